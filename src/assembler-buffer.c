@@ -30,6 +30,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -48,6 +49,7 @@
 #define PAGE_SIZE 0x1000
 #define INITIAL_SIZE (PAGE_SIZE * 64)
 #define MIN_INCREMENT (PAGE_SIZE * 64)
+#define MIN_HEADROOM (PAGE_SIZE * 16) /*e spare room for buffers in the middle of the code segment to grow into */
 
 #define MAX_ASM_WIDTH 14
 #define DISASSEMBLE_PRINT_MACHINE_CODE
@@ -70,9 +72,67 @@ typedef struct buffer_internal {
 static void *code_segment = NULL;
 static size_t code_segment_size = 0;
 static freelist_t *code_segment_free_list;
+//e protects the code segment and its free list: the dynamic compiler may run in a background thread
+static pthread_mutex_t code_segment_lock = PTHREAD_MUTEX_INITIALIZER;
 
 #define FREELIST
 
+#define CODE_SEGMENT_END		(((unsigned char *) code_segment) + code_segment_size)
+#define CODE_CHUNK_END(chunk)		(((unsigned char *) (chunk)) + sizeof(freelist_t) + (chunk)->size)
+
+/*e
+ * Appends a free chunk of at least `size' bytes (including its header) to the code segment
+ */
+static bool
+code_segment_grow(size_t size)
+{
+	const size_t old_size = code_segment_size;
+	size_t alloc_size = code_segment_size + MIN_INCREMENT;
+	if (MIN_INCREMENT < size + MIN_HEADROOM) {
+		alloc_size = (code_segment_size + size + MIN_INCREMENT) & (~(PAGE_SIZE-1));
+	}
+
+	// alloc executable memory
+	void *old_code_segment = code_segment; // error reporting
+
+	// Dieser Code funktioniert nicht auf OS X:
+	//void *mremap(void *old_address, size_t old_size, size_t new_size, int flags, ...);
+	//code_segment = (buffer_internal_t *) mremap(code_segment, old_size, alloc_size, 0);
+	// Daher verwenden wir diesen:
+	void *code_segment2 = mmap(((char *) code_segment) + old_size,
+				   alloc_size - old_size,
+				   PROT_READ | PROT_WRITE | PROT_EXEC,
+				   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+				   -1,
+				   0);
+	//exit(0);
+	if (code_segment2 == MAP_FAILED) {
+		perror("mmap");
+		fprintf(stderr, "Failed: mmap(%p, %zx, ...)\n", ((char *) code_segment) + old_size, alloc_size);
+		// Out of memory
+		return false;
+	}
+	assert(old_code_segment == code_segment);
+
+#ifdef DEBUG
+	fprintf(stderr, "[ABUF] L%d: Freelist at %p: ", __LINE__, code_segment_free_list);
+	if (code_segment_free_list) {
+		fprintf(stderr, "next=%p, size=%zx", code_segment_free_list->next, code_segment_free_list->size);
+	}
+	fprintf(stderr, "\n");
+#endif
+
+	freelist_t *new_freelist = (freelist_t *) (((unsigned char *)code_segment) + old_size);
+	code_segment_size = alloc_size;
+	new_freelist->next = code_segment_free_list;
+	new_freelist->size = alloc_size - old_size - sizeof(freelist_t);
+	code_segment_free_list = new_freelist;
+#ifdef DEBUG
+		fprintf(stderr, "[ABUF] L%d: Freelist at %p: next=%p, size=%zx\n", __LINE__, code_segment_free_list, code_segment_free_list->next, code_segment_free_list->size);
+#endif
+	return true;
+}
+
 static buffer_internal_t *
 code_alloc(size_t buf_size) // size does not include the header
 {
@@ -118,72 +178,42 @@ code_alloc(size_t buf_size) // size does not include the header
 
 	// NB: this will allocate the entire buffer on the first attempt, so
 	// use of buffer_terminate() is strongly encouraged.
-	// If we ever have more than one compilation thread, this will need revision.
-	freelist_t **free = &code_segment_free_list;
-	while (*free) {
-		if ((*free)->size >= buf_size) { // pick the first hit
-			freelist_t *buf_freelist = *free;
-			buffer_internal_t *buf = (buffer_internal_t *) *free;
-			// unchain
-			(*free) = buf_freelist->next;
-			buf->actual = 0;
+	//e Callers hold code_segment_lock.  With several compilation threads, one large buffer per thread
+	//e would split up the free space quickly, but we only ever have one background compiler.
+	//e Buffers never move (cf. code_realloc()), so they can only grow into free chunks right behind them.
+	//e Prefer the chunk at the end of the code segment, which can always grow; otherwise pick the largest
+	//e hit, but only if it leaves MIN_HEADROOM to spare.
+	freelist_t **free = NULL;
+	for (freelist_t **seeker = &code_segment_free_list; *seeker; seeker = &((*seeker)->next)) {
+		if (CODE_CHUNK_END(*seeker) == CODE_SEGMENT_END && (*seeker)->size >= buf_size) {
+			free = seeker;
+			break;
+		}
+		if ((*seeker)->size >= buf_size + MIN_HEADROOM
+		    && (!free || (*seeker)->size > (*free)->size)) {
+			free = seeker;
+		}
+	}
+	if (free) {
+		freelist_t *buf_freelist = *free;
+		buffer_internal_t *buf = (buffer_internal_t *) *free;
+		// unchain
+		(*free) = buf_freelist->next;
+		buf->actual = 0;
 #ifdef DEBUG
-			fprintf(stderr, "[ABUF] L%d: Freelist at %p: ", __LINE__, code_segment_free_list);
-			if (code_segment_free_list) {
-				fprintf(stderr, "next=%p, size=%zx", code_segment_free_list->next, code_segment_free_list->size);
-			}
-			fprintf(stderr, "\n");
-#endif
-			return buf;
+		fprintf(stderr, "[ABUF] L%d: Freelist at %p: ", __LINE__, code_segment_free_list);
+		if (code_segment_free_list) {
+			fprintf(stderr, "next=%p, size=%zx", code_segment_free_list->next, code_segment_free_list->size);
 		}
-		free = &((*free)->next);
+		fprintf(stderr, "\n");
+#endif
+		return buf;
 	}
 
 	// we ran out of space
-	const size_t old_size = code_segment_size;
-	size_t alloc_size = code_segment_size + MIN_INCREMENT;
-	if (alloc_size + code_segment_size < size) {
-		alloc_size = (code_segment_size + size + MIN_INCREMENT) & (~(PAGE_SIZE-1));
-	}
-
-	// alloc executable memory
-	void *old_code_segment = code_segment; // error reporting
-
-	// Dieser Code funktioniert nicht auf OS X:
-	//void *mremap(void *old_address, size_t old_size, size_t new_size, int flags, ...);
-	//code_segment = (buffer_internal_t *) mremap(code_segment, old_size, alloc_size, 0);
-	// Daher verwenden wir diesen:
-	void *code_segment2 = mmap(((char *) code_segment) + old_size,
-				   alloc_size - old_size,
-				   PROT_READ | PROT_WRITE | PROT_EXEC,
-				   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
-				   -1,
-				   0);
-	//exit(0);
-	if (code_segment2 == MAP_FAILED) {
-		perror("mmap");
-		fprintf(stderr, "Failed: mmap(%p, %zx, ...)\n", ((char *) code_segment) + old_size, alloc_size);
-		// Out of memory
+	if (!code_segment_grow(size)) {
 		return NULL;
 	}
-	assert(old_code_segment == code_segment);
-
-#ifdef DEBUG
-	fprintf(stderr, "[ABUF] L%d: Freelist at %p: ", __LINE__, code_segment_free_list);
-	if (code_segment_free_list) {
-		fprintf(stderr, "next=%p, size=%zx", code_segment_free_list->next, code_segment_free_list->size);
-	}
-	fprintf(stderr, "\n");
-#endif
-
-	freelist_t *new_freelist = (freelist_t *) (((unsigned char *)code_segment) + old_size);
-	code_segment_size = alloc_size;
-	new_freelist->next = code_segment_free_list;
-	new_freelist->size = alloc_size - old_size - sizeof(freelist_t);
-	code_segment_free_list = new_freelist;
-#ifdef DEBUG
-		fprintf(stderr, "[ABUF] L%d: Freelist at %p: next=%p, size=%zx\n", __LINE__, code_segment_free_list, code_segment_free_list->next, code_segment_free_list->size);
-#endif
 	return code_alloc(buf_size);
 }
 
@@ -203,22 +233,37 @@ code_free(buffer_internal_t *buf)
 	// size remains unchanged
 }
 
+/*e
+ * Grows `buf' in place to at least `size' bytes (without header)
+ *
+ * Buffers must not move: pending labels, call sites recorded by the dynamic compiler and
+ * stack maps all hold absolute addresses into them.  Instead, we absorb the free chunks that
+ * follow `buf', growing the code segment if `buf' is at its end.
+ */
 static buffer_internal_t * // only used if we _actually_ ran out of space
-code_realloc(buffer_internal_t *old_buf, size_t size)
+code_realloc(buffer_internal_t *buf, size_t size)
 {
-	buffer_internal_t *new_buf = code_alloc(size);
-#ifdef DEBUG
-	fprintf(stderr, "[ABUF] L%d: Realloc'd %p ->", __LINE__, old_buf);
-	fprintf(stderr, "%p (copying %zx) for %zx, now has %zx\n", new_buf, old_buf->actual, size, new_buf->allocd);
-#endif
-	memcpy(new_buf->data, old_buf->data, old_buf->actual);
-	new_buf->actual = old_buf->actual;
-	assert(new_buf->actual <= size);
-	code_free(old_buf);
+	while (buf->allocd < size) {
+		freelist_t *next = (freelist_t *) (buf->data + buf->allocd);
+		if ((unsigned char *) next == CODE_SEGMENT_END
+		    && !code_segment_grow(size - buf->allocd)) {
+			return NULL;
+		}
+		freelist_t **seeker = &code_segment_free_list;
+		while (*seeker && *seeker != next) {
+			seeker = &((*seeker)->next);
+		}
+		if (!*seeker) {
+			fail("code buffer outgrew its chunk");
+		}
+		// unchain
+		*seeker = next->next;
+		buf->allocd += sizeof(freelist_t) + next->size;
 #ifdef DEBUG
-	fprintf(stderr, "[ABUF] L%d: New buf has %zx\n", __LINE__, new_buf->allocd);
+		fprintf(stderr, "[ABUF] L%d: Grew %p in place to %zx\n", __LINE__, buf, buf->allocd);
 #endif
-	return new_buf;
+	}
+	return buf;
 }
 
 void
@@ -232,6 +277,7 @@ buffer_terminate(buffer_internal_t *buf)
 		left_over = 0;
 	}
 	buf->allocd -= left_over;
+	pthread_mutex_lock(&code_segment_lock);
 	if (left_over != 0) {
 		// then we have a new freelist entry
 		freelist_t *new_freelist = ((freelist_t *)end);
@@ -246,13 +292,16 @@ buffer_terminate(buffer_internal_t *buf)
 	}
 	fprintf(stderr, "\n");
 #endif
+	pthread_mutex_unlock(&code_segment_lock);
 }
 
 buffer_t
 buffer_new(size_t expected_size)
 {
 	assert(expected_size > 0);
+	pthread_mutex_lock(&code_segment_lock);
 	buffer_internal_t *buf = code_alloc(expected_size);
+	pthread_mutex_unlock(&code_segment_lock);
 	if (buf == NULL) {
 		fail("Out of code memory!");
 	}
@@ -266,7 +315,9 @@ buffer_new(size_t expected_size)
 void
 buffer_free(buffer_t buf)
 {
+	pthread_mutex_lock(&code_segment_lock);
 	code_free(buf);
+	pthread_mutex_unlock(&code_segment_lock);
 }
 
 size_t
@@ -289,11 +340,14 @@ buffer_alloc(buffer_t *buf, size_t bytes)
 	size_t required = buffer->actual + bytes;
 	if (required > buffer->allocd) {
 		size_t newsize = required + bytes; // some extra space
+		pthread_mutex_lock(&code_segment_lock);
 		buffer_t newbuf = code_realloc(buffer, newsize);
+		pthread_mutex_unlock(&code_segment_lock);
 		if (!newbuf) {
 			fail("Out of code memory!");
 		}
-		*buf = buffer = newbuf;
+		//e labels into the buffer (e.g., direct call sites) stay valid because buffers never move
+		assert(newbuf == buffer);
 	}
 	unsigned char * retval = buffer->data + buffer->actual;
 	buffer->actual += bytes;
@@ -73,6 +73,8 @@ $$BUILTIN_IDS$$
 #define OPT_FLAG_NO_TYPECHECK2	0x2
 #define OPT_FLAG_NO_LOWER	0x4
 #define OPT_FLAG_NO_UPPER	0x8
+#define OPT_FLAG_STACK_ALLOCATE	0x1	/*e NEWINSTANCE: object does not escape and may live in the stack frame */
+#define OPT_FLAG_GUARDED_CALL	0x1	/*e METHODAPP: call target predicted from type feedback; valid only if the receiver class matches */
 //e Flag usage varies by operator
 
 typedef struct ast_node {
@@ -35,6 +35,7 @@
 #include "class.h"
 #include "compiler-options.h"
 #include "data-flow.h"
+#include "object.h"
 #include "parser.h"
 #include "runtime.h"
 #include "symbol-table.h"
@@ -66,6 +67,11 @@
 #define COMPOPT_DEBUG_ADAPTIVE		6
 #define COMPOPT_DEBUG_GC		7
 #define COMPOPT_NO_ADAPTIVE		8
+#define COMPOPT_GC_THREADS		9
+#define COMPOPT_LARGE_OBJECT_THRESHOLD	10
+#define COMPOPT_GC_MARK_COMPACT		11
+#define COMPOPT_HEAP_MIN		12
+#define COMPOPT_BACKGROUND_COMPILATION	13
 
 typedef struct {
 	char *name;
@@ -91,12 +97,17 @@ static const option_rec_t options_printing[] = {
 static const option_rec_t options_compiler[] = {
 	{ "no-bounds-checks",		COMPOPT_NO_BOUNDS_CHECKS,	"Do not generate bounds-checking code for array accesses" },
 	{ "no-adaptive",		COMPOPT_NO_ADAPTIVE,		"Do not perform adaptive compilation" },
+	{ "background-jit",		COMPOPT_BACKGROUND_COMPILATION,	"Optimise hot code in a background thread while the program keeps running" },
 	{ "int-arrays",			COMPOPT_INT_ARRAYS,		"Change the type of array elements to 'int'" },
 	{ "debug-dynamic-compiler",	COMPOPT_DEBUG_DYNAMIC_COMPILER,	"Print out informative messages and disassembly during runtime compilation" },
 	{ "debug-asm",			COMPOPT_DEBUG_ASSEMBLY,		"Use interactive assembly debugger to run" },
 	{ "debug-adaptive",		COMPOPT_DEBUG_ADAPTIVE,		"Debug adaptive compilation" },
 	{ "debug-gc",			COMPOPT_DEBUG_GC,		"Debug automatic memory management" },
 	{ "debug-data-flow",		COMPOPT_DEBUG_DATA_FLOW,	"Debug the selected data flow analysis" },
+	{ "gc-threads=<n>",		COMPOPT_GC_THREADS,		"Use <n> threads for garbage collection" },
+	{ "gc-mark-compact",		COMPOPT_GC_MARK_COMPACT,	"Use mark-compact (instead of semispace copying) for major garbage collections" },
+	{ "heap-min=<n>",		COMPOPT_HEAP_MIN,		"Start with (and never shrink below) a heap of <n> kiB" },
+	{ "large-objects=<n>",		COMPOPT_LARGE_OBJECT_THRESHOLD,	"Allocate objects of <n> or more bytes in the non-moving large object space" },
 	{ NULL, 0, NULL }
 };
 
@@ -111,12 +122,21 @@ print_options(const option_rec_t *options, char *indent)
 	}
 }
 
+static char *option_value; /*e set by pick_option() for options of the form `name=<value>' */
+
 static int
 pick_option(const option_rec_t *options, char *msg, char *s)
 {
 	const option_rec_t *orig_options = options;
 	while (options->name) {
-		if (!strcmp(s, options->name)) {
+		char *value_start = strchr(options->name, '=');
+		if (value_start) {
+			const size_t name_len = value_start - options->name + 1;
+			if (!strncmp(s, options->name, name_len)) {
+				option_value = s + name_len;
+				return options->option;
+			}
+		} else if (!strcmp(s, options->name)) {
 			return options->option;
 		}
 		++options;
@@ -143,7 +163,7 @@ print_help(char *fn)
 	       "\t-h\tPrint this help information\n"
 	       "\t-x\tExecute program (default action)\n"
 	       "\t-t\tTime program execution\n"
-	       "\t-m <n>\tSet heap size to <n> kiB\n"
+	       "\t-m <n>\tSet maximum heap size to <n> kiB\n"
 	       "\t-f <n>\tActivate various compiler options, with <n> from:\n");
 	print_options(options_compiler, "\t\t\t");
 	printf("\t-p <n>\tPrint intermediate representation, with <n> from:\n");
@@ -266,6 +286,10 @@ main(int argc, char **argv)
 				compiler_options.no_adaptive_compilation = true;
 				break;
 
+			case COMPOPT_BACKGROUND_COMPILATION:
+				compiler_options.background_compilation = true;
+				break;
+
 			case COMPOPT_INT_ARRAYS:
 				compiler_options.array_storage_type = TYPE_INT;
 				break;
@@ -289,6 +313,38 @@ main(int argc, char **argv)
 			case COMPOPT_DEBUG_DATA_FLOW:
 				debug_data_flow = true;
 				break;
+
+			case COMPOPT_GC_THREADS:
+				compiler_options.gc_threads = strtol(option_value, NULL, 0);
+				if (compiler_options.gc_threads < 1) {
+					fprintf(stderr, "gc-threads: expected a positive number of threads\n");
+					exit(1);
+				}
+				break;
+
+			case COMPOPT_GC_MARK_COMPACT:
+				compiler_options.gc_mark_compact = true;
+				break;
+
+			case COMPOPT_HEAP_MIN: {
+				long heap_min = strtol(option_value, NULL, 0);
+				if (heap_min < 1) {
+					fprintf(stderr, "heap-min: expected a positive number of kiB\n");
+					exit(1);
+				}
+				compiler_options.heap_min_size = 1024 * heap_min;
+				break;
+			}
+
+			case COMPOPT_LARGE_OBJECT_THRESHOLD: {
+				long threshold = strtol(option_value, NULL, 0);
+				if (threshold < 1) {
+					fprintf(stderr, "large-objects: expected a positive number of bytes\n");
+					exit(1);
+				}
+				compiler_options.large_object_threshold = threshold;
+				break;
+			}
 			}
 			break;
 
@@ -388,6 +444,9 @@ main(int argc, char **argv)
 		fprintf(stderr, "Total\t");
 		timer_print(stderr, &timer);
 		fprintf(stderr, "\n");
+		unsigned long long hits, misses;
+		object_selector_cache_stats(&hits, &misses);
+		fprintf(stderr, "Selector cache\t%llu hits, %llu misses\n", hits, misses);
 	}
 	return 0;
 }
@@ -33,6 +33,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <sys/wait.h>
 #ifdef DEBUG
 #  define __USE_GNU
 #  include <signal.h>
@@ -222,6 +223,65 @@ test_run(char *source, char *expected_result, int line)
 	runtime_image = image;
 }
 
+/*e
+ * Runs a program that should halt with a runtime error, in a child process
+ *
+ * @param expected_error The error output must start with this string
+ */
+void
+test_run_failure(char *source, char *expected_error, int line)
+{
+	test_cleanup();
+	++runs;
+	builtins_reset();
+	if (post_builtins_init) {
+		post_builtins_init();
+	}
+	printf("[L%d] \033[4;1mTesting\033[0m: \t", line);
+	fflush(NULL);
+
+	int error_pipe[2];
+	if (pipe(error_pipe)) {
+		perror("pipe");
+		signal_failure();
+		return;
+	}
+	pid_t child = fork();
+	if (child == 0) {
+		close(error_pipe[0]);
+		dup2(error_pipe[1], STDERR_FILENO);
+		runtime_image_t *image = compile(source, line);
+		if (image) {
+			runtime_execute(image);
+		}
+		fflush(NULL);
+		_exit(0);
+	}
+	close(error_pipe[1]);
+
+	char error_buf[4096 + 1];
+	size_t error_len = 0;
+	ssize_t bytes_read;
+	while (error_len < sizeof(error_buf) - 1
+	       && (bytes_read = read(error_pipe[0], error_buf + error_len, sizeof(error_buf) - 1 - error_len)) > 0) {
+		error_len += bytes_read;
+	}
+	error_buf[error_len] = 0;
+	close(error_pipe[0]);
+	int status;
+	waitpid(child, &status, 0);
+
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 1
+	    && !strncmp(error_buf, expected_error, strlen(expected_error))) {
+		signal_success();
+	} else {
+		signal_failure();
+		fprintf(stderr, "[L%d] Expected runtime error starting with `%s', got status %d and error output:\n%s\n",
+			line, expected_error, status, error_buf);
+		fprintf(stderr, "[L%d] From program `%s'\n", line, source);
+	}
+}
+
 static void
 dump_bitvector(bitvector_t bitvector)
 {
@@ -297,7 +357,8 @@ check_memory_maps(int line,
 			void *addr = *((void **)(stack_get(stackmap_debug_stack, i)));
 			symtab_entry_t *ste;
 			bitvector_t bv;
-			if (!stackmap_get(addr, &bv, &ste)) {
+			int frame_start;
+			if (!stackmap_get(addr, &bv, &ste, &frame_start)) {
 				fprintf(stderr, "Address %p was supposed to be in stackmap but isn't!\n", addr);
 				success = false;
 			} else {
@@ -325,6 +386,7 @@ check_memory_maps(int line,
 
 
 #define TEST(program, expected) test_run(program, expected, __LINE__);
+#define TEST_FAILURE(program, expected_error) test_run_failure(program, expected_error, __LINE__);
 
 char* mk_unique_string(char *id); // lexer
 
@@ -364,6 +426,153 @@ init_selectors(void)
 		}
 	}
 }
+/*e
+ * Checks that the function `callee_name' of the most recent test program has at most
+ * `max_call_sites_nr' recorded direct call sites (cf. dyncomp_add_call_site())
+ */
+static void
+check_call_sites(int line, char *callee_name, size_t max_call_sites_nr)
+{
+	++runs;
+	printf("[L%d] \033[4;1mC-Testing\033[0m: \t", line);
+	symtab_entry_t *callee = NULL;
+	for (int i = 1; i <= symtab_entries_nr; i++) {
+		symtab_entry_t *sym = symtab_lookup(i);
+		if (SYMTAB_KIND(sym) == SYMTAB_KIND_FUNCTION && !strcmp(sym->name, callee_name)) {
+			callee = sym;
+		}
+	}
+	if (!callee) {
+		signal_failure();
+		fprintf(stderr, "[L%d] No function `%s'\n", line, callee_name);
+		return;
+	}
+	const size_t call_sites_nr = callee->r_call_sites ? stack_size(callee->r_call_sites) : 0;
+	if (call_sites_nr > max_call_sites_nr) {
+		signal_failure();
+		fprintf(stderr, "[L%d] `%s' has %zu call sites, expected at most %zu\n", line, callee_name, call_sites_nr, max_call_sites_nr);
+		return;
+	}
+	signal_success();
+}
+
+#define DISPATCH_TEST_CLASSES_NR	4
+#define DISPATCH_TEST_FIELDS_NR		3
+
+//e creates a class whose field `selectors[i]' is at offset (i + shift) % DISPATCH_TEST_FIELDS_NR
+static class_t *
+dispatch_test_class(symtab_entry_t **selectors, int shift, bool with_fields)
+{
+	symtab_entry_t *entry = symtab_new(0, SYMTAB_KIND_CLASS, "DispatchTest", NULL);
+	entry->storage.fields_nr = DISPATCH_TEST_FIELDS_NR;
+	class_t *classref = class_new(entry);
+	for (int i = 0; with_fields && i < DISPATCH_TEST_FIELDS_NR; i++) {
+		symtab_entry_t *field = symtab_new(TYPE_INT, SYMTAB_KIND_VAR | SYMTAB_MEMBER, selectors[i]->name, NULL);
+		field->parent = entry;
+		field->selector = selectors[i]->selector;
+		field->offset = (i + shift) % DISPATCH_TEST_FIELDS_NR;
+		class_add_selector(classref, field);
+	}
+	return classref;
+}
+
+//e does every field of `classref' read back through the dispatch table and the selector cache?
+static bool
+dispatch_test_class_check(class_t *classref, symtab_entry_t **selectors, int shift)
+{
+	bool success = true;
+	struct {
+		class_t *classref;
+		object_member_t fields[DISPATCH_TEST_FIELDS_NR];
+	} object;
+	object.classref = classref;
+	for (int i = 0; i < DISPATCH_TEST_FIELDS_NR; i++) {
+		object.fields[(i + shift) % DISPATCH_TEST_FIELDS_NR].int_v = i;
+	}
+	for (int i = 0; i < DISPATCH_TEST_FIELDS_NR; i++) {
+		const unsigned long long coding = class_lookup_selector(classref, selectors[i]->selector);
+		if (!coding || CLASS_DECODE_SELECTOR_OFFSET(coding) != (i + shift) % DISPATCH_TEST_FIELDS_NR) {
+			fprintf(stderr, "Dispatch table: class %p, selector %d: found %llx\n", classref, selectors[i]->selector, coding);
+			success = false;
+		} else {
+			//e twice, so that the second read hits in the selector cache
+			for (int k = 0; k < 2; k++) {
+				long long int value = object_read_member_field_int((object_t *) &object, NULL, selectors[i]->selector);
+				if (value != i) {
+					fprintf(stderr, "Selector lookup: class %p, selector %d: read %lld, expected %d\n",
+						classref, selectors[i]->selector, value, i);
+					success = false;
+				}
+			}
+		}
+	}
+	return success;
+}
+
+/*e
+ * Row displacement: classes that share all selectors, at different offsets, must get
+ * non-overlapping dispatch table rows.  class_free() must remove the row of the freed class,
+ * since classes allocated later may get its memory.
+ */
+static void
+check_dispatch_table(int line)
+{
+	test_cleanup();
+	++runs;
+	builtins_reset();
+	printf("[L%d] \033[4;1mD-Testing\033[0m: \t", line);
+	bool success = true;
+
+	symtab_entry_t *selectors[DISPATCH_TEST_FIELDS_NR];
+	char name[] = "dispatch_test_a";
+	for (int i = 0; i < DISPATCH_TEST_FIELDS_NR; i++) {
+		name[sizeof(name) - 2] = 'a' + i;
+		selectors[i] = symtab_selector(name);
+	}
+
+	class_t *classes[DISPATCH_TEST_CLASSES_NR];
+	for (int shift = 0; shift < DISPATCH_TEST_CLASSES_NR; shift++) {
+		classes[shift] = dispatch_test_class(selectors, shift, true);
+	}
+	for (int shift = 0; shift < DISPATCH_TEST_CLASSES_NR; shift++) {
+		success &= dispatch_test_class_check(classes[shift], selectors, shift);
+	}
+
+	//e (we only compare against the freed pointer, we don't dereference it)
+	class_t *freed = classes[0];
+	class_free(freed);
+	for (size_t i = 0; i < class_dispatch_table_size; i++) {
+		if (class_dispatch_table[i].classref == freed) {
+			fprintf(stderr, "Dispatch table: entry %zu still refers to freed class %p\n", i, freed);
+			success = false;
+		}
+	}
+	class_t *empty = dispatch_test_class(selectors, 0, false);
+	for (int i = 0; i < DISPATCH_TEST_FIELDS_NR; i++) {
+		if (class_lookup_selector(empty, selectors[i]->selector)) {
+			fprintf(stderr, "Dispatch table: class %p without members has selector %d\n", empty, selectors[i]->selector);
+			success = false;
+		}
+	}
+	//e re-link, possibly into the memory of the freed class, with a different layout
+	class_free(classes[1]);
+	classes[1] = dispatch_test_class(selectors, 2, true);
+	success &= dispatch_test_class_check(classes[1], selectors, 2);
+	for (int shift = 2; shift < DISPATCH_TEST_CLASSES_NR; shift++) {
+		success &= dispatch_test_class_check(classes[shift], selectors, shift);
+	}
+
+	class_free(empty);
+	for (int shift = 1; shift < DISPATCH_TEST_CLASSES_NR; shift++) {
+		class_free(classes[shift]);
+	}
+	if (success) {
+		signal_success();
+	} else {
+		signal_failure();
+	}
+}
+
 int
 main(int argc, char **argv)
 {
@@ -466,6 +675,12 @@ main(int argc, char **argv)
 	TEST("if (NULL is int) { print(\"1\"); }", "");
 	TEST("if (NULL is string) { print(\"1\"); }", "");
 
+	//e tagged ints and boxed ints beyond 63 bits
+	TEST("{ obj x = 4611686018427387903; print(x); x := x + 1; print(x); obj y = x - 1; print(y + 1 == x); if (x is int) print(1); }", "4611686018427387903\n4611686018427387904\n1\n1\n");
+	TEST("{ obj x = 0 - 4611686018427387904; print(x); x := x - 1; print(x); print(x + 1); }", "-4611686018427387904\n-4611686018427387905\n-4611686018427387904\n");
+	TEST("{ obj x = 5; obj y = 2 + 3; if (x == 5) print(1); if (5 == x) print(2); if (x == y) print(3); if (x != \"5\") print(4); }", "1\n2\n3\n4\n");
+	TEST("class C() { int i = 0; obj o = NULL; } obj c = C(); obj x = 0 - 7; c.i := x; c.o := c.i * 2; print(c.i); print(c.o);", "-7\n-14\n");
+
 	// skip
 	TEST("print(1);;;;;print(2);", "1\n2\n");
 	//e functions
@@ -512,6 +727,8 @@ main(int argc, char **argv)
 	TEST("class C(){ int x = 17; }; obj a = C(); print(a.x); ", "17\n");
 	TEST("class C(int a){ int x = a; }; obj a = C(1); obj b = C(2); print(a.x); print(b.x);", "1\n2\n");
 	TEST("class C(int a){ int x = a; int y = a*3;}; obj a = C(1); print(a.x); print(a.y);", "1\n3\n");
+	//e inline caches: the same field is int-typed in one class and obj-typed in another, and shifted in a third
+	TEST("class A() { int x = 1; } class B() { obj x = 2; } class C() { int y = 0; obj z = NULL; int x = 3; } obj a = [A(), B(), C(), NULL]; int i = 0; int s = 0; obj t = 0; while (i < 300) { obj o = a[i - ((i / 3) * 3)]; o.x := o.x + 1; s := s + o.x; t := t + o.x; i := i + 1; } print(s); print(t); print(a[1].x); print(a[2].x);", "15750\n15750\n102\n103\n");
 	TEST("class C(int a){ int x = a; print(a); int y = a*3;}; obj a = C(1); print(a.x + 1); print(a.y);", "1\n2\n3\n");
 	TEST("int z = 0; class C(int a) { z := z + 1; }; print(z); obj a = C(1);print(z); a := C(1); print(z);", "0\n1\n2\n");
 
@@ -566,6 +783,11 @@ main(int argc, char **argv)
 	TEST("class C() { obj p(obj x, int y) { print(x+y); } obj q() { p(1, 2); } } obj a = C(); a.q();", "3\n");
 	// the bug is in C.p's reading of variable k
 	TEST("class C(int z) { int k = z; int p(int l) { return k + l; } obj q() { print(p(2)); } } obj a = C(3); a.q();", "5\n");
+	//e inline caches: monomorphic, polymorphic and megamorphic call sites, and methods with clashing selectors
+	TEST("class A() { int m(int x) { return x + 1; } } class B() { int m(int x) { return x + 2; } } class C() { int m(int x) { return x + 3; } } class D() { int m(int x) { return x + 4; } } class E() { int m(int x) { return x + 5; } } class F() { int n() { return 0; } int m(int x) { return x + 6; } } obj a = [A(), B(), C(), D(), E(), F()]; int i = 0; int s = 0; int t = 0; while (i < 6000) { s := s + a[i - ((i / 6) * 6)].m(i); t := t + a[0].m(1); i := i + 1; } print(s); print(t);", "18018000\n12000\n");
+	//e dispatch table: classes sharing selectors at different offsets (displaced rows), and re-linking after class_free()
+	TEST("class A() { int a = 1; int b = 2; int get() { return a + b; } } class B() { int b = 10; int get() { return b * 2; } int a = 20; } class C() { int get() { return 7; } int c = 3; int a = 30; int b = 40; } obj xs = [A(), B(), C()]; int s = 0; int i = 0; while (i < 300) { obj x = xs[i - ((i / 3) * 3)]; s := s + x.a; s := s + x.b * 100; s := s + x.get() * 10000; i := i + 1; } print(s);", "30525100\n");
+	check_dispatch_table(__LINE__);
 
 	TEST("class C() { obj p() { int x = 0; print(x); x := 1; print(x); int y = 2; print(y); } } obj c = C(); c.p(); print(3); ", "0\n1\n2\n3\n");
 	TEST("class C() { obj x = \"unused\"; { int x = 0; print(x); x := 1; print(x); int y = 2; print(y); } } obj c = C(); print(3); ", "0\n1\n2\n3\n");
@@ -595,9 +817,111 @@ main(int argc, char **argv)
 	TEST("class C(obj parent) { obj p = parent; obj v = 0; } obj c = C(C(C(NULL))); print(c.p.p.v); ", "0\n");
 	TEST("class C(obj parent, int i) { obj p = parent; obj v = i; } obj c = C(C(C(NULL, 3), 2), 1); obj d = C(C(NULL, 10), 9); print(c.v); print(c.p.v); print(d.p.v);", "1\n2\n10\n");
 	TEST("class C(obj parent, int i) { obj p = parent; obj v = i; } obj c = C(C(C(NULL, 3), 2), 1); obj d = C(C(NULL, 10), 9); c.v := d.v; print(c.v);", "9\n");
+
+	//e garbage collection: references from promoted objects into the nursery (write barrier)
+	char *write_barrier_program = "class C() { obj v = NULL; obj w = NULL; obj set(obj x) { w := x; } } obj head = C(); obj a = [/ 10]; int i = 0; int bad = 0; while (i < 30000) { head.v := [i]; head.set([i]); a[i - ((i / 10) * 10)] := [i]; obj t = [/ 30]; if (head.v[0] != i) bad := bad + 1; if (head.w[0] != i) bad := bad + 1; if (a[i - ((i / 10) * 10)][0] != i) bad := bad + 1; i := i + 1; } print(bad);";
+	const size_t default_heap_size = compiler_options.heap_size;
+	compiler_options.heap_size = 0x40000;
+	TEST(write_barrier_program, "0\n");
+	//e same, with the parallel collector
+	compiler_options.gc_threads = 4;
+	TEST(write_barrier_program, "0\n");
+	compiler_options.gc_threads = 1;
+
+	//e same, with mark-compact major collections
+	compiler_options.gc_mark_compact = true;
+	TEST(write_barrier_program, "0\n");
+	compiler_options.gc_mark_compact = false;
+
+	//e same, with array headers at the very end of dirty cards (their elements start in the next card)
+	TEST("obj keep = [/ 1000]; int i = 0; while (i < 1000) { if (i - ((i / 3) * 3) == 0) keep[i] := [i]; else keep[i] := [i, i]; i := i + 1; } i := 0; int bad = 0; while (i < 60000) { int j = i - ((i / 1000) * 1000); keep[j][0] := [i]; obj junk = [/ 20]; i := i + 1; } i := 0; while (i < 1000) { if (keep[i][0][0] != 59000 + i) bad := bad + 1; i := i + 1; } print(bad);", "0\n");
+	//e survivors that do not all fit into old space: the collector leaves the rest in the nursery
+	TEST("class Cons(int v, obj a) { obj next = a; int value = v; } obj big = [/ 7000]; obj l = NULL; int i = 0; while (i < 4200) { l := Cons(i, l); obj g = [i, i, i]; i := i + 1; } int s = 0; while (l != NULL) { s := s + l.value; l := l.next; } print(s + big.size());", "8824900\n");
+	//e old space may use the memory that the large object space does not need
+	TEST("class Cons(int v, obj a) { obj next = a; int value = v; } obj l = NULL; int i = 0; while (i < 5000) { l := Cons(i, l); obj g = [i, i, i]; i := i + 1; } int s = 0; while (l != NULL) { s := s + l.value; l := l.next; } print(s);", "12497500\n");
+
+	//e large object space: references from large objects into the nursery, reclaiming large objects
+	const size_t default_large_object_threshold = compiler_options.large_object_threshold;
+	compiler_options.large_object_threshold = 0x800;
+	TEST("obj keep = [/ 500]; obj tmp = NULL; int i = 0; int bad = 0; while (i < 10000) { keep[i - ((i / 500) * 500)] := [i]; if (i - ((i / 100) * 100) == 0) { tmp := [/ 300]; tmp[7] := [i]; } if (keep[i - ((i / 500) * 500)][0] != i) bad := bad + 1; if (tmp[7][0] != (i / 100) * 100) bad := bad + 1; i := i + 1; } i := 0; while (i < 500) { if (keep[i][0] != 9500 + i) bad := bad + 1; i := i + 1; } print(bad);", "0\n");
+	//e same, with a threshold below HEAP_INLINE_ALLOCATION_MAX: literal arrays and instances must not be allocated inline
+	compiler_options.heap_size = default_heap_size;
+	compiler_options.large_object_threshold = 0x20;
+	TEST("class P(obj a) { obj x = a; obj y = NULL; obj z = NULL; } obj keep = [/ 50]; int i = 0; int bad = 0; while (i < 5000) { int j = i - ((i / 50) * 50); keep[j] := P([i, i, i]); keep[j].y := [i]; if (keep[j].x[2] + keep[j].y[0] != i + i) bad := bad + 1; i := i + 1; } i := 0; while (i < 50) { if (keep[i].x[0] != 4950 + i) bad := bad + 1; i := i + 1; } print(bad);", "0\n");
+	compiler_options.large_object_threshold = default_large_object_threshold;
+
+	//e growing the heap beyond its initial size
+	const size_t default_heap_min_size = compiler_options.heap_min_size;
+	compiler_options.heap_min_size = 0x40000;
+	compiler_options.heap_size = 0x1000000;
+	TEST("class Cons(obj h, obj t) { obj head = h; obj tail = t; } obj l = NULL; int i = 0; while (i < 30000) { l := Cons(i, l); i := i + 1; } int s = 0; while (l != NULL) { s := s + l.head; l := l.tail; } print(s);", "449985000\n");
+	//e field writes through inline caches must trigger the write barrier for old objects
+	TEST("class C() { obj v = NULL; } obj keep = [C(), C()]; obj junk = NULL; int i = 0; while (i < 20000) { junk := [/ 20]; keep[i - ((i / 2) * 2)].v := [i]; i := i + 1; } print(keep[0].v[0] + keep[1].v[0]);", "39997\n");
+	//e escape analysis: hot function with non-escaping (stack-allocated) and escaping instances, under GC pressure
+	TEST("class P(int a) { int x = a; obj s = [a, a + 1]; obj next = NULL; } obj keep = NULL; int f(int i) { obj p = P(i); obj q = P(i + 1); obj r = P(i + 2); if (i == 5) keep := q; p.next := r; int k = 0; obj junk = NULL; while (k < 10) { junk := [k, junk]; k := k + 1; } p.x := p.x + 1; return p.x + p.s[1] + p.next.x + q.x; } int total = 0; int i = 0; while (i < 20000) { total := total + f(i); i := i + 1; } print(total); print(keep.s[0]);", "800060000\n6\n");
+	compiler_options.heap_min_size = default_heap_min_size;
+	compiler_options.heap_size = default_heap_size;
 #endif
 	TEST("class C(obj parent, int i) { obj p = parent; obj v = i; } obj c = C(C(C(NULL, 3), 2), 1); obj d = C(C(NULL, 10), 9); c.p.v := d.p.v; print(c.p.v);", "10\n");
 	TEST("class C(obj parent, int i) { obj p = parent; obj v = i; } obj c = C(C(C(NULL, 3), 2), 1); c.p.v := 1 + 2; print(c.p.v);", "3\n");
+	//e call sites are back-patched across compilation, optimisation and deoptimisation
+	TEST("class A() { int v = 1; int get(int k) { return v + k; } } class B() { int v = 2; int get(int k) { return v * k; } } int f(obj a, int k) { return a.v + a.get(k); } int total = 0; int i = 0; obj a = A(); obj b = B(); while (i < 3000) { total := total + f(a, i); i := i + 1; } while (i < 6000) { total := total + f(b, i); i := i + 1; } while (i < 9000) { total := total + f(a, i); i := i + 1; } print(total);", "54012000\n");
+	TEST("class A() { int v = 1; } class B() { int v = 2; } class C(int w) { int u = w; int m(int k, obj a, int j) { return u + k + a.v + j; } } obj c = C(100); obj a = A(); obj b = B(); int t = 0; int i = 0; while (i < 100) { t := t + c.m(i, a, 1); i := i + 1; } t := t + c.m(1000, b, 10000); print(t);", "26252\n");
+	//e register allocation in optimised code: nested loops, more candidates than registers, methods
+	TEST("int f(int n) { int s = 0; int i = 0; while (i < n) { int j = 0; while (j < 10) { s := s + i * j; j := j + 1; } i := i + 1; } return s; } int t = 0; int k = 0; while (k < 200) { t := t + f(k); k := k + 1; } print(t);", "59103000\n");
+	TEST("class C(int w) { int u = w; int m(int n, int k) { int x = 0; int i = 0; while (i < n) { x := x + i * k + u; i := i + 1; } return x; } } int f(int n, int m) { int a = 0; int b = 1; int c = 2; int d = 3; int i = 0; while (i < n) { a := a + i; b := b + a + m; c := c + b; d := d + c / 100; i := i + 1; } return a + b + c + d; } obj o = C(3); int t = 0; int k = 0; while (k < 60) { t := t + f(k, 7) + o.m(k, 2); k := k + 1; } print(t);", "8085356\n");
+	//e inlining of small methods and functions into optimised code, including GC and deoptimisation
+	TEST("class P(int a, int b) { int x = a; int y = b; obj s = [a]; int getx() { return x; } int sum(int k) { if (k > 500) { return x + y + k; } return x + k; } obj gets() { return s; } } int sq(int v) { return v * v; } int f(obj p, int i) { int r = p.getx(); r := r + p.sum(i); r := r + sq(i); obj s = p.gets(); return r + s[0]; } int t = 0; int i = 0; obj p = P(3, 4); while (i < 1000) { t := t + f(p, i); obj junk = [i, i]; i := i + 1; } print(t);", "333343996\n");
+	TEST("class P(int a) { obj s = [a]; obj pair(obj o) { obj t = [o, s]; return t; } } obj f(obj p, obj q) { obj u = p.pair(q); obj v = p.pair(u); return v; } obj p = P(7); int i = 0; int bad = 0; while (i < 100000) { obj q = [i]; obj r = f(p, q); if (r[0][0] != q) bad := bad + 1; if (r[1][0] != 7) bad := bad + 1; if (r[0][1][0] != 7) bad := bad + 1; i := i + 1; } print(bad);", "0\n");
+	TEST("class P(int a) { int v = a; int get() { return v; } } class Q(int a) { int v = a; int get() { return v * 100; } } int f(obj p) { int r = p.get(); return r + 1; } obj p = P(2); obj q = Q(3); int t = 0; int i = 0; while (i < 100) { t := t + f(p); i := i + 1; } t := t + f(q); print(t);", "601\n");
+
+	//e constant propagation: folding, pruned IF/WHILE branches
+	TEST("int f(int n) { int x = 3; int y = x + x; if (y > 5) { n := n + y; } else { n := n - 1; } while (x < 0) { n := n + 1000; } int z = y * 7 / 2 - (x == 3); return n * y + z; } int s = 0; int i = 0; while (i < 20000) { s := s + f(i); i := i + 1; } print(s);", "1201060000\n");
+	TEST("int f(int n) { int c = 1; int d = 2; int s = 0; int i = 0; if (n > 50) { d := 3; } while (i < n) { s := s + c * d; c := c + 1; i := i + 1; } if (c == n + 1) { s := s + 1; } return s; } int t = 0; int k = 0; while (k < 100) { t := t + f(k); k := k + 1; } print(t);", "477950\n");
+	//e loop-invariant code motion, including array type checks hoisted via loop versioning
+	TEST("class C(int k) { int kk = k; obj w = [k, k + 1]; int run(int n) { int i = 0; int s = 0; while (i < n) { int j = 0; while (j < 2) { s := s + kk * 3 + n / 2 + w[j] * i; j := j + 1; } i := i + 1; } return s; } } obj c = C(7); int r = 0; int j = 0; while (j < 300) { r := r + c.run(j); j := j + 1; } print(r);", "77642750\n");
+	TEST("int f(obj a, int n, int k) { int i = 0; int s = 0; while (i < n) { if (k) { s := s + a[i / 100]; } s := s + n * k + a.size(); i := i + 1; } return s; } obj a = [1, 2, 3]; int t = 0; int i = 0; while (i < 300) { t := t + f(a, i, 1); obj b = \"abcd\"; t := t + f(b, i, 0); i := i + 1; } t := t + f(a, 0, 1); print(t);", "9338700\n");
+	//e bounds checks hoisted for induction variables, with fallback when the preheader checks fail
+	TEST("int sieve(int size) { int max = 0; obj s = [/size]; int x = 2; while (x < size) { if (NULL == s[x]) { max := x; int fill = x + x; while (fill < size) { s[fill] := x; fill := fill + x; } } x := x + 1; } return max; } int t = 0; int i = 0; while (i < 50) { t := t + sieve(1000 + i); i := i + 1; } print(t);", "50982\n");
+	TEST("int f(obj a, int lo, int n, int st) { int s = 0; int i = lo; while (i < n) { s := s + a[i]; i := i + st; } return s; } obj a = [1, 2, 3, 4, 5, 6, 7, 8, 9, 10]; int t = 0; int k = 0; while (k < 300) { t := t + f(a, 0, 10, 1) + f(a, 3, 8, 2); k := k + 1; } print(t); print(f(a, 0, 10, 20));", "21900\n1\n");
+	//e constructors: `self' stays a GC root while field initialisers allocate
+	TEST("class C(int n) { obj a = [n]; obj b = [/10000]; obj c = [n, n]; int get() { return a[0] + c[1]; } } int t = 0; int i = 0; while (i < 2000) { obj o = C(i); t := t + o.get(); i := i + 1; } print(t);", "3998000\n");
+	//e large functions: code buffers outgrow their initial chunk and must grow in place
+	{
+		const int statements_nr = 6000;
+		char *program = malloc(statements_nr * 32 + 256);
+		char *pos = program + sprintf(program, "int g(int x) { return x + 1; } int big(int a) { int s = 0;");
+		for (int i = 0; i < statements_nr; i++) {
+			pos += sprintf(pos, " s := s + g(a + %d);", i);
+		}
+		sprintf(pos, " return s; } print(big(1)); print(big(2)); print(big(3));");
+		TEST(program, "18009000\n18015000\n18021000\n");
+		free(program);
+	}
+	//e runtime errors: failed selector lookups report only the error
+	TEST_FAILURE("class A() { int v = 1; } obj x = A(); x.foo();", "Fatal: Object at ");
+	TEST_FAILURE("obj x = 3; x.foo();", "Fatal: Object at ");
+	//e on-stack replacement of long-running loops in functions, methods and the main program
+	TEST("int f(int n) { obj a = [1, 2]; int s = 0; int i = 0; while (i < n) { s := s + a[i - (i / 2) * 2] + i; i := i + 1; } return s; } print(f(100000));", "5000100000\n");
+	TEST("class C(int k) { int w = k; int m(int n) { int s = 0; int i = 0; while (i < n) { s := s + w; i := i + 1; } return s; } } print(C(3).m(50000));", "150000\n");
+	TEST("int s = 0; int i = 0; obj a = [5, 7]; while (i < 100000) { s := s + a[i - (i / 2) * 2]; i := i + 1; } print(s); print(i);", "600000\n100000\n");
+	//e repeated deoptimisation: back off, then stop specialising on the polymorphic parameter
+	TEST("class A() { int v = 1; int get(int k) { return v + k; } } class B() { int v = 2; int get(int k) { return v * k; } } int f(obj a, int k) { return a.get(k); } int total = 0; int i = 0; obj a = A(); obj b = B(); while (i < 3000) { total := total + f(a, i); i := i + 1; } while (i < 9000) { total := total + f(a, i) + f(b, i); i := i + 1; } print(total);", "112498500\n");
+	//e specialised versions per parameter class tuple, selected by the type dispatcher or bound directly by callers; a version without guards once the cache is full
+	TEST("class A() { int v = 1; int get(int k) { return v + k; } } class B() { obj w = NULL; int v = 2; int get(int k) { return v * k; } } int f(obj a, int k) { int r = a.get(k); return r + a.v; } int g(int k) { obj b = B(); int r = f(b, k); return r; } int t = 0; int i = 0; obj a = A(); obj b = B(); while (i < 3000) { t := t + f(a, i); i := i + 1; } while (i < 9000) { t := t + f(a, i) + f(b, i); i := i + 1; } while (i < 12000) { t := t + g(i); i := i + 1; } print(t);", "175522500\n");
+	TEST("class A() { int v = 1; } class B() { int v = 2; } class C() { int v = 3; } class D() { int v = 4; } class E() { int v = 5; } class F() { int v = 6; } int f(obj a, int k) { return a.v + k; } obj all = [A(), B(), C(), D(), E(), F(), NULL]; int t = 0; int i = 0; while (i < 30000) { int j = i / 5000; obj o = all[j]; if (j < 6) { t := t + f(o, i); } t := t + f(all[0], 1); i := i + 1; } print(t);", "450150000\n");
+	//e repeated deoptimisation of a function that can't have a type dispatcher: the call sites in each discarded version are dropped
+	TEST("class A() { int v = 1; } class B() { int v = 2; } obj w = [A()]; int g(obj z, int x) { int s = x; int i = 0; while (i < 3) { s := s + i * x; i := i + 1; } return s + z.v; } int f(obj a, obj b, obj c, obj d, obj e, obj h, obj k) { return g(w[0], a.v + b.v + c.v + d.v + e.v + h.v + k.v); } obj x = A(); obj y = B(); int t = 0; int p = 0; while (p < 20) { obj o = x; if (p - ((p / 2) * 2) == 1) o := y; int i = 0; while (i < 3000) { t := t + f(o, o, o, o, o, o, o); i := i + 1; } p := p + 1; } print(t);", "2580000\n");
+	check_call_sites(__LINE__, "g", 2);
+	//e type feedback: receivers of calls and field reads on fields and return values, including receivers of other classes later on
+	TEST("class A() { int v = 1; int get(int k) { return v + k; } } class B() { int v = 2; int get(int k) { return v * k; } } class H(obj x) { obj o = x; obj it() { return o; } } int f(obj h, int k) { int r = h.o.get(k); r := r + h.it().get(k); return r + h.o.v; } int t = 0; int i = 0; obj a = H(A()); obj b = H(B()); while (i < 3000) { t := t + f(a, i); i := i + 1; } while (i < 3100) { t := t + f(b, i) + f(a, i); i := i + 1; } print(t);", "10836200\n");
+	TEST("class A() { int v = 1; } class B() { obj w = NULL; int v = 20; } class H(obj x) { obj o = x; } int f(obj h) { return h.o.v; } int t = 0; int i = 0; obj a = H(A()); obj b = H(B()); while (i < 3000) { t := t + f(a); i := i + 1; } t := t + f(b) + f(a); print(t);", "3021\n");
+	//e background compilation: optimisation, on-stack replacement and deoptimisation with the compiler in its own thread
+	compiler_options.background_compilation = true;
+	TEST("int f(int n) { obj a = [1, 2]; int s = 0; int i = 0; while (i < n) { s := s + a[i - (i / 2) * 2] + i; i := i + 1; } return s; } print(f(100000));", "5000100000\n");
+	TEST("class A() { int v = 1; int get(int k) { return v + k; } } class B() { int v = 2; int get(int k) { return v * k; } } int f(obj a, int k) { return a.v + a.get(k); } int total = 0; int i = 0; obj a = A(); obj b = B(); while (i < 3000) { total := total + f(a, i); i := i + 1; } while (i < 6000) { total := total + f(b, i); i := i + 1; } while (i < 9000) { total := total + f(a, i); i := i + 1; } print(total);", "54012000\n");
+	TEST("class P(int a) { obj s = [a]; obj pair(obj o) { obj t = [o, s]; return t; } } obj f(obj p, obj q) { obj u = p.pair(q); obj v = p.pair(u); return v; } obj p = P(7); int i = 0; int bad = 0; while (i < 100000) { obj q = [i]; obj r = f(p, q); if (r[0][0] != q) bad := bad + 1; if (r[1][0] != 7) bad := bad + 1; if (r[0][1][0] != 7) bad := bad + 1; i := i + 1; } print(bad);", "0\n");
+	compiler_options.background_compilation = false;
 #ifndef AUX
 #endif
 	if (!failures) {
@@ -40,9 +40,14 @@
 #include "bitvector.h"
 #include "class.h"
 #include "compiler-options.h"
+#include "cstack.h"
 #include "dynamic-compiler.h"
 #include "errors.h"
+#include "heap.h"
+#include "inline-cache.h"
+#include "loop-invariants.h"
 #include "object.h"
+#include "register-allocator.h"
 #include "registers.h"
 #include "stackmap.h"
 
@@ -58,6 +63,30 @@ typedef struct relative_jump_label_list {
 	struct relative_jump_label_list *next;
 } relative_jump_label_list_t;
 
+//e object that escape analysis allowed us to allocate in the stack frame (cf. OPT_FLAG_STACK_ALLOCATE)
+typedef struct {
+	ast_node_t *node; /*e NEWINSTANCE node */
+	int fp_offset; /*e $fp offset of the object header */
+} stack_object_t;
+
+#define INLINE_BUDGET		24	/*e max. number of AST nodes in an inlined callee body */
+#define INLINE_BUDGET_TOTAL	256	/*e max. number of AST nodes inlined into any one function */
+
+//e call site in optimised code whose callee we compile in place (cf. inline_sites_find())
+typedef struct {
+	ast_node_t *node; /*e METHODAPP or FUNAPP node */
+	symtab_entry_t *callee;
+	int words; /*e size of the callee's frame region: `self', parameters, locals, temps */
+	int fp_offset; /*e $fp offset right above the callee's frame region */
+} inline_site_t;
+
+//e loop header in optimised code at which unoptimised code may continue (cf. emit_osr_entries())
+typedef struct {
+	dyncomp_loop_t *record;
+	void *loop_target; /*e start of the optimised code for the loop */
+	size_t offset; /*e buffer offset of the code that sets up the optimised frame */
+} osr_entry_t;
+
 //d Uebersetzungskontext
 //e translation context
 typedef struct {
@@ -73,6 +102,21 @@ typedef struct {
 	
 	/*e if we're in a loop: jump labels */ /*d Falls verfuegbar/in Schleife: Sprungmarken */
 	relative_jump_label_list_t *continue_labels, *break_labels;
+
+	stack_object_t *stack_objects; /*e stack-allocated objects, stored right below the temps */
+	int stack_objects_nr;
+
+	inline_site_t *inline_sites; /*e call sites to inline, with frame regions below the register save area */
+	int inline_sites_nr;
+	relative_jump_label_list_t **return_labels; /*e within inlined code: `return' jumps here rather than leaving the frame */
+
+	register_allocation_t registers; /*e local variables held in callee-saved registers (optimised code only) */
+	int registers_save_offset; /*e $fp offset of the save area for the callee-saved registers, right below the stack objects */
+
+	loop_invariants_t loop_invariants; /*e expressions to hoist out of loops (optimised code only) */
+
+	symtab_entry_t *main_entry; /*e main entry point only: its symbol, which holds the hotness records of its loops */
+	cstack_t *osr_entries; /*e osr_entry_t for loops that unoptimised code may enter (optimised code only) */
 } context_t;
 
 #define STACK_ALLOCATE(DSIZE) if (DSIZE) {emit_subi(buf, REGISTER_SP, WORD_SIZE * (DSIZE)); }
@@ -135,6 +179,50 @@ emit_call(buffer_t *buf, void *target, context_t *context)
 	}
 }
 
+/*e
+ * Calls a function/method/constructor through r_mem
+ *
+ * For dynamically compiled callees we emit a direct call and ask the dynamic compiler
+ * to back-patch it whenever r_mem changes, so that callers never take a detour through
+ * the trampoline once the callee has been compiled.  We can record the call site right
+ * away, since code buffers never move while they grow (cf. code_realloc()).
+ */
+static void
+emit_call_callable(buffer_t *buf, symtab_entry_t *sym, context_t *context)
+{
+	long long distance = ((unsigned char *) sym->r_mem) - ((unsigned char *) buffer_target(buf));
+	if (!sym->r_trampoline /*e builtins */) {
+		emit_call(buf, sym->r_mem, context);
+	} else if (llabs(distance) < 0x7ffffff0) {
+		label_t lab;
+		emit_jal(buf, &lab);
+		save_stackmap(buf, context);
+		buffer_setlabel(&lab, sym->r_mem);
+		dyncomp_add_call_site(sym, &lab);
+	} else {
+		//e out of range for back-patching: load target address from the symbol table
+		emit_la(buf, REGISTER_V0, &(sym->r_mem));
+		emit_ld(buf, REGISTER_V0, 0, REGISTER_V0);
+		emit_jalr(buf, REGISTER_V0);
+		save_stackmap(buf, context);
+	}
+}
+
+/*e
+ * Calls a function/method at call site `node', preferring the version that the precise
+ * types analysis has bound the site to (cf. dyncomp_version_bind())
+ */
+static void
+emit_call_site(buffer_t *buf, symtab_entry_t *sym, ast_node_t *node, context_t *context)
+{
+	void *version = context->symtab_entry ? dyncomp_version_binding(context->symtab_entry, node) : NULL;
+	if (version) {
+		emit_call(buf, version, context);
+	} else {
+		emit_call_callable(buf, sym, context);
+	}
+}
+
 
 static void
 baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context_t *context);
@@ -214,6 +302,153 @@ emit_optmove(buffer_t *buf, int dest, int src)
 	}
 }
 
+/*e
+ * Card-marking write barrier: marks the heap card containing the address in `addr_reg'
+ * (cf. heap.h).  Must follow every store of an object reference into a heap object.
+ * Clobbers `addr_reg' and `scratch_reg'.
+ */
+static void
+emit_write_barrier(buffer_t *buf, int addr_reg, int scratch_reg)
+{
+	emit_srai(buf, addr_reg, HEAP_CARD_SHIFT);
+	emit_la(buf, scratch_reg, &heap_card_table_bias);
+	emit_ld(buf, scratch_reg, 0, scratch_reg);
+	emit_add(buf, addr_reg, scratch_reg);
+	emit_li(buf, scratch_reg, 1);
+	emit_sb(buf, scratch_reg, 0, addr_reg);
+}
+
+/*e
+ * Emits a write barrier for a slot that might be part of a stack-allocated object (cf. heap.h)
+ */
+static void
+emit_write_barrier_if_heap(buffer_t *buf, int addr_reg, int scratch_reg)
+{
+	label_t below_label, above_label;
+	emit_la(buf, scratch_reg, &heap_reserved_start);
+	emit_ld(buf, scratch_reg, 0, scratch_reg);
+	emit_blt(buf, addr_reg, scratch_reg, &below_label);
+	emit_la(buf, scratch_reg, &heap_reserved_end);
+	emit_ld(buf, scratch_reg, 0, scratch_reg);
+	emit_bge(buf, addr_reg, scratch_reg, &above_label);
+	emit_write_barrier(buf, addr_reg, scratch_reg);
+	buffer_setlabel2(&below_label, buf);
+	buffer_setlabel2(&above_label, buf);
+}
+
+/*e
+ * Emits the fast path of an allocation of an object with `fields_nr' fields (cf. heap.h):
+ * bumps the nursery allocation pointer and stores `classref' into the new object, which ends up in $v0.
+ * Jumps to `slow_path' if the nursery is exhausted; the caller must then use
+ * emit_inline_allocation_end() to provide an equivalent runtime call.
+ * Clobbers $t0 and $t1.
+ */
+static void
+emit_inline_allocation(buffer_t *buf, class_t *classref, int fields_nr, label_t *slow_path)
+{
+	emit_la(buf, REGISTER_T1, &heap_free_pointer);
+	emit_ld(buf, REGISTER_V0, 0, REGISTER_T1);
+	emit_move(buf, REGISTER_T0, REGISTER_V0);
+	emit_addi(buf, REGISTER_T0, sizeof(object_t) + fields_nr * WORD_SIZE);
+	emit_la(buf, REGISTER_T1, &heap_allocation_limit);
+	emit_ld(buf, REGISTER_T1, 0, REGISTER_T1);
+	emit_bge(buf, REGISTER_T0, REGISTER_T1, slow_path);
+	emit_la(buf, REGISTER_T1, &heap_free_pointer);
+	emit_sd(buf, REGISTER_T0, 0, REGISTER_T1);
+	emit_la(buf, REGISTER_T0, classref);
+	emit_sd(buf, REGISTER_T0, 0, REGISTER_V0);
+}
+
+/*e
+ * Emits the slow path for emit_inline_allocation(): calls `allocator', whose arguments must already
+ * be in place, and joins the fast path with the new object in $v0.
+ */
+static void
+emit_inline_allocation_end(buffer_t *buf, label_t *slow_path, void *allocator, context_t *context)
+{
+	label_t done_label;
+	emit_j(buf, &done_label);
+	buffer_setlabel2(slow_path, buf);
+	emit_la(buf, REGISTER_V0, allocator);
+	emit_jalr(buf, REGISTER_V0);
+	save_stackmap(buf, context);
+	buffer_setlabel2(&done_label, buf);
+}
+
+/*e
+ * Loads the class of the non-NULL object reference in `obj_reg' into `dest_reg', mapping tagged ints
+ * (cf. object.h) to class_boxed_int.  `dest_reg' must differ from `obj_reg'.
+ */
+static void
+emit_load_class(buffer_t *buf, int dest_reg, int obj_reg)
+{
+	label_t boxed_label, done_label;
+	assert(dest_reg != obj_reg);
+	emit_move(buf, dest_reg, obj_reg);
+	emit_andi(buf, dest_reg, OBJECT_INT_TAG);
+	emit_beqz(buf, dest_reg, &boxed_label);
+	emit_la(buf, dest_reg, &class_boxed_int);
+	emit_j(buf, &done_label);
+	buffer_setlabel2(&boxed_label, buf);
+	emit_ld(buf, dest_reg, 0, obj_reg);
+	buffer_setlabel2(&done_label, buf);
+}
+
+/*e
+ * Emits an inline cache check for the object in $a0 (which may be NULL; NULL always misses).
+ * On a hit, jumps to hit_labels[i] for the matching entry #i, with that entry's method slot or
+ * field offset in $v0.  On a miss, falls through.  Clobbers $t0 and $t1.
+ */
+static void
+emit_inline_cache_check(buffer_t *buf, inline_cache_t *cache, label_t *hit_labels)
+{
+	label_t null_label;
+	emit_beqz(buf, REGISTER_A0, &null_label);
+	emit_load_class(buf, REGISTER_T1, REGISTER_A0);
+	emit_la(buf, REGISTER_T0, cache);
+	for (int i = 0; i < INLINE_CACHE_ENTRIES_NR; i++) {
+		label_t next_label;
+		emit_ld(buf, REGISTER_V0, offsetof(inline_cache_t, entries[i].classref), REGISTER_T0);
+		emit_bne(buf, REGISTER_V0, REGISTER_T1, &next_label);
+		emit_ld(buf, REGISTER_V0, offsetof(inline_cache_t, entries[i].field_offset), REGISTER_T0);
+		emit_j(buf, &hit_labels[i]);
+		buffer_setlabel2(&next_label, buf);
+	}
+	buffer_setlabel2(&null_label, buf);
+}
+
+//e inline cache for a member access or method call, which doubles as the site's type feedback
+static inline_cache_t *
+site_inline_cache(ast_node_t *node, context_t *context)
+{
+	if (!context->symtab_entry) {
+		return inline_cache_new();
+	}
+	return dyncomp_type_feedback(context->symtab_entry, node);
+}
+
+/*e
+ * Jumps to one of the two miss_labels unless $a0 holds an instance of `classref' (NULL always
+ * misses).  Clobbers $t0 and $t1.
+ */
+static void
+emit_class_guard(buffer_t *buf, class_t *classref, label_t *miss_labels)
+{
+	emit_beqz(buf, REGISTER_A0, &miss_labels[0]);
+	emit_load_class(buf, REGISTER_T1, REGISTER_A0);
+	emit_la(buf, REGISTER_T0, classref);
+	emit_bne(buf, REGISTER_T0, REGISTER_T1, &miss_labels[1]);
+}
+
+//e objects that belong into the large object space must go through heap_allocate_object()
+static bool
+can_inline_allocation(int fields_nr)
+{
+	const size_t size = sizeof(object_t) + fields_nr * WORD_SIZE;
+	return size <= HEAP_INLINE_ALLOCATION_MAX
+		&& size < compiler_options.large_object_threshold;
+}
+
 static void
 emit_fail_at_node(buffer_t *buf, ast_node_t *node, char *msg)
 {
@@ -269,6 +504,323 @@ stackmap_mark(context_t *context, int fp_offset, bool is_reference)
 	}
 }
 
+//e class symbol of the object allocated by a NEWINSTANCE node
+#define NEWINSTANCE_CLASS(node) ((node)->children[0]->sym)
+
+/*e
+ * Collects all NEWINSTANCE nodes below `node' that escape analysis marked for stack allocation and whose
+ * class and constructor are ready for it; the latter must have been compiled, to provide an entry point
+ * for preallocated objects.  Records word offsets relative to the start of the stack object area.
+ *
+ * @return Number of stack words needed for all objects found so far
+ */
+static int
+stack_objects_find(ast_node_t *node, stack_object_t **objects, int *objects_nr, int words)
+{
+	if (!node || IS_VALUE_NODE(node)) {
+		return words;
+	}
+	switch (NODE_TY(node)) {
+	case AST_NODE_FUNDEF:
+	case AST_NODE_CLASSDEF:
+		return words;
+
+	case AST_NODE_NEWINSTANCE:
+		if (node->opt_flags & OPT_FLAG_STACK_ALLOCATE) {
+			symtab_entry_t *class_sym = NEWINSTANCE_CLASS(node);
+			symtab_entry_t *constructor = AST_CALLABLE_SYMREF(class_sym->astref->children[3]);
+			if (class_sym->r_mem && constructor->r_mem_preallocated
+			    && (constructor->symtab_flags & SYMTAB_COMPILED)) {
+				*objects = realloc(*objects, sizeof(stack_object_t) * (*objects_nr + 1));
+				(*objects)[*objects_nr].node = node;
+				(*objects)[*objects_nr].fp_offset = words;
+				++(*objects_nr);
+				words += 1 + class_sym->storage.fields_nr;
+			}
+		}
+		break;
+
+	default:
+		break;
+	}
+	for (int i = 0; i < node->children_nr; i++) {
+		words = stack_objects_find(node->children[i], objects, objects_nr, words);
+	}
+	return words;
+}
+
+/*e
+ * Places the objects from stack_objects_find() at the `additional words' (cf. setup_mcontext()) of the
+ * stack frame and marks their reference fields in the stack map.  Takes ownership of `objects'.
+ */
+static void
+stack_objects_setup(context_t *context, stack_object_t *objects, int objects_nr, int words)
+{
+	const int area_start = context->stack_offset_temps - words * WORD_SIZE;
+	context->stack_objects = objects;
+	context->stack_objects_nr = objects_nr;
+	for (int i = 0; i < objects_nr; i++) {
+		symtab_entry_t *class_sym = NEWINSTANCE_CLASS(objects[i].node);
+		class_t *classref = (class_t *) class_sym->r_mem;
+		objects[i].fp_offset = area_start + objects[i].fp_offset * WORD_SIZE;
+		for (int field = 0; field < class_sym->storage.fields_nr; field++) {
+			stackmap_mark(context, objects[i].fp_offset + (1 + field) * WORD_SIZE,
+				      BITVECTOR_IS_SET(classref->object_map, field));
+		}
+	}
+}
+
+static void
+baseline_id_get_location(buffer_t *buf, symtab_entry_t *sym, int *reg, int *offset, context_t *context);
+
+/*e
+ * Installs a register allocation; the save area for callee-saved registers follows the
+ * stack objects in the `additional words' (cf. setup_mcontext())
+ */
+static void
+registers_setup(context_t *context, register_allocation_t *registers, int stack_objects_words)
+{
+	context->registers = *registers;
+	context->registers_save_offset = context->stack_offset_temps - (stack_objects_words + 1) * WORD_SIZE;
+}
+
+//e save callee-saved registers that we use, then load register-allocated parameters
+static void
+emit_callee_saved_store(buffer_t *buf, ast_node_t **args, int args_nr, context_t *context)
+{
+	int offset = context->registers_save_offset;
+	for (int i = 0; i < REGISTERS_CALLEE_SAVED_NR; i++) {
+		if (context->registers.used[i]) {
+			emit_sd(buf, registers_callee_saved[i], offset, REGISTER_FP);
+			offset -= WORD_SIZE;
+		}
+	}
+	for (int i = 0; i < args_nr; i++) {
+		const int var_reg = register_allocation_lookup(&context->registers, args[i]->sym);
+		if (var_reg >= 0) {
+			int base_reg;
+			baseline_id_get_location(buf, args[i]->sym, &base_reg, &offset, context);
+			emit_ld(buf, var_reg, offset, base_reg);
+		}
+	}
+}
+
+static void
+emit_callee_saved_restore(buffer_t *buf, context_t *context)
+{
+	int offset = context->registers_save_offset;
+	for (int i = 0; i < REGISTERS_CALLEE_SAVED_NR; i++) {
+		if (context->registers.used[i]) {
+			emit_ld(buf, registers_callee_saved[i], offset, REGISTER_FP);
+			offset -= WORD_SIZE;
+		}
+	}
+}
+
+static int
+ast_size(ast_node_t *node)
+{
+	if (!node) {
+		return 0;
+	}
+	int size = 1;
+	if (!IS_VALUE_NODE(node)) {
+		for (int i = 0; i < node->children_nr; i++) {
+			size += ast_size(node->children[i]);
+		}
+	}
+	return size;
+}
+
+//e Can we inline this callee body?  We only inline leaves, whose code is valid in any calling context.
+static bool
+inline_body_ok(ast_node_t *node)
+{
+	if (!node || IS_VALUE_NODE(node)) {
+		return true;
+	}
+	switch (NODE_TY(node)) {
+	case AST_NODE_METHODAPP:
+	case AST_NODE_NEWINSTANCE:
+	case AST_NODE_FUNDEF:
+	case AST_NODE_CLASSDEF:
+		return false;
+
+	case AST_NODE_FUNAPP: {
+		symtab_entry_t *callee = AST_CALLABLE_SYMREF(node);
+		if (!callee || !(callee->id < 0 || (callee->symtab_flags & SYMTAB_BUILTIN))) {
+			return false;
+		}
+	}
+		break;
+
+	default:
+		break;
+	}
+	for (int i = 0; i < node->children_nr; i++) {
+		if (!inline_body_ok(node->children[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*e
+ * Determines whether we can inline the callee of the given call site into `caller'
+ *
+ * Method call targets are only known in optimised code, where the precise-types analysis has
+ * resolved them under the parameter type guards from baseline_optimisation_hook().
+ *
+ * @return The callee to inline, or NULL
+ */
+static symtab_entry_t *
+inline_callee(symtab_entry_t *caller, ast_node_t *node)
+{
+	symtab_entry_t *callee;
+	int args_nr;
+	if (NODE_TY(node) == AST_NODE_METHODAPP) {
+		callee = node->children[1]->sym;
+		if (!callee || SYMTAB_KIND(callee) != SYMTAB_KIND_FUNCTION || !(callee->symtab_flags & SYMTAB_MEMBER)
+		    || (node->opt_flags & OPT_FLAG_GUARDED_CALL)) {
+			//e unresolved selector, or a target that only type feedback predicts
+			return NULL;
+		}
+		args_nr = 1 + node->children[2]->children_nr;
+	} else if (NODE_TY(node) == AST_NODE_FUNAPP) {
+		callee = AST_CALLABLE_SYMREF(node);
+		if (!callee || SYMTAB_KIND(callee) != SYMTAB_KIND_FUNCTION || callee->id < 0
+		    || (callee->symtab_flags & (SYMTAB_BUILTIN | SYMTAB_MEMBER | SYMTAB_CONSTRUCTOR))) {
+			return NULL;
+		}
+		args_nr = node->children[1]->children_nr;
+	} else {
+		return NULL;
+	}
+
+	if (callee == caller || !callee->astref || NODE_TY(callee->astref) != AST_NODE_FUNDEF
+	    || args_nr > REGISTERS_ARGUMENT_NR
+	    || ast_size(callee->astref->children[2]) > INLINE_BUDGET
+	    || !inline_body_ok(callee->astref->children[2])) {
+		return NULL;
+	}
+	return callee;
+}
+
+/*e
+ * Collects the call sites below `node' whose callees we inline, within INLINE_BUDGET_TOTAL.
+ * Records word offsets relative to the start of the inline area.
+ *
+ * @return Number of stack words needed for the frame regions of all inlined callees found so far
+ */
+static int
+inline_sites_find(symtab_entry_t *caller, ast_node_t *node, inline_site_t **sites, int *sites_nr, int words, int *budget)
+{
+	if (!node || IS_VALUE_NODE(node)) {
+		return words;
+	}
+	switch (NODE_TY(node)) {
+	case AST_NODE_FUNDEF:
+	case AST_NODE_CLASSDEF:
+		return words;
+
+	case AST_NODE_METHODAPP:
+	case AST_NODE_FUNAPP: {
+		symtab_entry_t *callee = inline_callee(caller, node);
+		const int size = callee ? ast_size(callee->astref->children[2]) : 0;
+		if (callee && size <= *budget) {
+			*budget -= size;
+			*sites = realloc(*sites, sizeof(inline_site_t) * (*sites_nr + 1));
+			inline_site_t *site = &(*sites)[*sites_nr];
+			site->node = node;
+			site->callee = callee;
+			site->words = 1 + callee->parameters_nr + callee->storage.vars_nr + callee->storage.temps_nr;
+			site->fp_offset = words;
+			++(*sites_nr);
+			words += site->words;
+			if (compiler_options.debug_adaptive) {
+				fprintf(stderr, "inlining `");
+				symtab_entry_name_dump(stderr, callee);
+				fprintf(stderr, "' into `");
+				symtab_entry_name_dump(stderr, caller);
+				fprintf(stderr, "'\n");
+			}
+		}
+	}
+		break;
+
+	default:
+		break;
+	}
+	for (int i = 0; i < node->children_nr; i++) {
+		words = inline_sites_find(caller, node->children[i], sites, sites_nr, words, budget);
+	}
+	return words;
+}
+
+/*e
+ * Places the frame regions of inlined callees at the `additional words' (cf. setup_mcontext()),
+ * starting below `area_top'
+ */
+static void
+inline_sites_setup(context_t *context, inline_site_t *sites, int sites_nr, int area_top)
+{
+	context->inline_sites = sites;
+	context->inline_sites_nr = sites_nr;
+	for (int i = 0; i < sites_nr; i++) {
+		sites[i].fp_offset = area_top - sites[i].fp_offset * WORD_SIZE;
+	}
+}
+
+static inline_site_t *
+inline_sites_lookup(context_t *context, ast_node_t *node)
+{
+	for (int i = 0; i < context->inline_sites_nr; i++) {
+		if (context->inline_sites[i].node == node) {
+			return &context->inline_sites[i];
+		}
+	}
+	return NULL;
+}
+
+//e Clears all inlined callee frame regions, so that the stack map never describes stale slots
+static void
+emit_inline_sites_clear(buffer_t *buf, context_t *context)
+{
+	if (!context->inline_sites_nr) {
+		return;
+	}
+	emit_li(buf, REGISTER_T0, 0);
+	for (int i = 0; i < context->inline_sites_nr; i++) {
+		inline_site_t *site = &context->inline_sites[i];
+		for (int k = 1; k <= site->words; k++) {
+			emit_sd(buf, REGISTER_T0, site->fp_offset - k * WORD_SIZE, REGISTER_FP);
+		}
+	}
+}
+
+//e stack object allocated for `node', or NULL
+static stack_object_t *
+stack_objects_lookup(context_t *context, ast_node_t *node)
+{
+	for (int i = 0; i < context->stack_objects_nr; i++) {
+		if (context->stack_objects[i].node == node) {
+			return &context->stack_objects[i];
+		}
+	}
+	return NULL;
+}
+
+//e Zeroes the fields of a stack object (clobbers $t0)
+static void
+emit_stack_object_clear(buffer_t *buf, stack_object_t *obj)
+{
+	symtab_entry_t *class_sym = NEWINSTANCE_CLASS(obj->node);
+	emit_li(buf, REGISTER_T0, 0);
+	for (int field = 0; field < class_sym->storage.fields_nr; field++) {
+		emit_sd(buf, REGISTER_T0, obj->fp_offset + (1 + field) * WORD_SIZE, REGISTER_FP);
+	}
+}
+
 static void
 baseline_store_temp(buffer_t *buf, int reg, ast_node_t *node, context_t *context)
 {
@@ -343,15 +895,33 @@ baseline_id_get_location(buffer_t *buf, symtab_entry_t *sym, int *reg, int *offs
 	*offset = off;
 }
 
+//e register holding the variable `sym', or -1 if it lives in memory
+static int
+baseline_id_register(symtab_entry_t *sym, context_t *context)
+{
+	return register_allocation_lookup(&context->registers, sym);
+}
+
 static void
 baseline_store_type(buffer_t *buf, int reg, symtab_entry_t *sym, context_t *context, bool is_obj)
 {
+	const int var_reg = baseline_id_register(sym, context);
+	if (var_reg >= 0) {
+		emit_optmove(buf, var_reg, reg);
+		return;
+	}
+
 	int offset, base_reg;
 	baseline_id_get_location(buf, sym, &base_reg, &offset, context);
 	if (base_reg == REGISTER_FP) {
 		stackmap_mark(context, offset, is_obj);
 	}
 	emit_sd(buf, reg, offset, base_reg);
+	if (base_reg == REGISTER_T0 && is_obj) {
+		//e field of `self'
+		emit_addi(buf, REGISTER_T0, offset);
+		emit_write_barrier(buf, REGISTER_T0, REGISTER_T1);
+	}
 }
 
 static void
@@ -363,6 +933,12 @@ baseline_store(buffer_t *buf, int reg, symtab_entry_t *sym, context_t *context)
 static void
 baseline_load(buffer_t *buf, int reg, symtab_entry_t *sym, context_t *context)
 {
+	const int var_reg = baseline_id_register(sym, context);
+	if (var_reg >= 0) {
+		emit_optmove(buf, reg, var_reg);
+		return;
+	}
+
 	int offset, base_reg;
 	baseline_id_get_location(buf, sym, &base_reg, &offset, context);
 	emit_ld(buf, reg, offset, base_reg);
@@ -387,8 +963,8 @@ baseline_compile_builtin_convert(buffer_t *buf, ast_node_t *arg, int to_ty, int
 	int arguments_flags = 0;
 	if (to_ty != from_ty
 	    && to_ty == TYPE_OBJ) {
-		//e always use function call when boxing
-		//d Verpacken (boxing) immer mit Funktionsaufruf
+		//e boxing may call new_int()
+		//d Verpacken (boxing) kann new_int() aufrufen
 		arguments_flags = PREPARE_ARGUMENTS_MUSTALIGN;
 	}
 	STACK_DEALLOCATE(baseline_prepare_arguments(buf, 1, &arg, context, arguments_flags));
@@ -398,12 +974,27 @@ baseline_compile_builtin_convert(buffer_t *buf, ast_node_t *arg, int to_ty, int
 		switch (to_ty) {
 		case TYPE_INT:
 			return;
-		case TYPE_OBJ:
-			emit_la(buf, REGISTER_V0, &new_int);
-			emit_jalr(buf, REGISTER_V0);
-			save_stackmap(buf, context);
+		case TYPE_OBJ: {
+			label_t boxed_label, slow_path, done_label;
+			//e tag the int unless shifting loses its topmost bit (cf. object.h)
+			//d Markiere die Ganzzahl, sofern beim Schieben kein oberstes Bit verloren geht
+			emit_move(buf, REGISTER_T0, REGISTER_A0);
+			emit_add(buf, REGISTER_T0, REGISTER_T0);
+			emit_move(buf, REGISTER_T1, REGISTER_T0);
+			emit_srai(buf, REGISTER_T1, 1);
+			emit_bne(buf, REGISTER_T1, REGISTER_A0, &boxed_label);
+			emit_ori(buf, REGISTER_T0, OBJECT_INT_TAG);
+			emit_optmove(buf, dest_register, REGISTER_T0);
+			emit_j(buf, &done_label);
+
+			buffer_setlabel2(&boxed_label, buf);
+			emit_inline_allocation(buf, &class_boxed_int, 1, &slow_path);
+			emit_sd(buf, REGISTER_A0, offsetof(object_t, fields[0].int_v), REGISTER_V0);
+			emit_inline_allocation_end(buf, &slow_path, &new_int, context);
 			emit_optmove(buf, dest_register, REGISTER_V0);
+			buffer_setlabel2(&done_label, buf);
 			return;
+		}
 		case TYPE_VAR:
 			FAIL("VAR not supported");
 			return;
@@ -412,7 +1003,17 @@ baseline_compile_builtin_convert(buffer_t *buf, ast_node_t *arg, int to_ty, int
 	case TYPE_OBJ:
 		switch (to_ty) {
 		case TYPE_INT: {
-			label_t null_label;
+			label_t null_label, boxed_label, done_label;
+			//e tagged int: shift out the tag
+			//d Markierte Ganzzahl: Markierung herausschieben
+			emit_move(buf, REGISTER_T0, REGISTER_A0);
+			emit_andi(buf, REGISTER_T0, OBJECT_INT_TAG);
+			emit_beqz(buf, REGISTER_T0, &boxed_label);
+			emit_move(buf, dest_register, REGISTER_A0);
+			emit_srai(buf, dest_register, 1);
+			emit_j(buf, &done_label);
+
+			buffer_setlabel2(&boxed_label, buf);
 			emit_beqz(buf, REGISTER_A0, &null_label); // NULL?
 			emit_ld(buf, REGISTER_T0, 0, REGISTER_A0);
 			emit_la(buf, REGISTER_V0, &class_boxed_int);
@@ -430,6 +1031,7 @@ baseline_compile_builtin_convert(buffer_t *buf, ast_node_t *arg, int to_ty, int
 				//e int value in object:
 				offsetof(object_t, fields[0].int_v),
 				REGISTER_A0);
+			buffer_setlabel2(&done_label, buf);
 			return;
 		}
 		case TYPE_OBJ:
@@ -641,11 +1243,27 @@ baseline_compile_builtin_op(buffer_t *buf, int ty_and_node_flags, int op, ast_no
 	case BUILTIN_OP_ALLOCATE: {
 		assert(0 == baseline_prepare_arguments(buf, 0, args, context, PREPARE_ARGUMENTS_MUSTALIGN));
 		symtab_entry_t *sym = symtab_lookup(AV_INT(args[0]));
-		emit_la(buf, REGISTER_V0, new_object);
+		const bool in_constructor = context->symtab_entry && (context->symtab_entry->symtab_flags & SYMTAB_CONSTRUCTOR);
+		label_t preallocated_label;
+		if (in_constructor) {
+			//e entered through r_mem_preallocated: `self' already points to a stack object
+			emit_ld(buf, REGISTER_V0, context->self_stack_location, REGISTER_FP);
+			emit_bnez(buf, REGISTER_V0, &preallocated_label);
+		}
 		emit_la(buf, REGISTER_A0, sym->r_mem);
 		emit_li(buf, REGISTER_A1, sym->storage.fields_nr);
-		emit_jalr(buf, REGISTER_V0);
-		save_stackmap(buf, context);
+		if (can_inline_allocation(sym->storage.fields_nr)) {
+			label_t slow_path;
+			emit_inline_allocation(buf, sym->r_mem, sym->storage.fields_nr, &slow_path);
+			emit_inline_allocation_end(buf, &slow_path, new_object, context);
+		} else {
+			emit_la(buf, REGISTER_V0, new_object);
+			emit_jalr(buf, REGISTER_V0);
+			save_stackmap(buf, context);
+		}
+		if (in_constructor) {
+			buffer_setlabel2(&preallocated_label, buf);
+		}
 	}
 		break;
 
@@ -787,12 +1405,323 @@ baseline_prepare_arguments(buffer_t *buf, int children_nr, ast_node_t **children
 	return stack_args_nr;
 }
 
+/*e
+ * Compiles a call site by compiling the callee's body in place (cf. inline_sites_find())
+ *
+ * The callee runs in its frame region within our own frame: we evaluate receiver and arguments
+ * straight into its `self' and parameter slots, and its locals and temps follow below.  Since
+ * all of these slots are part of our frame, our stack map covers them, too.
+ */
+static void
+baseline_compile_inlined(buffer_t *buf, inline_site_t *site, int dest_register, context_t *context)
+{
+	ast_node_t *ast = site->node;
+	symtab_entry_t *callee = site->callee;
+	ast_node_t *actuals = ast->children[NODE_TY(ast) == AST_NODE_METHODAPP ? 2 : 1];
+
+	context_t inline_context;
+	context_copy(&inline_context, context);
+	inline_context.self_stack_location = site->fp_offset - WORD_SIZE;
+	inline_context.stack_offset_args = inline_context.self_stack_location - callee->parameters_nr * WORD_SIZE;
+	inline_context.stack_offset_locals = inline_context.stack_offset_args - callee->storage.vars_nr * WORD_SIZE;
+	inline_context.stack_offset_temps = inline_context.stack_offset_locals - callee->storage.temps_nr * WORD_SIZE;
+	inline_context.continue_labels = NULL;
+	inline_context.break_labels = NULL;
+	inline_context.inline_sites_nr = 0;
+	//e hoisted expressions live in temps relative to our own frame, not the callee's region
+	inline_context.loop_invariants.loops_nr = 0;
+	relative_jump_label_list_t *return_labels = NULL;
+	inline_context.return_labels = &return_labels;
+
+	if (NODE_TY(ast) == AST_NODE_METHODAPP) {
+		baseline_compile_expr(buf, ast->children[0], REGISTER_V0, context);
+		emit_sd(buf, REGISTER_V0, inline_context.self_stack_location, REGISTER_FP);
+		stackmap_mark(context, inline_context.self_stack_location, true);
+	}
+	for (int i = 0; i < actuals->children_nr; i++) {
+		const int offset = inline_context.stack_offset_args + i * WORD_SIZE;
+		baseline_compile_expr(buf, actuals->children[i], REGISTER_V0, context);
+		emit_sd(buf, REGISTER_V0, offset, REGISTER_FP);
+		stackmap_mark(context, offset, AST_TYPE(actuals->children[i]) == TYPE_OBJ);
+	}
+
+	inline_context.stackmap = context->stackmap;
+	baseline_compile_expr(buf, callee->astref->children[2], REGISTER_V0, &inline_context);
+	context->stackmap = inline_context.stackmap;
+	jll_labels_resolve(&return_labels, buffer_target(buf));
+	emit_optmove(buf, dest_register, REGISTER_V0);
+}
+
+static int
+loop_invariant_fp_offset(loop_invariant_t *invariant, context_t *context)
+{
+	return context->stack_offset_temps + invariant->temp * WORD_SIZE;
+}
+
+/*e
+ * Generates code for a loop header in unoptimised code that counts loop iterations and, once
+ * the loop is hot, asks the dynamic compiler for on-stack replacement
+ *
+ * Functions and methods continue in the optimised version of their code (cf. dyncomp_osr()),
+ * which takes over the current stack frame.  The main entry point instead calls an optimised
+ * function that runs the rest of the loop (cf. dyncomp_osr_main_loop()) and then leaves the
+ * loop through one of the `exit_labels'.
+ */
+static void
+emit_loop_hotness_check(buffer_t *buf, ast_node_t *loop, relative_jump_label_list_t **exit_labels, context_t *context)
+{
+	if (compiler_options.no_adaptive_compilation) {
+		return;
+	}
+	symtab_entry_t *sym = context->symtab_entry;
+	dyncomp_loop_t *record;
+	if (context->main_entry) {
+		if (!dyncomp_osr_main_loop_eligible(loop)) {
+			return;
+		}
+		record = dyncomp_loop_record(context->main_entry, loop);
+	} else {
+		if (!sym || (sym->symtab_flags & SYMTAB_OPT) || !dyncomp_osr_eligible(sym)) {
+			return;
+		}
+		record = dyncomp_loop_record(sym, loop);
+	}
+	relative_jump_label_list_t *skip_labels = NULL;
+
+	emit_la(buf, REGISTER_T1, &record->hotness_counter);
+	addrstore_put(&record->hotness_counter, ADDRSTORE_KIND_COUNTER, context->main_entry ? "<main loop>" : sym->name);
+	emit_ld(buf, REGISTER_T0, 0, REGISTER_T1);
+	emit_subi(buf, REGISTER_T0, 1);
+	emit_sd(buf, REGISTER_T0, 0, REGISTER_T1);
+	emit_bgez(buf, REGISTER_T0, jll_add_label(&skip_labels));
+
+	emit_la(buf, REGISTER_A0, record);
+	if (context->main_entry) {
+		addrstore_put(&dyncomp_osr_main_loop, ADDRSTORE_KIND_BUILTIN, "dyncomp_osr_main_loop");
+		emit_la(buf, REGISTER_V0, &dyncomp_osr_main_loop);
+		emit_jalr(buf, REGISTER_V0);
+		emit_beqz(buf, REGISTER_V0, jll_add_label(&skip_labels));
+		emit_jalr(buf, REGISTER_V0);
+		save_stackmap(buf, context);
+		emit_j(buf, jll_add_label(exit_labels));
+	} else {
+		emit_move(buf, REGISTER_A1, REGISTER_FP);
+		emit_subi(buf, REGISTER_A1, -context->stack_offset_args);
+		addrstore_put(&dyncomp_osr, ADDRSTORE_KIND_BUILTIN, "dyncomp_osr");
+		emit_la(buf, REGISTER_V0, &dyncomp_osr);
+		emit_jalr(buf, REGISTER_V0);
+		emit_beqz(buf, REGISTER_V0, jll_add_label(&skip_labels));
+		emit_jr(buf, REGISTER_V0);
+	}
+	jll_labels_resolve(&skip_labels, buffer_target(buf));
+}
+
+/*e
+ * Compiles one copy of a WHILE loop
+ *
+ * @param enter_at_body The caller has already tested the loop condition for the first
+ *        iteration, so we jump straight to the loop body
+ */
+static void
+baseline_compile_loop(buffer_t *buf, ast_node_t *ast, bool enter_at_body, context_t *context)
+{
+	label_t loop_label, exit_label, body_label;
+	if (enter_at_body) {
+		emit_j(buf, &body_label);
+	}
+	void *loop_target = buffer_target(buf);
+	relative_jump_label_list_t *osr_exit_labels = NULL;
+	emit_loop_hotness_check(buf, ast, &osr_exit_labels, context);
+
+	// Schleife beendet?
+	baseline_compile_expr(buf, ast->children[0], REGISTER_V0, context);
+	emit_beqz(buf, REGISTER_V0, &exit_label);
+	if (enter_at_body) {
+		buffer_setlabel2(&body_label, buf);
+	}
+
+	// Schleifenkoerper
+	context_t context_backup;  // Kontext sichern (s.u.)
+	context_copy(&context_backup, context);
+	context->continue_labels = NULL;
+	context->break_labels = NULL;
+	baseline_compile_expr(buf, ast->children[1], REGISTER_V0, context);
+	emit_j(buf, &loop_label);
+
+	// Schleifenende, und Sprungmarken einsetzen
+	void *exit_target = buffer_target(buf);
+	buffer_setlabel(&loop_label, loop_target);
+	buffer_setlabel(&exit_label, exit_target);
+	// Break-Continue-Sprungmarken binden
+	jll_labels_resolve(&context->continue_labels, loop_target);
+	jll_labels_resolve(&context->break_labels, exit_target);
+	jll_labels_resolve(&osr_exit_labels, exit_target);
+
+	// Kontext wiederherstellen, damit umgebende Schleifen wieder Zugriff auf ihre `continue_label' und `break_label' erhalten
+	context_copy(context, &context_backup);
+}
+
+/*e
+ * Remembers the start of the optimised code for `loop' as an entry point for on-stack replacement
+ *
+ * We skip loops in inlined code and loops within loops whose hoisted invariants unoptimised
+ * code would not have computed.  Code with stack-allocated objects is out, too: unoptimised
+ * code keeps these objects on the heap, whereas optimised code expects them in its frame.
+ */
+static void
+osr_entry_add(buffer_t *buf, ast_node_t *loop, context_t *context)
+{
+	if (!context->osr_entries || context->return_labels || context->stack_objects_nr) {
+		return;
+	}
+	for (int i = 0; i < context->loop_invariants.loops_nr; i++) {
+		if (context->loop_invariants.loops[i].active) {
+			return;
+		}
+	}
+	dyncomp_loop_t *record = dyncomp_loop_lookup(context->symtab_entry, loop);
+	if (record) {
+		osr_entry_t entry = { .record = record, .loop_target = buffer_target(buf), .offset = 0 };
+		stack_push(context->osr_entries, &entry);
+	}
+}
+
+//e Jumps to one of the `fail_labels' unless the variable `sym' holds an array
+static void
+baseline_compile_array_check(buffer_t *buf, symtab_entry_t *sym, relative_jump_label_list_t **fail_labels, context_t *context)
+{
+	baseline_load(buf, REGISTER_V0, sym, context);
+	emit_beqz(buf, REGISTER_V0, jll_add_label(fail_labels));
+	emit_load_class(buf, REGISTER_T0, REGISTER_V0);
+	emit_la(buf, REGISTER_T1, &class_array);
+	emit_bne(buf, REGISTER_T0, REGISTER_T1, jll_add_label(fail_labels));
+}
+
+/*e
+ * Checks that all `a[v]' in plan->bounded_accesses stay within bounds, for loops
+ * `while (v < bound) { ... v := v + step; }'
+ *
+ * Since 0 <= v and 0 <= step, `v' never decreases and so remains non-negative; since v < bound
+ * on each access, and bound <= a.size(), the upper bound holds, too.  We require step <= bound
+ * so that `v + step' cannot overflow; loops with larger steps run at most once anyway.
+ */
+static void
+baseline_compile_bounds_check(buffer_t *buf, loop_plan_t *plan, relative_jump_label_list_t **fail_labels, context_t *context)
+{
+	const int bound_offset = context->stack_offset_temps + plan->bound_temp * WORD_SIZE;
+	baseline_compile_expr(buf, plan->induction_bound, REGISTER_V0, context);
+	emit_sd(buf, REGISTER_V0, bound_offset, REGISTER_FP);
+
+	baseline_compile_expr(buf, plan->induction_step, REGISTER_V0, context);
+	emit_bltz(buf, REGISTER_V0, jll_add_label(fail_labels));
+	emit_ld(buf, REGISTER_T0, bound_offset, REGISTER_FP);
+	emit_blt(buf, REGISTER_T0, REGISTER_V0, jll_add_label(fail_labels));
+
+	baseline_load(buf, REGISTER_V0, plan->induction_var, context);
+	emit_bltz(buf, REGISTER_V0, jll_add_label(fail_labels));
+
+	for (int i = 0; i < plan->bounded_arrays_nr; i++) {
+		baseline_load(buf, REGISTER_V0, plan->bounded_arrays[i], context);
+		emit_ld(buf, REGISTER_T1, WORD_SIZE, REGISTER_V0);
+		// t1: size
+		emit_ld(buf, REGISTER_T0, bound_offset, REGISTER_FP);
+		emit_blt(buf, REGISTER_T1, REGISTER_T0, jll_add_label(fail_labels));
+	}
+}
+
+//e Evaluates loop invariants into their temps
+static void
+baseline_compile_invariants(buffer_t *buf, loop_plan_t *plan, bool needs_arrays, context_t *context)
+{
+	for (int i = 0; i < plan->invariants_nr; i++) {
+		loop_invariant_t *invariant = &plan->invariants[i];
+		if (invariant->needs_arrays == needs_arrays) {
+			const int offset = loop_invariant_fp_offset(invariant, context);
+			baseline_compile_expr(buf, invariant->node, REGISTER_V0, context);
+			emit_sd(buf, REGISTER_V0, offset, REGISTER_FP);
+			stackmap_mark(context, offset, AST_TYPE(invariant->node) == TYPE_OBJ);
+		}
+	}
+}
+
+/*e
+ * Compiles a WHILE loop with loop-invariant code motion (cf. loop_invariants_find())
+ *
+ * We test the loop condition once up front, so that the preheader only runs if the loop body
+ * runs, too.  The preheader then stores all invariants in their temps and checks the arrays
+ * from plan->checked_arrays and the bounds from plan->bounded_accesses.  If any of these checks
+ * fails, we run a copy of the loop that keeps its type and bounds checks and only uses the
+ * invariants that don't rely on these arrays.
+ */
+static void
+baseline_compile_hoisted_loop(buffer_t *buf, loop_plan_t *plan, context_t *context)
+{
+	ast_node_t *ast = plan->loop;
+	relative_jump_label_list_t *exit_labels = NULL;
+	relative_jump_label_list_t *unchecked_labels = NULL;
+
+	if (compiler_options.debug_adaptive) {
+		fprintf(stderr, "hoisting %d invariant(s), %d array type check(s) and %d bounds check(s) out of loop in `",
+			plan->invariants_nr, plan->checked_arrays_nr, plan->bounded_accesses_nr);
+		symtab_entry_name_dump(stderr, context->symtab_entry);
+		fprintf(stderr, "'\n");
+	}
+
+	baseline_compile_expr(buf, ast->children[0], REGISTER_V0, context);
+	emit_beqz(buf, REGISTER_V0, jll_add_label(&exit_labels));
+
+	//e preheader
+	baseline_compile_invariants(buf, plan, false, context);
+	for (int i = 0; i < plan->checked_arrays_nr; i++) {
+		baseline_compile_array_check(buf, plan->checked_arrays[i], &unchecked_labels, context);
+	}
+	for (int i = 0; i < plan->bounded_arrays_nr; i++) {
+		baseline_compile_array_check(buf, plan->bounded_arrays[i], &unchecked_labels, context);
+	}
+	baseline_compile_invariants(buf, plan, true, context);
+	if (plan->bounded_accesses_nr) {
+		baseline_compile_bounds_check(buf, plan, &unchecked_labels, context);
+	}
+
+	const bool versioned = plan->checked_arrays_nr || plan->bounded_accesses_nr;
+	plan->active = true;
+	plan->arrays_checked = versioned;
+	baseline_compile_loop(buf, ast, true, context);
+	if (versioned) {
+		//e fallback: not all of these are arrays
+		emit_j(buf, jll_add_label(&exit_labels));
+		jll_labels_resolve(&unchecked_labels, buffer_target(buf));
+		plan->arrays_checked = false;
+		for (int i = 0; i < plan->invariants_nr; i++) {
+			if (plan->invariants[i].needs_arrays) {
+				stackmap_mark(context, loop_invariant_fp_offset(&plan->invariants[i], context), false);
+			}
+		}
+		baseline_compile_loop(buf, ast, true, context);
+	}
+	plan->active = false;
+	jll_labels_resolve(&exit_labels, buffer_target(buf));
+
+	for (int i = 0; i < plan->invariants_nr; i++) {
+		stackmap_mark(context, loop_invariant_fp_offset(&plan->invariants[i], context), false);
+	}
+}
+
 // Der Aufrufer speichert; der Aufgerufene haelt sich immer an dest_register
 static void
 baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context_t *context)
 {
 	/* ast_node_dump(stderr, ast, 6 | 8); */
 
+	if (context->loop_invariants.loops_nr) {
+		loop_invariant_t *invariant = loop_invariants_lookup(&context->loop_invariants, ast);
+		if (invariant) {
+			//e computed ahead of an enclosing loop
+			emit_ld(buf, dest_register, loop_invariant_fp_offset(invariant, context), REGISTER_FP);
+			return;
+		}
+	}
+
 	switch (NODE_TY(ast)) {
 	case AST_VALUE_INT:
 		emit_li(buf, dest_register, AV_INT(ast));
@@ -818,6 +1747,15 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 		//d Basis-Register und Abstand bestimmen
 		int reg, offset;
 
+		const int var_reg = baseline_id_register(ast->sym, context);
+		if (var_reg >= 0) {
+			if (ast->type & AST_FLAG_LVALUE) {
+				fail_at_node(ast, "Cannot take the address of a register variable");
+			}
+			emit_optmove(buf, dest_register, var_reg);
+			break;
+		}
+
 		baseline_id_get_location(buf, ast->sym, &reg, &offset, context);
 		
 		//d Adresse oder Wert?
@@ -868,14 +1806,21 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 				baseline_load_temp(buf, REGISTER_A3, ast->children[0], context);
 			}
 			
+			inline_cache_t *cache = site_inline_cache(ast, context);
+			label_t done_label;
+			label_t hit_labels[INLINE_CACHE_ENTRIES_NR];
+			emit_inline_cache_check(buf, cache, hit_labels);
+
+			//e cache miss
 			emit_la(buf, REGISTER_A1, selector_node);
 			emit_li(buf, REGISTER_A2, selector);
+			emit_la(buf, registers_argument[4], cache);
 
 			const int ty = ast->children[1]->type;
 			if (ty & TYPE_INT) {
-				emit_la(buf, REGISTER_V0, object_write_member_field_int);
+				emit_la(buf, REGISTER_V0, object_write_member_field_int_cached);
 			} else { //if (ty & TYPE_OBJ) {
-				emit_la(buf, REGISTER_V0, object_write_member_field_obj);
+				emit_la(buf, REGISTER_V0, object_write_member_field_obj_cached);
 			}
 			/* } else */
 			/* } else { */
@@ -888,6 +1833,20 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 							       PREPARE_ARGUMENTS_MUSTALIGN));
 			emit_jalr(buf, REGISTER_V0);
 			save_stackmap(buf, context);
+			emit_j(buf, &done_label);
+
+			//e cache hit: field of the right type at offset $v0
+			for (int i = 0; i < INLINE_CACHE_ENTRIES_NR; i++) {
+				buffer_setlabel2(&hit_labels[i], buf);
+			}
+			emit_add(buf, REGISTER_V0, REGISTER_A0);
+			emit_sd(buf, REGISTER_A3, 0, REGISTER_V0);
+			if (!(ty & TYPE_INT)) {
+				//e the object might be stack-allocated
+				emit_write_barrier_if_heap(buf, REGISTER_V0, REGISTER_T0);
+			}
+
+			buffer_setlabel2(&done_label, buf);
 		} else {
 			//e local or global variable
 			baseline_compile_expr(buf, ast->children[1], REGISTER_V0, context);
@@ -903,6 +1862,7 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 					baseline_load_temp(buf, REGISTER_V0, ast->children[1], context);
 				}
 				emit_sd(buf, REGISTER_V0, 0, REGISTER_T0);
+				emit_write_barrier(buf, REGISTER_T0, REGISTER_T1);
 			}
 		}
 		break;
@@ -926,9 +1886,16 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 			//e load with implicit size
 			emit_li(buf, REGISTER_A0, ast->children[0]->children_nr);
 		}
-		emit_la(buf, REGISTER_V0, &new_array);
-		emit_jalr(buf, REGISTER_V0);
-		save_stackmap(buf, context);
+		if (!ast->children[1] && can_inline_allocation(ast->children[0]->children_nr + 1)) {
+			label_t slow_path;
+			emit_inline_allocation(buf, &class_array, ast->children[0]->children_nr + 1, &slow_path);
+			emit_sd(buf, REGISTER_A0, offsetof(object_t, fields[0].int_v), REGISTER_V0);
+			emit_inline_allocation_end(buf, &slow_path, &new_array, context);
+		} else {
+			emit_la(buf, REGISTER_V0, &new_array);
+			emit_jalr(buf, REGISTER_V0);
+			save_stackmap(buf, context);
+		}
 		//e We now have the allocated array in REGISTER_V0
 		baseline_store_temp(buf, REGISTER_V0, ast, context);
 		for (int i = 0; i < ast->children[0]->children_nr; i++) {
@@ -940,6 +1907,10 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 			emit_sd(buf, REGISTER_T0,
 				(2 * WORD_SIZE) /*e header + size */ /*d header + groesse */ + WORD_SIZE * i,
 				REGISTER_V0);
+			//e large arrays may be allocated in old space directly
+			emit_move(buf, REGISTER_T0, REGISTER_V0);
+			emit_addi(buf, REGISTER_T0, (2 * WORD_SIZE) + WORD_SIZE * i);
+			emit_write_barrier(buf, REGISTER_T0, REGISTER_T1);
 		}
 		emit_optmove(buf, dest_register, REGISTER_V0);
 	}
@@ -950,10 +1921,12 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 		baseline_compile_expr(buf, ast->children[0], REGISTER_V0, context);
 		//e Array is now in REGISTER_V0
 
-		if (!(ast->opt_flags & OPT_FLAG_NO_TYPECHECK1)) {
+		if (!(ast->opt_flags & OPT_FLAG_NO_TYPECHECK1)
+		    && !(NODE_TY(ast->children[0]) == AST_VALUE_ID
+			 && loop_invariants_array_checked(&context->loop_invariants, ast->children[0]->sym))) {
 			//e Type check
 			emit_la(buf, REGISTER_T1, &class_array);
-			emit_ld(buf, REGISTER_T0, 0, REGISTER_V0);
+			emit_load_class(buf, REGISTER_T0, REGISTER_V0);
 			//e array type is now in REGISTER_T0
 			emit_beq(buf, REGISTER_T0, REGISTER_T1, &jl);
 			emit_fail_at_node(buf, ast, "Attempted to index non-array");
@@ -975,13 +1948,15 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 			// v0: Array
 			// t0: offset
 
-			if (!(ast->opt_flags & OPT_FLAG_NO_LOWER)) {
+			const bool bounds_checked = loop_invariants_bounds_checked(&context->loop_invariants, ast);
+
+			if (!(ast->opt_flags & OPT_FLAG_NO_LOWER) && !bounds_checked) {
 				emit_bgez(buf, REGISTER_T0, &jl);
 				emit_fail_at_node(buf, ast, "Negative index into array");
 				buffer_setlabel2(&jl, buf);
 			}
 
-			if (!(ast->opt_flags & OPT_FLAG_NO_UPPER)) {
+			if (!(ast->opt_flags & OPT_FLAG_NO_UPPER) && !bounds_checked) {
 				emit_ld(buf, REGISTER_T1, WORD_SIZE, REGISTER_V0);
 				// t1: size
 				emit_blt(buf, REGISTER_T0, REGISTER_T1, &jl);
@@ -1004,6 +1979,14 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 		break;
 
 	case AST_NODE_IF: {
+		if (NODE_TY(ast->children[0]) == AST_VALUE_INT) {
+			//e condition folded by constant propagation: only emit the branch that can be taken
+			ast_node_t *branch = AV_INT(ast->children[0]) ? ast->children[1] : ast->children[2];
+			if (branch) {
+				baseline_compile_expr(buf, branch, REGISTER_V0, context);
+			}
+			break;
+		}
 		baseline_compile_expr(buf, ast->children[0], REGISTER_V0, context);
 		label_t false_label, end_label;
 		emit_beqz(buf, REGISTER_V0, &false_label);
@@ -1020,31 +2003,20 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 	}
 
 	case AST_NODE_WHILE: {
-		label_t loop_label, exit_label;
-		void *loop_target = buffer_target(buf);
-
-		// Schleife beendet?
-		baseline_compile_expr(buf, ast->children[0], REGISTER_V0, context);
-		emit_beqz(buf, REGISTER_V0, &exit_label);
-
-		// Schleifenkoerper
-		context_t context_backup;  // Kontext sichern (s.u.)
-		context_copy(&context_backup, context);
-		context->continue_labels = NULL;
-		context->break_labels = NULL;
-		baseline_compile_expr(buf, ast->children[1], REGISTER_V0, context);
-		emit_j(buf, &loop_label);
-
-		// Schleifenende, und Sprungmarken einsetzen
-		void *exit_target = buffer_target(buf);
-		buffer_setlabel(&loop_label, loop_target);
-		buffer_setlabel(&exit_label, exit_target);
-		// Break-Continue-Sprungmarken binden
-		jll_labels_resolve(&context->continue_labels, loop_target);
-		jll_labels_resolve(&context->break_labels, exit_target);
-
-		// Kontext wiederherstellen, damit umgebende Schleifen wieder Zugriff auf ihre `continue_label' und `break_label' erhalten
-		context_copy(context, &context_backup);
+		if (NODE_TY(ast->children[0]) == AST_VALUE_INT && !AV_INT(ast->children[0])) {
+			//e loop body can never execute
+			break;
+		}
+		osr_entry_add(buf, ast, context);
+		loop_plan_t *plan = NULL;
+		if (context->loop_invariants.loops_nr) {
+			plan = loop_invariants_plan(&context->loop_invariants, ast);
+		}
+		if (plan) {
+			baseline_compile_hoisted_loop(buf, plan, context);
+		} else {
+			baseline_compile_loop(buf, ast, false, context);
+		}
 	}
 		break;
 
@@ -1062,12 +2034,24 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 		if (ast->children[0]) {
 			baseline_compile_expr(buf, ast->children[0], REGISTER_V0, context);
 		}
+		if (context->return_labels) {
+			//e inlined callee: continue after the inlined body
+			emit_j(buf, jll_add_label(context->return_labels));
+			break;
+		}
+		emit_callee_saved_restore(buf, context);
 		emit_move(buf, REGISTER_SP, REGISTER_FP);
 		emit_pop(buf, REGISTER_FP);
 		emit_jreturn(buf);
 		break;
 
 	case AST_NODE_METHODAPP: {
+		inline_site_t *inline_site = inline_sites_lookup(context, ast);
+		if (inline_site) {
+			baseline_compile_inlined(buf, inline_site, dest_register, context);
+			break;
+		}
+
 		baseline_compile_expr(buf, ast->children[0], REGISTER_A0, context);
 		if (!(IS_SELF_REF(ast->children[0]))) {
 			//e don't need to backup self ref (it's already in a secure stack slot)
@@ -1076,26 +2060,62 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 
 		//e we _might_ know the exact jump target
 		void *known_call_target = NULL;
+		class_t *guard_class = NULL;
 		if (context->symtab_entry && context->symtab_entry->symtab_flags & SYMTAB_OPT) {
 			//e but we only trust the target if the current function is tagged as `opt'
 			known_call_target = ast->children[1]->sym->r_mem;
+			if (known_call_target && (ast->opt_flags & OPT_FLAG_GUARDED_CALL)) {
+				//e ... and, for targets predicted from type feedback, if the receiver class matches
+				guard_class = dyncomp_type_feedback_class(context->symtab_entry, ast, NULL);
+				if (!guard_class) {
+					known_call_target = NULL;
+				}
+			}
 		}
 
-		if (!known_call_target) {
+		if (!known_call_target || guard_class) {
+			label_t found_label, guard_hit_label;
+			if (guard_class) {
+				//e receiver class matches: $v0 := NULL selects the direct call below
+				label_t miss_labels[2];
+				emit_class_guard(buf, guard_class, miss_labels);
+				emit_li(buf, REGISTER_V0, 0);
+				emit_j(buf, &guard_hit_label);
+				buffer_setlabel2(&miss_labels[0], buf);
+				buffer_setlabel2(&miss_labels[1], buf);
+			}
+
 			//d Berechne Sprungadresse
-			//e compute jump address
+			//e compute jump address: try the inline cache first
+			inline_cache_t *cache = site_inline_cache(ast, context);
+			label_t found_labels[INLINE_CACHE_ENTRIES_NR];
+			emit_inline_cache_check(buf, cache, found_labels);
+
+			//e cache miss (or NULL, which object_get_member_method_cached() reports)
 			ast_node_t *selector_node = ast->children[1];
 			const int selector = selector_node->sym->selector;
 			emit_la(buf, REGISTER_A1, selector_node);
 			emit_li(buf, REGISTER_A2, selector);
 			emit_li(buf, REGISTER_A3, ast->children[2]->children_nr);
-			emit_la(buf, REGISTER_V0, object_get_member_method);
+			emit_la(buf, registers_argument[4], cache);
+			emit_la(buf, REGISTER_V0, object_get_member_method_cached);
 
 			assert(0 == baseline_prepare_arguments(buf, 0, NULL, context,
 							       PREPARE_ARGUMENTS_MUSTALIGN));
 			emit_jalr(buf, REGISTER_V0);
 			save_stackmap(buf, context);
-		
+			emit_j(buf, &found_label);
+
+			//e cache hit: $v0 points to the vtable entry
+			for (int i = 0; i < INLINE_CACHE_ENTRIES_NR; i++) {
+				buffer_setlabel2(&found_labels[i], buf);
+			}
+			emit_ld(buf, REGISTER_V0, 0, REGISTER_V0);
+			buffer_setlabel2(&found_label, buf);
+			if (guard_class) {
+				buffer_setlabel2(&guard_hit_label, buf);
+			}
+
 			//d Speichere Sprungadresse
 			//e save jump address
 			baseline_store_temp(buf, REGISTER_V0, ast, context);
@@ -1122,13 +2142,19 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 #if 0
 			fprintf(stderr, "Using UNKNOWN jump location\n");
 #endif
-		} else {
-			//e load target address from jump table.  This is slower than a direct jump
-			//e but necessary, as the target method might get replaced again later.
-			emit_la(buf, REGISTER_V0, &(ast->children[1]->sym->r_mem));
-			emit_ld(buf, REGISTER_V0, 0, REGISTER_V0);
+		} else if (guard_class) {
+			label_t direct_label, done_label;
+			baseline_load_temp(buf, REGISTER_V0, ast, context);
+			emit_beqz(buf, REGISTER_V0, &direct_label);
 			emit_jalr(buf, REGISTER_V0);
 			save_stackmap(buf, context);
+			emit_j(buf, &done_label);
+			buffer_setlabel2(&direct_label, buf);
+			emit_call_site(buf, ast->children[1]->sym, ast, context);
+			buffer_setlabel2(&done_label, buf);
+		} else {
+			//e direct call; back-patched if the target method gets replaced later
+			emit_call_site(buf, ast->children[1]->sym, ast, context);
 #if 0			
 			fprintf(stderr, "Using KNOWN jump location:");
 			symtab_entry_name_dump(stderr, ast->children[1]->sym);
@@ -1148,13 +2174,32 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 		ast_node_t *selector_node = ast->children[1];
 		const int selector = selector_node->sym->selector;
 
+		label_t done_label, guard_hit_label;
+		inline_cache_entry_t observed = { .classref = NULL };
+		if (context->symtab_entry && (context->symtab_entry->symtab_flags & SYMTAB_OPT)
+		    && dyncomp_type_feedback_class(context->symtab_entry, ast, &observed)) {
+			//e the site has only ever seen one receiver class: check for it before consulting the inline cache
+			label_t miss_labels[2];
+			emit_class_guard(buf, observed.classref, miss_labels);
+			emit_ld(buf, REGISTER_V0, observed.field_offset, REGISTER_A0);
+			emit_j(buf, &guard_hit_label);
+			buffer_setlabel2(&miss_labels[0], buf);
+			buffer_setlabel2(&miss_labels[1], buf);
+		}
+
+		inline_cache_t *cache = site_inline_cache(ast, context);
+		label_t hit_labels[INLINE_CACHE_ENTRIES_NR];
+		emit_inline_cache_check(buf, cache, hit_labels);
+
+		//e cache miss
 		emit_la(buf, REGISTER_A1, selector_node);
 		emit_li(buf, REGISTER_A2, selector);
+		emit_la(buf, REGISTER_A3, cache);
 
 		if (ast->type & TYPE_INT) {
-			emit_la(buf, REGISTER_V0, object_read_member_field_int);
+			emit_la(buf, REGISTER_V0, object_read_member_field_int_cached);
 		} else { //if (ast->type & TYPE_OBJ) {
-			emit_la(buf, REGISTER_V0, object_read_member_field_obj);
+			emit_la(buf, REGISTER_V0, object_read_member_field_obj_cached);
 		}
 		/* } else { */
 		/* 	AST_DUMP(ast); */
@@ -1165,6 +2210,19 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 						       PREPARE_ARGUMENTS_MUSTALIGN));
 		emit_jalr(buf, REGISTER_V0);
 		save_stackmap(buf, context);
+		emit_j(buf, &done_label);
+
+		//e cache hit: field of the right type at offset $v0
+		for (int i = 0; i < INLINE_CACHE_ENTRIES_NR; i++) {
+			buffer_setlabel2(&hit_labels[i], buf);
+		}
+		emit_add(buf, REGISTER_V0, REGISTER_A0);
+		emit_ld(buf, REGISTER_V0, 0, REGISTER_V0);
+
+		buffer_setlabel2(&done_label, buf);
+		if (observed.classref) {
+			buffer_setlabel2(&guard_hit_label, buf);
+		}
 		emit_optmove(buf, dest_register, REGISTER_V0);
 	}
 		break;
@@ -1180,10 +2238,29 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 			sym = AST_CALLABLE_SYMREF(sym->astref->children[3]);
 		}
 		assert(sym);
+		stack_object_t *stack_object = NULL;
+		if (NODE_TY(ast) == AST_NODE_NEWINSTANCE) {
+			stack_object = stack_objects_lookup(context, ast);
+		}
 		// Besondere eingebaute Operationen werden in einer separaten Funktion behandelt
 		if (sym->id < 0 && sym->symtab_flags & SYMTAB_HIDDEN) {
 			baseline_compile_builtin_op(buf, ast->type & ~AST_NODE_MASK, sym->id,
 						    ast->children[1]->children, dest_register, context);
+		} else if (stack_object) {
+			//e object lives in our stack frame: initialise it there and pass it to the constructor in $t1
+			int stack_frame_size =
+				baseline_prepare_arguments(buf, ast->children[1]->children_nr, ast->children[1]->children, context,
+							   PREPARE_ARGUMENTS_MUSTALIGN);
+			emit_stack_object_clear(buf, stack_object);
+			emit_la(buf, REGISTER_T0, NEWINSTANCE_CLASS(ast)->r_mem);
+			emit_sd(buf, REGISTER_T0, stack_object->fp_offset, REGISTER_FP);
+			emit_move(buf, REGISTER_T1, REGISTER_FP);
+			emit_subi(buf, REGISTER_T1, -stack_object->fp_offset);
+			emit_call(buf, sym->r_mem_preallocated, context);
+			STACK_DEALLOCATE(stack_frame_size);
+			emit_optmove(buf, dest_register, REGISTER_V0);
+		} else if (inline_sites_lookup(context, ast)) {
+			baseline_compile_inlined(buf, inline_sites_lookup(context, ast), dest_register, context);
 		} else {
 			//d Normaler Funktionsaufruf
 			//d Argumente laden
@@ -1196,11 +2273,7 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 				symtab_entry_dump(stderr, sym);
 				fail_at_node(ast, "No call target address for function");
 			}
-			if (compiler_options.no_adaptive_compilation || !sym->r_trampoline /*e happens for builtins */) {
-				emit_call(buf, sym->r_mem, context);
-			} else {
-				emit_call(buf, sym->r_trampoline, context);
-			}
+			emit_call_site(buf, sym, ast, context);
 
 			// Stapelrahmen nachbereiten, soweit noetig
 			STACK_DEALLOCATE(stack_frame_size);
@@ -1231,7 +2304,7 @@ baseline_compile_expr(buffer_t *buf, ast_node_t *ast, int dest_register, context
 		baseline_compile_expr(buf, ast->children[0], REGISTER_T0, context);
 		emit_li(buf, dest_register, 0);
 		emit_beqz(buf, REGISTER_T0, &null_label);
-		emit_ld(buf, REGISTER_T1, 0, REGISTER_T0);
+		emit_load_class(buf, REGISTER_T1, REGISTER_T0);
 		emit_la(buf, REGISTER_T0, ast->children[1]->sym->r_mem);
 		assert(ast->children[1]->sym->r_mem);
 		emit_seq(buf, dest_register, REGISTER_T0, REGISTER_T1);
@@ -1266,6 +2339,16 @@ init_address_store()
 		ADDRSTORE_PUT(object_read_member_field_obj, SPECIAL);
 		ADDRSTORE_PUT(object_read_member_field_int, SPECIAL);
 		ADDRSTORE_PUT(object_get_member_method, SPECIAL);
+		ADDRSTORE_PUT(object_get_member_method_cached, SPECIAL);
+		ADDRSTORE_PUT(object_write_member_field_obj_cached, SPECIAL);
+		ADDRSTORE_PUT(object_write_member_field_int_cached, SPECIAL);
+		ADDRSTORE_PUT(object_read_member_field_obj_cached, SPECIAL);
+		ADDRSTORE_PUT(object_read_member_field_int_cached, SPECIAL);
+		addrstore_put(&heap_reserved_start, ADDRSTORE_KIND_DATA, "heap_reserved_start");
+		addrstore_put(&heap_reserved_end, ADDRSTORE_KIND_DATA, "heap_reserved_end");
+		addrstore_put(&heap_card_table_bias, ADDRSTORE_KIND_DATA, "heap_card_table_bias");
+		addrstore_put(&heap_free_pointer, ADDRSTORE_KIND_DATA, "heap_free_pointer");
+		addrstore_put(&heap_allocation_limit, ADDRSTORE_KIND_DATA, "heap_allocation_limit");
 	}
 
 }
@@ -1315,6 +2398,16 @@ setup_mcontext(context_t *context, symtab_entry_t *sym,
 
 	context->stackmap = bitvector_alloc(words + stackmap_extra_bits);
 	context->symtab_entry = sym;
+	context->stack_objects = NULL;
+	context->stack_objects_nr = 0;
+	context->inline_sites = NULL;
+	context->inline_sites_nr = 0;
+	context->return_labels = NULL;
+	memset(&context->registers, 0, sizeof(register_allocation_t));
+	context->registers_save_offset = 0;
+	memset(&context->loop_invariants, 0, sizeof(loop_invariants_t));
+	context->main_entry = NULL;
+	context->osr_entries = NULL;
 
 	/* fprintf(stderr, "[mcontext: params=%d, vars=%d, temps=%d, extra=%d, cons|method=%d, excess-args=%d]\n", */
 	/* 	parameters_nr, storage->vars_nr, storage->temps_nr, additional_words, kind, excess_parameters); */
@@ -1332,11 +2425,18 @@ void
 free_mcontext(context_t *context)
 {
 	bitvector_free(context->stackmap);
+	free(context->stack_objects);
+	free(context->inline_sites);
+	register_allocation_free(&context->registers);
+	loop_invariants_free(&context->loop_invariants);
+	if (context->osr_entries) {
+		stack_free(context->osr_entries, NULL);
+	}
 }
 
 buffer_t
 baseline_compile_entrypoint(ast_node_t *root,
-			    storage_record_t *storage,
+			    symtab_entry_t *main_sym,
 			    void *static_memory)
 {
 	init_address_store();
@@ -1348,8 +2448,9 @@ baseline_compile_entrypoint(ast_node_t *root,
 	mcontext.continue_labels = NULL;
 	mcontext.break_labels = NULL;
 	context_t *context = &mcontext;
-	int stack_entries_nr = setup_mcontext(&mcontext, NULL, storage, 0, MCONTEXT_KIND_DEFAULT, 1);
+	int stack_entries_nr = setup_mcontext(&mcontext, NULL, &main_sym->storage, 0, MCONTEXT_KIND_DEFAULT, 1);
 	int gp_offset = -WORD_SIZE * stack_entries_nr;
+	mcontext.main_entry = main_sym;
 
 	buffer_t mbuf = buffer_new(1024);
 	buffer_t *buf = &mbuf;
@@ -1373,6 +2474,57 @@ baseline_compile_entrypoint(ast_node_t *root,
 	return mbuf;
 }
 
+/*e
+ * Generates the entry points through which unoptimised code continues in optimised code
+ *
+ * Unoptimised code jumps here with its own stack frame in place (cf. emit_loop_hotness_check()).
+ * The optimised frame keeps `self', parameters and locals where the unoptimised frame has them
+ * and only adds words below, so we extend the frame, repeat the parts of the prologue that
+ * concern these words, and load the register-allocated variables that are live at the loop
+ * header from their stack slots.  (osr_entry_add() has excluded code with stack objects.)
+ */
+static void
+emit_osr_entries(buffer_t *buf, ast_node_t **args, int args_nr, int stack_entries_nr, context_t *context)
+{
+	if (!context->osr_entries) {
+		return;
+	}
+	register_assignment_t live[context->registers.assignments_nr + 1];
+	const size_t entries_nr = stack_size(context->osr_entries);
+	for (size_t i = 0; i < entries_nr; i++) {
+		osr_entry_t *entry = (osr_entry_t *) stack_get(context->osr_entries, i);
+		entry->offset = buffer_size(*buf);
+		emit_move(buf, REGISTER_SP, REGISTER_FP);
+		STACK_ALLOCATE(stack_entries_nr);
+		emit_inline_sites_clear(buf, context);
+		emit_callee_saved_store(buf, args, args_nr, context);
+
+		const int live_nr = register_allocation_live_at_loop(&context->registers, entry->record->loop, live);
+		for (int k = 0; k < live_nr; k++) {
+			int base_reg, offset;
+			baseline_id_get_location(buf, live[k].sym, &base_reg, &offset, context);
+			emit_ld(buf, live[k].reg, offset, base_reg);
+		}
+		label_t loop_label;
+		emit_j(buf, &loop_label);
+		buffer_setlabel(&loop_label, entry->loop_target);
+	}
+}
+
+//e Publishes the entry points from emit_osr_entries() once the buffer is final
+static void
+osr_entries_install(buffer_t buf, context_t *context)
+{
+	if (!context->osr_entries) {
+		return;
+	}
+	const size_t entries_nr = stack_size(context->osr_entries);
+	for (size_t i = 0; i < entries_nr; i++) {
+		osr_entry_t *entry = (osr_entry_t *) stack_get(context->osr_entries, i);
+		entry->record->osr_code = ((unsigned char *) buffer_entrypoint(buf)) + entry->offset;
+	}
+}
+
 /*e
  * Generate code to trigger dynamic/adaptive optimisation/deoptimisation
  */
@@ -1406,10 +2558,10 @@ baseline_optimisation_hook(buffer_t *buf, symtab_entry_t *sym, int args_offset_0
 				baseline_id_get_location(buf, args[i]->sym, &base_reg, &offset, context);
 				emit_ld(buf, REGISTER_T0, offset, base_reg);//REGISTER_FP);
 				emit_beqz(buf, REGISTER_T0, &is_null_label);
-				emit_la(buf, REGISTER_T1, type);
 				//e introduce guard
 				//e load dynamic type descriptor
-				emit_ld(buf, REGISTER_T0, 0, REGISTER_T0);
+				emit_load_class(buf, REGISTER_T1, REGISTER_T0);
+				emit_la(buf, REGISTER_T0, type);
 				emit_bne(buf, REGISTER_T0, REGISTER_T1, &jump_labels[i]);
 				buffer_setlabel2(&is_null_label, buf);
 			} else {
@@ -1420,10 +2572,18 @@ baseline_optimisation_hook(buffer_t *buf, symtab_entry_t *sym, int args_offset_0
 		label_t skip_label;
 		emit_j(buf, &skip_label);
 
-		//e deoptimise
+		//e deoptimise, telling the dynamic compiler which guard failed
+		label_t deopt_labels[sym->parameters_nr];
 		for (int i = 0; i < sym->parameters_nr; i++) {
 			if (!buffer_label_is_empty(&jump_labels[i])) {
 				buffer_setlabel2(&jump_labels[i], buf);
+				emit_li(buf, REGISTER_A1, i);
+				emit_j(buf, &deopt_labels[i]);
+			}
+		}
+		for (int i = 0; i < sym->parameters_nr; i++) {
+			if (!buffer_label_is_empty(&jump_labels[i])) {
+				buffer_setlabel2(&deopt_labels[i], buf);
 			}
 		}
 		emit_la(buf, REGISTER_A0, sym);
@@ -1434,8 +2594,12 @@ baseline_optimisation_hook(buffer_t *buf, symtab_entry_t *sym, int args_offset_0
 		if (param_reg_count > REGISTERS_ARGUMENT_NR) {
 			param_reg_count = REGISTERS_ARGUMENT_NR;
 		}
-		for (int i = 0; i < param_reg_count; i++) {
-			emit_ld(buf, registers_argument[i], args_offset_0 - (i * WORD_SIZE), REGISTER_FP);
+		if (has_self_parameter) {
+			emit_ld(buf, REGISTER_A0, context->self_stack_location, REGISTER_FP);
+		}
+		//e parameters are stored in ascending order, starting at args_offset_0
+		for (int i = first_regular_parameter; i < param_reg_count; i++) {
+			emit_ld(buf, registers_argument[i], args_offset_0 + ((i - first_regular_parameter) * WORD_SIZE), REGISTER_FP);
 		}
 		//e continue on to deoptimised subroutine
 		emit_move(buf, REGISTER_SP, REGISTER_FP);
@@ -1523,12 +2687,45 @@ baseline_compile_static_callable(symtab_entry_t *sym)
 	if (is_constructor) {
 		parameters_nr = sym->parent->parameters_nr;
 	}
-	int stack_entries_nr = setup_mcontext(&mcontext, sym, &sym->storage, parameters_nr,
-					      is_constructor ? MCONTEXT_KIND_CONSTRUCTOR : MCONTEXT_KIND_DEFAULT, 0);
+	ast_node_t *body = node->children[2];
+	stack_object_t *stack_objects = NULL;
+	int stack_objects_nr = 0;
+	int stack_objects_words = 0;
+	register_allocation_t registers = { .assignments = NULL, .used_nr = 0 };
+	inline_site_t *inline_sites = NULL;
+	int inline_sites_nr = 0;
+	int inline_words = 0;
+	loop_invariants_t loop_invariants = { .loops = NULL, .loops_nr = 0, .temps_nr = 0 };
+	if (sym->symtab_flags & SYMTAB_OPT) {
+		stack_objects_words = stack_objects_find(body, &stack_objects, &stack_objects_nr, 0);
+		register_allocation_linear_scan(sym, &registers);
+		int inline_budget = INLINE_BUDGET_TOTAL;
+		inline_words = inline_sites_find(sym, body, &inline_sites, &inline_sites_nr, 0, &inline_budget);
+		loop_invariants_find(sym, sym->storage.temps_nr, &loop_invariants);
+	}
+	//e hoisted loop invariants live in extra temps
+	storage_record_t storage = sym->storage;
+	storage.temps_nr += loop_invariants.temps_nr;
+	int stack_entries_nr = setup_mcontext(&mcontext, sym, &storage, parameters_nr,
+					      is_constructor ? MCONTEXT_KIND_CONSTRUCTOR : MCONTEXT_KIND_DEFAULT,
+					      stack_objects_words + registers.used_nr + inline_words);
 	context_t *context = &mcontext;
+	context->loop_invariants = loop_invariants;
+	if ((sym->symtab_flags & SYMTAB_OPT) && sym->r_osr_loops) {
+		context->osr_entries = stack_alloc(sizeof(osr_entry_t), 2);
+	}
+	stack_objects_setup(context, stack_objects, stack_objects_nr, stack_objects_words);
+	inline_sites_setup(context, inline_sites, inline_sites_nr,
+			   context->stack_offset_temps - (stack_objects_words + registers.used_nr) * WORD_SIZE);
 
 	buffer_t mbuf = buffer_new(1024);
 	buffer_t *buf = &mbuf;
+	size_t preallocated_entry_offset = 0;
+	if (is_constructor) {
+		//e regular entry point: no preallocated `self'
+		emit_li(buf, REGISTER_T1, 0);
+		preallocated_entry_offset = buffer_size(mbuf);
+	}
 	emit_push(buf, REGISTER_FP);
 	emit_move(buf, REGISTER_FP, REGISTER_SP);
 	
@@ -1537,7 +2734,6 @@ baseline_compile_static_callable(symtab_entry_t *sym)
 	
 	ast_node_t **args = node->children[1]->children;
 	const int args_nr = node->children[1]->children_nr;
-	ast_node_t *body = node->children[2];
 
 	//d Parameter in Argumentregistern auf Stapel
 	//e Move parameters in argument registers onto the stack
@@ -1551,22 +2747,34 @@ baseline_compile_static_callable(symtab_entry_t *sym)
 		args[i]->sym->symtab_flags |= SYMTAB_EXCESS_PARAM;
 	}
 	if (is_constructor) {
-		//e Zero the `self' reference so the GC can tell if it hasn't been assigned yet
-		//d `self'-Referenz auf NULL setzen, damit der GC sie nicht fälschlich sucht
-		emit_li(buf, REGISTER_T0, 0);
-		emit_sd(buf, REGISTER_T0, context->self_stack_location, REGISTER_FP);
+		//e Store the preallocated `self' reference, or NULL so the GC can tell if it hasn't been assigned yet
+		//d Vorallozierte `self'-Referenz speichern, sonst NULL, damit der GC sie nicht fälschlich sucht
+		emit_sd(buf, REGISTER_T1, context->self_stack_location, REGISTER_FP);
 		stackmap_mark(context, context->self_stack_location, true);
 	}
+	for (int i = 0; i < context->stack_objects_nr; i++) {
+		emit_stack_object_clear(buf, &context->stack_objects[i]);
+	}
+	emit_inline_sites_clear(buf, context);
 
 	if (!is_constructor) {
 		baseline_optimisation_hook(buf, sym, context->stack_offset_args, 2 * WORD_SIZE, context);
 	}
+	//e parameters have been spilled to the stack above; from here on, use the register allocation
+	registers_setup(context, &registers, stack_objects_words);
+	emit_callee_saved_store(buf, args, args_nr, context);
 	baseline_compile_expr(buf, body, REGISTER_V0, context);
 
+	emit_callee_saved_restore(buf, context);
 	emit_move(buf, REGISTER_SP, REGISTER_FP);
 	emit_pop(buf, REGISTER_FP);
 	emit_jreturn(buf);
+	emit_osr_entries(buf, args, args_nr, stack_entries_nr, context);
 	buffer_terminate(mbuf);
+	osr_entries_install(mbuf, context);
+	if (is_constructor) {
+		sym->r_mem_preallocated = ((unsigned char *) buffer_entrypoint(mbuf)) + preallocated_entry_offset;
+	}
 	free_mcontext(&mcontext);
 	return mbuf;
 }
@@ -1579,9 +2787,34 @@ baseline_compile_method(symtab_entry_t *sym)
 	context_t mcontext;
 	mcontext.continue_labels = NULL;
 	mcontext.break_labels = NULL;
-	int stack_entries_nr = setup_mcontext(&mcontext, sym, &sym->storage, sym->parameters_nr,
-					      MCONTEXT_KIND_METHOD, 0);
+	stack_object_t *stack_objects = NULL;
+	int stack_objects_nr = 0;
+	int stack_objects_words = 0;
+	register_allocation_t registers = { .assignments = NULL, .used_nr = 0 };
+	inline_site_t *inline_sites = NULL;
+	int inline_sites_nr = 0;
+	int inline_words = 0;
+	loop_invariants_t loop_invariants = { .loops = NULL, .loops_nr = 0, .temps_nr = 0 };
+	if (sym->symtab_flags & SYMTAB_OPT) {
+		stack_objects_words = stack_objects_find(node->children[2], &stack_objects, &stack_objects_nr, 0);
+		register_allocation_linear_scan(sym, &registers);
+		int inline_budget = INLINE_BUDGET_TOTAL;
+		inline_words = inline_sites_find(sym, node->children[2], &inline_sites, &inline_sites_nr, 0, &inline_budget);
+		loop_invariants_find(sym, sym->storage.temps_nr, &loop_invariants);
+	}
+	//e hoisted loop invariants live in extra temps
+	storage_record_t storage = sym->storage;
+	storage.temps_nr += loop_invariants.temps_nr;
+	int stack_entries_nr = setup_mcontext(&mcontext, sym, &storage, sym->parameters_nr,
+					      MCONTEXT_KIND_METHOD, stack_objects_words + registers.used_nr + inline_words);
 	context_t *context = &mcontext;
+	context->loop_invariants = loop_invariants;
+	if ((sym->symtab_flags & SYMTAB_OPT) && sym->r_osr_loops) {
+		context->osr_entries = stack_alloc(sizeof(osr_entry_t), 2);
+	}
+	stack_objects_setup(context, stack_objects, stack_objects_nr, stack_objects_words);
+	inline_sites_setup(context, inline_sites, inline_sites_nr,
+			   context->stack_offset_temps - (stack_objects_words + registers.used_nr) * WORD_SIZE);
 
 	buffer_t mbuf = buffer_new(1024);
 	buffer_t *buf = &mbuf;
@@ -1610,14 +2843,70 @@ baseline_compile_method(symtab_entry_t *sym)
 		args[i - 1]->sym->offset = i + 2; // post $fp, return address
 		args[i - 1]->sym->symtab_flags |= SYMTAB_EXCESS_PARAM;
 	}
+	for (int i = 0; i < context->stack_objects_nr; i++) {
+		emit_stack_object_clear(buf, &context->stack_objects[i]);
+	}
+	emit_inline_sites_clear(buf, context);
 
 	baseline_optimisation_hook(buf, sym, context->stack_offset_args, 2 * WORD_SIZE, context);
+	//e parameters have been spilled to the stack above; from here on, use the register allocation
+	registers_setup(context, &registers, stack_objects_words);
+	emit_callee_saved_store(buf, args, full_args_nr - 1, context);
 	baseline_compile_expr(buf, body, REGISTER_V0, context);
 
+	emit_callee_saved_restore(buf, context);
 	emit_move(buf, REGISTER_SP, REGISTER_FP);
 	emit_pop(buf, REGISTER_FP);
 	emit_jreturn(buf);
+	emit_osr_entries(buf, args, full_args_nr - 1, stack_entries_nr, context);
 	buffer_terminate(mbuf);
+	osr_entries_install(mbuf, context);
 	free_mcontext(&mcontext);
 	return mbuf;
 }
+
+buffer_t
+baseline_compile_type_dispatcher(symtab_entry_t *sym, void *fallback)
+{
+	const int first_regular_parameter = SYMTAB_HAS_SELF(sym) ? 1 : 0;
+	const size_t versions_nr = sym->r_versions ? stack_size(sym->r_versions) : 0;
+	assert(sym->parameters_nr + first_regular_parameter <= REGISTERS_ARGUMENT_NR);
+
+	buffer_t buf = buffer_new(32 + versions_nr * (32 + 48 * sym->parameters_nr));
+	for (size_t v = 0; v < versions_nr; v++) {
+		dyncomp_version_t *version = (dyncomp_version_t *) stack_get(sym->r_versions, v);
+		label_t mismatch_labels[sym->parameters_nr + 1];
+		int mismatch_labels_nr = 0;
+
+		//e same guards as in baseline_optimisation_hook(), but on the argument registers
+		for (int i = 0; i < sym->parameters_nr; i++) {
+			class_t *type = version->parameter_types[i];
+			if (type && type != &class_top && type != &class_bottom) {
+				const int arg_reg = registers_argument[i + first_regular_parameter];
+				label_t is_null_label;
+				emit_beqz(&buf, arg_reg, &is_null_label);
+				emit_load_class(&buf, REGISTER_T1, arg_reg);
+				emit_la(&buf, REGISTER_T0, type);
+				emit_bne(&buf, REGISTER_T0, REGISTER_T1, &mismatch_labels[mismatch_labels_nr++]);
+				buffer_setlabel2(&is_null_label, &buf);
+			}
+		}
+		emit_la(&buf, REGISTER_T0, version->entry);
+		emit_jr(&buf, REGISTER_T0);
+
+		for (int k = 0; k < mismatch_labels_nr; k++) {
+			buffer_setlabel2(&mismatch_labels[k], &buf);
+		}
+	}
+	emit_la(&buf, REGISTER_T0, fallback);
+	emit_jr(&buf, REGISTER_T0);
+	buffer_terminate(buf);
+
+	if (compiler_options.debug_dynamic_compilation) {
+		fprintf(stderr, "Type dispatcher for `");
+		symtab_entry_name_dump(stderr, sym);
+		fprintf(stderr, "':");
+		buffer_disassemble(buf);
+	}
+	return buf;
+}
@@ -37,11 +37,12 @@
  * Maschinencode
  *
  * @param node Der zu uebersetzende AST-Baumknoten
+ * @param main_sym Symboltabelleneintrag des Haupteinsprungpunktes (mit Speicherbedarf und Schleifenzaehlern)
  * @param static_memory Der statische Speicher fuer Variableninhalte
  * @return Ein buffer_t mit dem Haupteinsprungpunkt
  */
 buffer_t
-baseline_compile_entrypoint(ast_node_t *node, storage_record_t *storage, void *static_memory);
+baseline_compile_entrypoint(ast_node_t *node, symtab_entry_t *main_sym, void *static_memory);
 
 /**
  * Uebersetzt ein AST-Fragment einer Funktion in ausfuehrbaren Maschinencode
@@ -61,4 +62,17 @@ baseline_compile_static_callable(symtab_entry_t *sym);
 buffer_t
 baseline_compile_method(symtab_entry_t *sym);
 
+/*e
+ * Generates the type dispatcher of a function with specialised versions (cf. dyncomp_version_t)
+ *
+ * The dispatcher expects the function's arguments in registers, jumps to the first of
+ * sym->r_versions whose parameter type guards hold, and otherwise jumps to `fallback'.
+ *
+ * @param sym Symbol table entry; all of its parameters must be passed in registers
+ * @param fallback Entry point to use if no version matches
+ * @return A buffer_t with the dispatcher
+ */
+buffer_t
+baseline_compile_type_dispatcher(symtab_entry_t *sym, void *fallback);
+
 #endif // defined(_ATTOL_BASELINE_BACKEND_H)
@@ -41,6 +41,7 @@ class_t class_boxed_int = {
 	.id = NULL,
 	.object_map = BITVECTOR_MAKE_SMALL(1, 0),
 	.table_mask = 0,
+	.dispatch_offset = -1,
 	.members = { { 0, NULL } }
 };
 
@@ -48,6 +49,7 @@ class_t class_boxed_real = {
 	.id = NULL,
 	.object_map = BITVECTOR_MAKE_SMALL(1, 0),
 	.table_mask = 0,
+	.dispatch_offset = -1,
 	.members = { { 0, NULL } }
 };
 
@@ -55,6 +57,7 @@ class_t class_string = {
 	.id = NULL,
 	.object_map = BITVECTOR_MAKE_SMALL(0, 0),
 	.table_mask = 1,
+	.dispatch_offset = -1,
 	.members = { { 0, NULL }, { 0, NULL },
 		     { 0, NULL }} // Zusaetzlicher Platz fuer virtuelle Funktionstabelle
 };
@@ -63,6 +66,7 @@ class_t class_array = {
 	.id = NULL,
 	.object_map = BITVECTOR_MAKE_SMALL(0, 0),
 	.table_mask = 1,
+	.dispatch_offset = -1,
 	.members = { { 0, NULL }, { 0, NULL },
 		     { 0, NULL }} // Zusaetzlicher Platz fuer virtuelle Funktionstabelle
 };
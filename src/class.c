@@ -26,15 +26,101 @@
 ***************************************************************************/
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "errors.h"
 #include "class.h"
+#include "object.h"
 #include "symbol-table.h"
 #include "address-store.h"
 
 class_t class_top;
 class_t class_bottom;
 
+class_dispatch_entry_t *class_dispatch_table = NULL;
+size_t class_dispatch_table_size = 0;
+
+//e Grows the dispatch table to at least `size' entries
+static void
+dispatch_table_reserve(size_t size)
+{
+	if (size <= class_dispatch_table_size) {
+		return;
+	}
+	size_t new_size = class_dispatch_table_size ? class_dispatch_table_size : 64;
+	while (new_size < size) {
+		new_size <<= 1;
+	}
+	class_dispatch_table = realloc(class_dispatch_table, new_size * sizeof(class_dispatch_entry_t));
+	if (!class_dispatch_table) {
+		fail("Out of memory for the class dispatch table");
+	}
+	memset(class_dispatch_table + class_dispatch_table_size, 0,
+	       (new_size - class_dispatch_table_size) * sizeof(class_dispatch_entry_t));
+	class_dispatch_table_size = new_size;
+}
+
+//e Removes the row of `classref' from the dispatch table
+static void
+dispatch_remove(class_t *classref)
+{
+	if (classref->dispatch_offset < 0) {
+		return;
+	}
+	for (int i = 0; i <= classref->table_mask; i++) {
+		const unsigned long long coding = classref->members[i].selector_encoding;
+		if (coding) {
+			const size_t index = classref->dispatch_offset + CLASS_DECODE_SELECTOR_ID(coding);
+			if (index < class_dispatch_table_size && class_dispatch_table[index].classref == classref) {
+				class_dispatch_table[index].classref = NULL;
+				class_dispatch_table[index].selector_encoding = 0;
+			}
+		}
+	}
+	classref->dispatch_offset = -1;
+}
+
+//e Can the row of `classref' start at `offset' without overlapping other rows?
+static bool
+dispatch_row_fits(class_t *classref, size_t offset)
+{
+	for (int i = 0; i <= classref->table_mask; i++) {
+		const unsigned long long coding = classref->members[i].selector_encoding;
+		if (coding) {
+			const size_t index = offset + CLASS_DECODE_SELECTOR_ID(coding);
+			if (index < class_dispatch_table_size && class_dispatch_table[index].classref) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/*e
+ * (Re-)inserts the row of `classref' into the dispatch table, at the first offset at which it fits
+ * (row displacement).  Rows of different classes interleave, since each row is sparse.
+ */
+static void
+dispatch_place(class_t *classref)
+{
+	dispatch_remove(classref);
+	size_t offset = 0;
+	while (!dispatch_row_fits(classref, offset)) {
+		++offset;
+	}
+	classref->dispatch_offset = offset;
+	for (int i = 0; i <= classref->table_mask; i++) {
+		const unsigned long long coding = classref->members[i].selector_encoding;
+		if (coding) {
+			const size_t index = offset + CLASS_DECODE_SELECTOR_ID(coding);
+			dispatch_table_reserve(index + 1);
+			class_dispatch_table[index].classref = classref;
+			class_dispatch_table[index].selector_encoding = coding;
+		}
+	}
+}
+
 class_t *
 class_new(symtab_entry_t *entry)
 {
@@ -45,11 +131,21 @@ class_new(symtab_entry_t *entry)
 				   // Virtuelle Methodentabelle
 				   + (entry->storage.functions_nr * sizeof(void *)));
 	classref->table_mask = size - 1;
+	classref->dispatch_offset = -1;
 	classref->object_map = bitvector_alloc(entry->storage.fields_nr);
 
 	return class_initialise_and_link(classref, entry);
 }
 
+void
+class_free(class_t *classref)
+{
+	dispatch_remove(classref);
+	object_selector_cache_flush();
+	bitvector_free(classref->object_map);
+	free(classref);
+}
+
 // Findet das signifikanteste gesetzte Bit
 int
 find_last_set(int number)
@@ -166,11 +262,25 @@ class_add_selector(class_t *classref, symtab_entry_t *selector_impl)
 	classref->members[index].selector_encoding =
 		CLASS_ENCODE_SELECTOR(selector_impl->selector, selector_impl->offset, type_encoding);
 	classref->members[index].symbol = selector_impl;
+	if (classref->dispatch_offset >= 0) {
+		//e already linked: update our row, moving it if the new entry's slot is taken
+		const size_t dispatch_index = classref->dispatch_offset + selector_impl->selector;
+		if (dispatch_index < class_dispatch_table_size && class_dispatch_table[dispatch_index].classref) {
+			dispatch_place(classref);
+		} else {
+			dispatch_table_reserve(dispatch_index + 1);
+			class_dispatch_table[dispatch_index].classref = classref;
+			class_dispatch_table[dispatch_index].selector_encoding = classref->members[index].selector_encoding;
+		}
+	}
+	object_selector_cache_flush();
 }
 
 class_t *
 class_initialise_and_link(class_t *classref, symtab_entry_t *entry)
 {
+	//e statically allocated classes may be linked repeatedly
+	dispatch_remove(classref);
 	classref->id = entry;
 	entry->r_mem = classref;
 	addrstore_put(classref, ADDRSTORE_KIND_TYPE, entry->name);
@@ -192,6 +302,8 @@ class_initialise_and_link(class_t *classref, symtab_entry_t *entry)
 			}
 		}
 	}
+	dispatch_place(classref);
+	object_selector_cache_flush(); /*e `classref' may reuse the memory of a deallocated class */
 	return classref;
 }
 
@@ -110,6 +110,11 @@ typedef struct {
 //e
 //e Method addresses reside in memory immediately after the `members' table (cf. CLASS_VTABLE).
 //e
+//e The runtime does not probe `members' for lookups: all linked classes also share one global, selector-indexed
+//e dispatch table, compressed by row displacement.  The row of a class starts at its `dispatch_offset', so the
+//e entry for a selector is at class_dispatch_table[dispatch_offset + selector] (cf. class_lookup_selector()).
+//e `members' remains the authoritative list of a class' members, e.g. for printing.
+//e
 //e Note wrt encoding:  All members are re-written by type analysis to take parameters of type
 //e compiler_options.method_call_param_type and to return values of type
 //e compiler_options.method_call_return_type.  (Usually both are TYPE_OBJ, corresponding to object_t *)
@@ -124,6 +129,7 @@ typedef struct class_struct {
 	symtab_entry_t *id; /*d Symboltabelleneintrag (fuer den Uebersetzer/Debugging) *//*e symbol table entry */
 	bitvector_t object_map; /*e bitvector marking the offsets of reference (object_t *) fields */
 	unsigned long long table_mask; /*d Tabellengroesse - 1 *//* table size - 1 */
+	long long dispatch_offset; /*e start of this class' row in class_dispatch_table; negative if not linked */
 
 	class_member_t members[]; /* (table_mask + 1) Eintraege *//* (table_mask + 1) entries */
 	//d Hinter den `members' liegt die virtuelle Funktionstabelle (vtable) (Adressen der tatsaechlichen Einsprungpunkte der Methoden)
@@ -135,6 +141,30 @@ extern class_t class_boxed_real;/*d Ein Eintrag: real_v */
 extern class_t class_string;	/*d Zeichenkette beginnt ab member[0] */
 extern class_t class_array;	/*d len+1 Eintraege, mit member[0].int_v=len */
 
+//e entry in the global dispatch table
+typedef struct {
+	class_t *classref; /*e class whose row contains this entry; NULL if unused */
+	unsigned long long selector_encoding; /*e encoded via CLASS_ENCODE_SELECTOR() */
+} class_dispatch_entry_t;
+
+extern class_dispatch_entry_t *class_dispatch_table;
+extern size_t class_dispatch_table_size;
+
+/*e
+ * Looks up a selector in the dispatch table
+ *
+ * @return The selector encoding (cf. CLASS_ENCODE_SELECTOR()), or 0 if the class has no such member
+ */
+static inline unsigned long long
+class_lookup_selector(class_t *classref, int selector)
+{
+	const size_t index = classref->dispatch_offset + selector;
+	if (index < class_dispatch_table_size && class_dispatch_table[index].classref == classref) {
+		return class_dispatch_table[index].selector_encoding;
+	}
+	return 0;
+}
+
 extern class_t class_top;	/*e `top' fake class to aid analysis; lacks symbol table entry */
 extern class_t class_bottom;	/*e `bottom' fake class to aid analysis; lacks symbol table entry */
 
@@ -153,6 +183,12 @@ class_print_short(FILE *file, class_t *classref);
 class_t*
 class_new(symtab_entry_t *entry);
 
+/*e
+ * Deallocates a class structure obtained from class_new() and removes it from the dispatch table
+ */
+void
+class_free(class_t *classref);
+
 /*e
  * Prints the structure of a given class
  */
@@ -38,11 +38,16 @@ struct compiler_options {
 	bool debug_adaptive;
 	bool debug_gc;
 	bool no_adaptive_compilation;
+	bool background_compilation; /*e optimise hot code in a background compiler thread */
 
 	int array_storage_type;
 	int method_call_param_type;
 	int method_call_return_type;
-	size_t heap_size; /*e available heap memory size */
+	size_t heap_size; /*e maximum heap memory size */
+	size_t heap_min_size; /*e initial and minimum heap memory size */
+	int gc_threads; /*e number of garbage collector threads */
+	bool gc_mark_compact; /*e use mark-compact instead of semispace copying for major collections */
+	size_t large_object_threshold; /*e minimum size (in bytes) of objects in the large object space */
 };
 
 extern struct compiler_options compiler_options;
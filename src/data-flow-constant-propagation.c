@@ -0,0 +1,501 @@
+/***************************************************************************
+  Copyright (C) 2015 Christoph Reichenbach
+
+
+ This program may be modified and copied freely according to the terms of
+ the GNU general public license (GPL), as long as the above copyright
+ notice and the licensing information contained herein are preserved.
+
+ Please refer to www.gnu.org for licensing details.
+
+ This work is provided AS IS, without warranty of any kind, expressed or
+ implied, including but not limited to the warranties of merchantability,
+ noninfringement, and fitness for a specific purpose. The author will not
+ be held liable for any damage caused by this work or derivatives of it.
+
+ By using this source code, you agree to the licensing terms as stated
+ above.
+
+
+ Please contact the maintainer for bug reports or inquiries.
+
+ Current Maintainer:
+
+    Christoph Reichenbach (CR) <creichen@gmail.com>
+
+***************************************************************************/
+
+#include <assert.h>
+#include <string.h>
+
+#include "ast.h"
+#include "data-flow.h"
+
+//================================================================================
+//e Data Flow Anaysis:  sparse conditional constant propagation
+
+//e Data stored:
+//e Reachability of the node, the branch (if any) that was just decided by a constant IF/WHILE condition,
+//e and an array mapping integer local variables to their constant values.
+
+#define CONST_BOT	0
+#define CONST_INT	1
+#define CONST_TOP	2
+
+typedef struct {
+	unsigned char kind; /*e One of CONST_* */
+	signed long int num; /*e only with CONST_INT */
+} constant_t;
+
+typedef struct {
+	bool reachable;
+	//e IF/WHILE node whose condition was constant, and the branch taken (1: `then'/loop body, 0: `else'/loop exit)
+	ast_node_t *branch;
+	bool branch_taken;
+	constant_t values[];
+} fact_t;
+
+static constant_t
+const_bottom()
+{
+	return (constant_t) { .kind = CONST_BOT };
+}
+
+static constant_t
+const_top()
+{
+	return (constant_t) { .kind = CONST_TOP };
+}
+
+static constant_t
+const_int(signed long int num)
+{
+	return (constant_t) { .kind = CONST_INT, .num = num };
+}
+
+static fact_t *
+fact_alloc(symtab_entry_t *sym)
+{
+	const int count = data_flow_number_of_locals(sym);
+	return calloc(1, sizeof(fact_t) + sizeof(constant_t) * count);
+}
+
+static void *
+init(symtab_entry_t *sym, ast_node_t *node)
+{
+	fact_t *fact = fact_alloc(sym);
+
+	//e only the entry node is known to be reachable; parameters may hold any value there
+	if (node == sym->astref) {
+		fact->reachable = true;
+		for (int i = 0; i < sym->parameters_nr; i++) {
+			fact->values[i] = const_top();
+		}
+	}
+	return fact;
+}
+
+static void
+print(FILE *file, symtab_entry_t *sym, void *pfact)
+{
+	if (!pfact) {
+		fprintf(file, "NULL");
+		return;
+	}
+
+	fact_t *fact = (fact_t *) pfact;
+	if (!fact->reachable) {
+		fprintf(file, "unreachable");
+		return;
+	}
+
+	const int entries_nr = data_flow_number_of_locals(sym);
+	symtab_entry_t *var_symbols[entries_nr];
+	data_flow_get_all_locals(sym, var_symbols);
+
+	bool printed_before = false;
+	for (int i = 0; i < entries_nr; ++i) {
+		if (fact->values[i].kind != CONST_BOT) {
+			if (printed_before) {
+				fprintf(file, "; ");
+			} else {
+				printed_before = true;
+			}
+			fprintf(file, "%s:", var_symbols[i]->name);
+			if (fact->values[i].kind == CONST_TOP) {
+				fprintf(file, "T");
+			} else {
+				fprintf(file, "%ld", fact->values[i].num);
+			}
+		}
+	}
+	if (fact->branch) {
+		fprintf(file, "%s[branch %d]", printed_before ? " " : "", fact->branch_taken);
+	}
+}
+
+static void *
+df_copy(symtab_entry_t *sym, void *pfact)
+{
+	const int count = data_flow_number_of_locals(sym);
+	size_t size = sizeof(fact_t) + sizeof(constant_t) * count;
+	fact_t *fact = malloc(size);
+	memcpy(fact, pfact, size);
+	return fact;
+}
+
+static constant_t
+const_join(constant_t lhs, constant_t rhs)
+{
+	if (lhs.kind == CONST_BOT) {
+		return rhs;
+	}
+	if (rhs.kind == CONST_BOT) {
+		return lhs;
+	}
+	if (lhs.kind == CONST_INT && rhs.kind == CONST_INT
+	    && lhs.num == rhs.num) {
+		return lhs;
+	}
+	return const_top();
+}
+
+static bool
+const_less_than_or_equal(constant_t lhs, constant_t rhs)
+{
+	if (lhs.kind == CONST_BOT || rhs.kind == CONST_TOP) {
+		return true;
+	}
+	return lhs.kind == rhs.kind && lhs.num == rhs.num;
+}
+
+static void *
+join(symtab_entry_t *sym, void *pin1, void *pin2)
+{
+	fact_t *lhs = (fact_t *) pin1;
+	fact_t *rhs = (fact_t *) pin2;
+
+	//e unreachable paths contribute nothing
+	if (!lhs->reachable) {
+		return df_copy(sym, rhs);
+	}
+	if (!rhs->reachable) {
+		return df_copy(sym, lhs);
+	}
+
+	const int locals_nr = data_flow_number_of_locals(sym);
+	fact_t *result = fact_alloc(sym);
+	result->reachable = true;
+	if (lhs->branch == rhs->branch && lhs->branch_taken == rhs->branch_taken) {
+		result->branch = lhs->branch;
+		result->branch_taken = lhs->branch_taken;
+	}
+	for (int i = 0; i < locals_nr; i++) {
+		result->values[i] = const_join(lhs->values[i], rhs->values[i]);
+	}
+	return result;
+}
+
+/*e
+ * Determines whether the given variable is an integer local that we track
+ *
+ * @return The local variable index, or -1
+ */
+static int
+int_local_var(symtab_entry_t *sym, ast_node_t *node)
+{
+	if (NODE_TY(node) != AST_VALUE_ID
+	    || AST_TYPE(node) != TYPE_INT) {
+		return -1;
+	}
+	return data_flow_is_local_var(sym, node);
+}
+
+static bool
+is_foldable_builtin(ast_node_t *node)
+{
+	if (NODE_TY(node) != AST_NODE_FUNAPP
+	    || AST_TYPE(node) != TYPE_INT
+	    || node->children[0]->sym->id >= 0
+	    || node->children[1]->children_nr != 2) {
+		return false;
+	}
+	switch (node->children[0]->sym->id) {
+	case BUILTIN_OP_ADD:
+	case BUILTIN_OP_SUB:
+	case BUILTIN_OP_MUL:
+	case BUILTIN_OP_DIV:
+	case BUILTIN_OP_TEST_EQ:
+	case BUILTIN_OP_TEST_LE:
+	case BUILTIN_OP_TEST_LT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*e
+ * Evaluates an expression over the constants known for local variables
+ */
+static constant_t
+expression(symtab_entry_t *sym, constant_t *values, ast_node_t *node)
+{
+	switch (NODE_TY(node)) {
+	case AST_VALUE_INT:
+		if (AST_TYPE(node) == TYPE_INT) {
+			return const_int(AV_INT(node));
+		}
+		return const_top();
+
+	case AST_VALUE_ID: {
+		int var = int_local_var(sym, node);
+		if (var >= 0) {
+			return values[var];
+		}
+		return const_top();
+	}
+
+	case AST_NODE_FUNAPP: {
+		if (!is_foldable_builtin(node)) {
+			return const_top();
+		}
+		ast_node_t **args = node->children[1]->children;
+		if (AST_TYPE(args[0]) != TYPE_INT || AST_TYPE(args[1]) != TYPE_INT) {
+			return const_top();
+		}
+		constant_t lhs = expression(sym, values, args[0]);
+		constant_t rhs = expression(sym, values, args[1]);
+		if (lhs.kind == CONST_BOT || rhs.kind == CONST_BOT) {
+			return const_bottom();
+		}
+		if (lhs.kind == CONST_TOP || rhs.kind == CONST_TOP) {
+			return const_top();
+		}
+		//e compute with the same (wrap-around) semantics as the generated code
+		unsigned long int a = lhs.num;
+		unsigned long int b = rhs.num;
+		switch (node->children[0]->sym->id) {
+		case BUILTIN_OP_ADD:
+			return const_int((signed long int) (a + b));
+		case BUILTIN_OP_SUB:
+			return const_int((signed long int) (a - b));
+		case BUILTIN_OP_MUL:
+			return const_int((signed long int) (a * b));
+		case BUILTIN_OP_DIV:
+			//e division by zero must still trap at run time, and negative dividends are not sign-extended
+			if (lhs.num < 0 || rhs.num <= 0) {
+				return const_top();
+			}
+			return const_int(lhs.num / rhs.num);
+		case BUILTIN_OP_TEST_EQ:
+			return const_int(lhs.num == rhs.num);
+		case BUILTIN_OP_TEST_LE:
+			return const_int(lhs.num <= rhs.num);
+		case BUILTIN_OP_TEST_LT:
+			return const_int(lhs.num < rhs.num);
+		}
+		return const_top();
+	}
+
+	default:
+		return const_top();
+	}
+}
+
+/*e
+ * Finds the AST node of the first CFG node within a branch (or NULL if the branch contains none)
+ */
+static ast_node_t *
+branch_entry(ast_node_t *node)
+{
+	if (!node) {
+		return NULL;
+	}
+	if (NODE_TY(node) == AST_NODE_BLOCK) {
+		for (int i = 0; i < node->children_nr; i++) {
+			ast_node_t *entry = branch_entry(node->children[i]);
+			if (entry) {
+				return entry;
+			}
+		}
+		return NULL;
+	}
+	return node;
+}
+
+/*e
+ * Determines the branch of an IF or WHILE node that cannot be taken, if `taken' is known
+ */
+static ast_node_t *
+dead_branch(ast_node_t *node, bool taken)
+{
+	if (NODE_TY(node) == AST_NODE_IF) {
+		return taken ? node->children[2] : node->children[1];
+	}
+	//e WHILE: a constantly true condition leaves the loop exit to `break'
+	return taken ? NULL : node->children[1];
+}
+
+static void *
+transfer(symtab_entry_t *sym, ast_node_t *ast, void *pin)
+{
+	fact_t *in = (fact_t *) pin;
+	fact_t *fact = (fact_t *) df_copy(sym, pin);
+	fact->branch = NULL;
+
+	if (!in->reachable) {
+		return fact;
+	}
+
+	if (in->branch && branch_entry(dead_branch(in->branch, in->branch_taken)) == ast) {
+		//e only reached along an edge that is never taken
+		fact->reachable = false;
+		return fact;
+	}
+
+	switch (NODE_TY(ast)) {
+	case AST_NODE_VARDECL:
+	case AST_NODE_ASSIGN: {
+		int var = data_flow_is_local_var(sym, ast->children[0]);
+		if (var >= 0) {
+			if (ast->children[1] && AST_TYPE(ast->children[0]) == TYPE_INT) {
+				fact->values[var] = expression(sym, in->values, ast->children[1]);
+			} else {
+				fact->values[var] = const_top();
+			}
+		}
+	}
+		break;
+
+	case AST_NODE_IF:
+	case AST_NODE_WHILE: {
+		constant_t condition = expression(sym, in->values, ast->children[0]);
+		if (condition.kind == CONST_INT) {
+			fact->branch = ast;
+			fact->branch_taken = condition.num != 0;
+		}
+	}
+		break;
+	}
+
+	return fact;
+}
+
+static bool
+is_less_than_or_equal(symtab_entry_t *sym, void *plhs, void *prhs)
+{
+	const int locals_nr = data_flow_number_of_locals(sym);
+	fact_t *lhs = (fact_t *) plhs;
+	fact_t *rhs = (fact_t *) prhs;
+
+	if (!lhs->reachable) {
+		return true;
+	}
+	if (!rhs->reachable) {
+		return false;
+	}
+	if (rhs->branch
+	    && (lhs->branch != rhs->branch || lhs->branch_taken != rhs->branch_taken)) {
+		return false;
+	}
+	for (int var = 0; var < locals_nr; var++) {
+		if (!const_less_than_or_equal(lhs->values[var], rhs->values[var])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void
+df_free(void *fact)
+{
+	free(fact);
+}
+
+// --------------------------------------------------------------------------------
+// Folding
+
+static ast_node_t *
+fold(ast_node_t *node, signed long int num)
+{
+	ast_node_t *folded = value_node_alloc_generic(AST_VALUE_INT, (ast_value_union_t) { .num = num });
+	folded->type |= TYPE_INT;
+	folded->storage = node->storage;
+	folded->source_line = node->source_line;
+	ast_node_free(node, 1);
+	return folded;
+}
+
+/*e
+ * Replaces constant integer expressions and reads of constant local variables by literals
+ */
+static void
+fold_recursively(symtab_entry_t *sym, constant_t *values, ast_node_t *node)
+{
+	if (!node || IS_VALUE_NODE(node)) {
+		return;
+	}
+
+	//e CFG split magic:  as for precise-types, don't descend into other CFG nodes
+	int *cfg_subnodes_indices;
+	int cfg_subnodes_indices_nr = cfg_subnodes(node, &cfg_subnodes_indices);
+	if (cfg_subnodes_indices_nr < 0) {
+		return;
+	}
+	int cfg_subnodes_index_counter = 0;
+
+	for (int i = 0; i < node->children_nr; i++) {
+		ast_node_t *child = node->children[i];
+		if (cfg_subnodes_index_counter < cfg_subnodes_indices_nr
+		    && i == cfg_subnodes_indices[cfg_subnodes_index_counter]) {
+			++cfg_subnodes_index_counter;
+			continue;
+		}
+		if (!child) {
+			continue;
+		}
+
+		if ((NODE_TY(child) == AST_VALUE_ID
+		     && !(child->type & (AST_FLAG_LVALUE | AST_FLAG_DECL))
+		     && int_local_var(sym, child) >= 0)
+		    || is_foldable_builtin(child)) {
+			constant_t value = expression(sym, values, child);
+			if (value.kind == CONST_INT) {
+				node->children[i] = fold(child, value.num);
+				continue;
+			}
+		}
+		fold_recursively(sym, values, child);
+	}
+}
+
+static void
+fold_constants(symtab_entry_t *sym, void *pfact, void **context, ast_node_t *node)
+{
+	fact_t *fact = (fact_t *) pfact;
+	if (!fact->reachable) {
+		return;
+	}
+	//e IF/WHILE nodes with constant conditions get a literal condition, which lets the
+	//e backend skip the dead branch
+	fold_recursively(sym, fact->values, node);
+}
+
+static data_flow_postprocessor_t postprocessor = {
+	.init = NULL,
+	.visit_node = fold_constants,
+	.free = NULL
+};
+
+data_flow_analysis_t data_flow_analysis__constant_propagation = {
+	.forward = true,
+	.name = "constant-propagation",
+	.init = init,
+	.print = print,
+	.join = join,
+	.transfer = transfer,
+	.is_less_than_or_equal = is_less_than_or_equal,
+	.free = df_free,
+	.copy = df_copy,
+	.postprocessor = &postprocessor
+};
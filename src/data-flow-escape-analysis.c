@@ -0,0 +1,455 @@
+/***************************************************************************
+  Copyright (C) 2015 Christoph Reichenbach
+
+
+ This program may be modified and copied freely according to the terms of
+ the GNU general public license (GPL), as long as the above copyright
+ notice and the licensing information contained herein are preserved.
+
+ Please refer to www.gnu.org for licensing details.
+
+ This work is provided AS IS, without warranty of any kind, expressed or
+ implied, including but not limited to the warranties of merchantability,
+ noninfringement, and fitness for a specific purpose. The author will not
+ be held liable for any damage caused by this work or derivatives of it.
+
+ By using this source code, you agree to the licensing terms as stated
+ above.
+
+
+ Please contact the maintainer for bug reports or inquiries.
+
+ Current Maintainer:
+
+    Christoph Reichenbach (CR) <creichen@gmail.com>
+
+***************************************************************************/
+
+#include <assert.h>
+#include <string.h>
+
+#include "ast.h"
+#include "data-flow.h"
+
+//e Escape analysis: finds NEWINSTANCE nodes whose objects never outlive the current activation record,
+//e and marks them with OPT_FLAG_STACK_ALLOCATE so that the backend can place them in the stack frame.
+//e
+//e An allocation site is a candidate if it is assigned directly to a local variable and the class
+//e constructor does not leak `self'.  The object then lives only in that variable, so it escapes precisely
+//e when the variable is used in any other way than as the receiver of a field access, as the subject of
+//e an `is' test, or as an argument to a built-in operator (other than CONVERT) while it (may) hold the object.
+
+//================================================================================
+//e Escape lattice
+
+#define ESCAPE_BOT	0	/*e unassigned */
+#define ESCAPE_OTHER	1	/*e holds something that did not come from a candidate allocation site */
+#define ESCAPE_SITE	2	/*e holds the object from allocation site `site' */
+#define ESCAPE_MAYBE	3	/*e either ESCAPE_OTHER or ESCAPE_SITE */
+#define ESCAPE_TOP	4	/*e may hold objects from any allocation site assigned to this variable */
+
+typedef struct {
+	ast_node_t *site;
+	unsigned char kind; /*e One of ESCAPE_* */
+} escape_t;
+
+static escape_t
+esc_init(int kind, ast_node_t *site)
+{
+	return (escape_t) { .site = site, .kind = kind };
+}
+
+static bool
+esc_equal(escape_t lhs, escape_t rhs)
+{
+	return lhs.kind == rhs.kind && lhs.site == rhs.site;
+}
+
+static escape_t
+esc_join(escape_t lhs, escape_t rhs)
+{
+	if (lhs.kind == ESCAPE_BOT || esc_equal(lhs, rhs)) {
+		return rhs;
+	}
+	if (rhs.kind == ESCAPE_BOT) {
+		return lhs;
+	}
+	if (lhs.kind == ESCAPE_TOP || rhs.kind == ESCAPE_TOP) {
+		return esc_init(ESCAPE_TOP, NULL);
+	}
+	if (lhs.kind == ESCAPE_OTHER) {
+		return esc_init(ESCAPE_MAYBE, rhs.site);
+	}
+	if (rhs.kind == ESCAPE_OTHER) {
+		return esc_init(ESCAPE_MAYBE, lhs.site);
+	}
+	//e both are SITE or MAYBE
+	if (lhs.site == rhs.site) {
+		return esc_init(ESCAPE_MAYBE, lhs.site);
+	}
+	return esc_init(ESCAPE_TOP, NULL);
+}
+
+static void
+esc_print(FILE *file, escape_t esc)
+{
+	switch (esc.kind) {
+	case ESCAPE_BOT:
+		fprintf(file, "_");
+		break;
+	case ESCAPE_OTHER:
+		fprintf(file, "-");
+		break;
+	case ESCAPE_SITE:
+		fprintf(file, "L%d", esc.site->source_line);
+		break;
+	case ESCAPE_MAYBE:
+		fprintf(file, "L%d?", esc.site->source_line);
+		break;
+	case ESCAPE_TOP:
+		fprintf(file, "T");
+		break;
+	default:
+		fprintf(file, "?(%d)ERROR\n", esc.kind);
+	}
+}
+
+//================================================================================
+//e Data Flow Anaysis
+
+//e Data stored:
+//e Array mapping local variables to the allocation site whose object they hold
+
+static void *
+init(symtab_entry_t *sym, ast_node_t *node)
+{
+	return calloc(sizeof(escape_t), data_flow_number_of_locals(sym));
+}
+
+static void
+print(FILE *file, symtab_entry_t *sym, void *pfact)
+{
+	if (!pfact) {
+		fprintf(file, "NULL");
+		return;
+	}
+
+	const int entries_nr = data_flow_number_of_locals(sym);
+	symtab_entry_t *var_symbols[entries_nr];
+	data_flow_get_all_locals(sym, var_symbols);
+
+	escape_t *locals = (escape_t *) pfact;
+
+	bool printed_before = false;
+	for (int i = 0; i < entries_nr; ++i) {
+		if (locals[i].kind != ESCAPE_BOT) {
+			if (printed_before) {
+				fprintf(file, "; ");
+			} else {
+				printed_before = true;
+			}
+			fprintf(file, "%s:", var_symbols[i]->name);
+			esc_print(file, locals[i]);
+		}
+	}
+}
+
+static void *
+df_copy(symtab_entry_t *sym, void *fact)
+{
+	size_t size = data_flow_number_of_locals(sym) * sizeof(escape_t);
+	escape_t *cloned = calloc(size, 1);
+	memcpy(cloned, fact, size);
+	return cloned;
+}
+
+static void *
+join(symtab_entry_t *sym, void *pin1, void *pin2)
+{
+	const int locals_nr = data_flow_number_of_locals(sym);
+	escape_t *lhs = (escape_t *) pin1;
+	escape_t *rhs = (escape_t *) pin2;
+	escape_t *result = malloc(sizeof(escape_t) * locals_nr);
+	for (int i = 0; i < locals_nr; i++) {
+		result[i] = esc_join(lhs[i], rhs[i]);
+	}
+	return result;
+}
+
+static void *
+transfer(symtab_entry_t *sym, ast_node_t *ast, void *pin)
+{
+	escape_t *locals = (escape_t *) df_copy(sym, pin);
+
+	switch (NODE_TY(ast)) {
+	case AST_NODE_VARDECL:
+	case AST_NODE_ASSIGN: {
+		int var = data_flow_is_local_var(sym, ast->children[0]);
+		if (var >= 0) {
+			if (ast->children[1] && NODE_TY(ast->children[1]) == AST_NODE_NEWINSTANCE) {
+				locals[var] = esc_init(ESCAPE_SITE, ast->children[1]);
+			} else {
+				locals[var] = esc_init(ESCAPE_OTHER, NULL);
+			}
+		}
+	}
+	}
+
+	return locals;
+}
+
+static bool
+is_less_than_or_equal(symtab_entry_t *sym, void *plhs, void *prhs)
+{
+	const int locals_nr = data_flow_number_of_locals(sym);
+	escape_t *lhs = (escape_t *) plhs;
+	escape_t *rhs = (escape_t *) prhs;
+
+	for (int var = 0; var < locals_nr; var++) {
+		if (!esc_equal(esc_join(lhs[var], rhs[var]), rhs[var])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void
+df_free(void *fact)
+{
+	free(fact);
+}
+
+// --------------------------------------------------------------------------------
+// Marking non-escaping allocation sites
+
+#define IS_SELF(node) (NODE_TY(node) == AST_VALUE_ID && (node)->sym && (node)->sym->id == BUILTIN_OP_SELF)
+
+typedef struct {
+	ast_node_t *site;
+	int var;
+} candidate_t;
+
+typedef struct {
+	candidate_t *candidates;
+	int candidates_nr;
+} escape_context_t;
+
+/*e
+ * Determines whether a constructor body might let `self' escape
+ *
+ * `self' may only be (re)assigned, used as the receiver of field accesses, and returned.  Implicit writes to
+ * fields are rejected, too, since the backend emits heap write barriers for them.
+ */
+static bool
+constructor_leaks_self(ast_node_t *node)
+{
+	if (!node) {
+		return false;
+	}
+	if (IS_VALUE_NODE(node)) {
+		return IS_SELF(node);
+	}
+
+	switch (NODE_TY(node)) {
+	case AST_NODE_VARDECL:
+	case AST_NODE_ASSIGN: {
+		ast_node_t *lhs = node->children[0];
+		if (NODE_TY(lhs) == AST_VALUE_ID) {
+			if ((lhs->sym->symtab_flags & SYMTAB_MEMBER) && SYMTAB_KIND(lhs->sym) == SYMTAB_KIND_VAR) {
+				return true;
+			}
+		} else if (NODE_TY(lhs) == AST_NODE_MEMBER) {
+			if (!IS_SELF(lhs->children[0]) && constructor_leaks_self(lhs->children[0])) {
+				return true;
+			}
+		} else if (constructor_leaks_self(lhs)) {
+			return true;
+		}
+		return constructor_leaks_self(node->children[1]);
+	}
+
+	case AST_NODE_MEMBER:
+		return !IS_SELF(node->children[0]) && constructor_leaks_self(node->children[0]);
+
+	case AST_NODE_RETURN:
+		return !IS_SELF(node->children[0]) && constructor_leaks_self(node->children[0]);
+
+	default:
+		for (int i = 0; i < node->children_nr; i++) {
+			if (constructor_leaks_self(node->children[i])) {
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+static bool
+is_candidate_site(ast_node_t *site)
+{
+	symtab_entry_t *class_sym = site->children[0]->sym;
+	assert(class_sym);
+	ast_node_t *constructor = class_sym->astref->children[3];
+	return !constructor_leaks_self(constructor->children[2]);
+}
+
+//e collects all candidate allocation sites in `node' and resets the optimisation flag on all others
+static void
+find_candidates(symtab_entry_t *sym, escape_context_t *ctx, ast_node_t *node)
+{
+	if (!node || IS_VALUE_NODE(node)) {
+		return;
+	}
+	for (int i = 0; i < node->children_nr; i++) {
+		find_candidates(sym, ctx, node->children[i]);
+	}
+
+	switch (NODE_TY(node)) {
+	case AST_NODE_NEWINSTANCE:
+		node->opt_flags &= ~OPT_FLAG_STACK_ALLOCATE;
+		break;
+
+	case AST_NODE_VARDECL:
+	case AST_NODE_ASSIGN: {
+		ast_node_t *site = node->children[1];
+		const int var = data_flow_is_local_var(sym, node->children[0]);
+		if (var >= 0 && site && NODE_TY(site) == AST_NODE_NEWINSTANCE && is_candidate_site(site)) {
+			site->opt_flags |= OPT_FLAG_STACK_ALLOCATE;
+			ctx->candidates = realloc(ctx->candidates, sizeof(candidate_t) * (ctx->candidates_nr + 1));
+			ctx->candidates[ctx->candidates_nr++] = (candidate_t) { .site = site, .var = var };
+		}
+	}
+		break;
+	}
+}
+
+static void
+escape(escape_context_t *ctx, int var, escape_t esc)
+{
+	switch (esc.kind) {
+	case ESCAPE_SITE:
+	case ESCAPE_MAYBE:
+		esc.site->opt_flags &= ~OPT_FLAG_STACK_ALLOCATE;
+		break;
+
+	case ESCAPE_TOP:
+		for (int i = 0; i < ctx->candidates_nr; i++) {
+			if (ctx->candidates[i].var == var) {
+				ctx->candidates[i].site->opt_flags &= ~OPT_FLAG_STACK_ALLOCATE;
+			}
+		}
+		break;
+	}
+}
+
+/*e
+ * Marks all sites whose objects escape through `node'
+ *
+ * @param harmless Whether `node' is in a position that cannot leak a local variable's value
+ */
+static void
+mark_escapes_recursively(symtab_entry_t *sym, escape_context_t *ctx, escape_t *locals, ast_node_t *node, bool harmless)
+{
+	if (!node) {
+		return;
+	}
+	if (IS_VALUE_NODE(node)) {
+		const int var = data_flow_is_local_var(sym, node);
+		if (var >= 0 && !harmless) {
+			escape(ctx, var, locals[var]);
+		}
+		return;
+	}
+
+	//e CFG split magic (cf. data-flow-out-of-bounds-elimination.c):  skip children that are CFG nodes themselves
+	int *cfg_subnodes_indices;
+	int cfg_subnodes_indices_nr = cfg_subnodes(node, &cfg_subnodes_indices);
+	if (cfg_subnodes_indices_nr < 0) {
+		return;
+	}
+	int cfg_subnodes_index_counter = 0;
+
+	for (int i = 0; i < node->children_nr; i++) {
+		if (cfg_subnodes_index_counter < cfg_subnodes_indices_nr
+		    && i == cfg_subnodes_indices[cfg_subnodes_index_counter]) {
+			++cfg_subnodes_index_counter;
+			continue;
+		}
+
+		ast_node_t *child = node->children[i];
+		bool child_harmless = false;
+		switch (NODE_TY(node)) {
+		case AST_NODE_VARDECL:
+		case AST_NODE_ASSIGN:
+			if (i == 0) {
+				if (NODE_TY(child) == AST_NODE_MEMBER) {
+					//e field write: only the receiver is a use
+					mark_escapes_recursively(sym, ctx, locals, child->children[0], true);
+					continue;
+				}
+				//e variable being defined
+				child_harmless = true;
+			}
+			break;
+
+		case AST_NODE_MEMBER:
+		case AST_NODE_ISINSTANCE:
+			child_harmless = (i == 0);
+			break;
+
+		case AST_NODE_FUNAPP: {
+			symtab_entry_t *callee = AST_CALLABLE_SYMREF(node);
+			//e built-in operators never retain their arguments, except that conversions may return them
+			child_harmless = callee && callee->id < 0 && (callee->symtab_flags & SYMTAB_HIDDEN)
+				&& callee->id != BUILTIN_OP_CONVERT;
+		}
+			break;
+
+		case AST_NODE_ACTUALS:
+			child_harmless = harmless;
+			break;
+		}
+		mark_escapes_recursively(sym, ctx, locals, child, child_harmless);
+	}
+}
+
+static void
+mark_escapes_init(symtab_entry_t *sym, void **data)
+{
+	escape_context_t *ctx = calloc(1, sizeof(escape_context_t));
+	find_candidates(sym, ctx, sym->astref);
+	*data = ctx;
+}
+
+static void
+mark_escapes(symtab_entry_t *sym, void *pfact, void **data, ast_node_t *node)
+{
+	mark_escapes_recursively(sym, (escape_context_t *) *data, (escape_t *) pfact, node, false);
+}
+
+static void
+mark_escapes_free(symtab_entry_t *sym, void **data)
+{
+	escape_context_t *ctx = (escape_context_t *) *data;
+	free(ctx->candidates);
+	free(ctx);
+}
+
+static data_flow_postprocessor_t postprocessor = {
+	.init = mark_escapes_init,
+	.visit_node = mark_escapes,
+	.free = mark_escapes_free
+};
+
+data_flow_analysis_t data_flow_analysis__escape = {
+	.forward = true,
+	.name = "escape",
+	.init = init,
+	.print = print,
+	.join = join,
+	.transfer = transfer,
+	.is_less_than_or_equal = is_less_than_or_equal,
+	.free = df_free,
+	.copy = df_copy,
+	.postprocessor = &postprocessor
+};
@@ -31,6 +31,8 @@
 #include "ast.h"
 #include "data-flow.h"
 #include "class.h"
+#include "compiler-options.h"
+#include "dynamic-compiler.h"
 
 //#define DEBUG_PRECISE_CALLS
 
@@ -267,6 +269,36 @@ df_free(void *fact)
 // --------------------------------------------------------------------------------
 // Mark for optimisation
 
+/*e
+ * Binds a call to the version of `callee' that fits the classes of the arguments, if we know them
+ */
+static void
+bind_version(symtab_entry_t *sym, symtab_entry_t **locals, ast_node_t *node, symtab_entry_t *callee, ast_node_t *actuals)
+{
+	if (!callee->r_versions || callee->parameters_nr != actuals->children_nr) {
+		return;
+	}
+	symtab_entry_t *argument_classes[callee->parameters_nr + 1];
+	for (int i = 0; i < callee->parameters_nr; i++) {
+		symtab_entry_t *classification = expression(sym, locals, actuals->children[i]);
+		if (classification == TOP || classification == BOTTOM) {
+			classification = NULL;
+		}
+		argument_classes[i] = classification;
+	}
+	void *entry = dyncomp_version_lookup(callee, argument_classes);
+	if (entry) {
+		dyncomp_version_bind(sym, node, entry);
+		if (compiler_options.debug_adaptive) {
+			fprintf(stderr, "calling a specialised version of `");
+			symtab_entry_name_dump(stderr, callee);
+			fprintf(stderr, "' directly from `");
+			symtab_entry_name_dump(stderr, sym);
+			fprintf(stderr, "'\n");
+		}
+	}
+}
+
 /*e
  * Record out-of-bounds access information
  */
@@ -300,35 +332,69 @@ mark_types_recursively(symtab_entry_t *sym, symtab_entry_t **locals, ast_node_t
 	}
 
 	switch (NODE_TY(node)) {
+	case AST_NODE_FUNAPP: {
+		symtab_entry_t *callee = node->children[0]->sym;
+		if (callee && SYMTAB_KIND(callee) == SYMTAB_KIND_FUNCTION && callee->r_trampoline) {
+			bind_version(sym, locals, node, callee, node->children[1]);
+		}
+		break;
+	}
+
 	case AST_NODE_METHODAPP: {
+		ast_node_t *selector_node = node->children[1];
 		symtab_entry_t *receiver = expression(sym, locals, node->children[0]);
+		node->opt_flags &= ~OPT_FLAG_GUARDED_CALL;
+		bool guarded = false;
+		if (!receiver || receiver == TOP || receiver == BOTTOM) {
+			//e no static information; perhaps the call site has only seen one receiver class so far?
+			class_t *observed = dyncomp_type_feedback_class(sym, node, NULL);
+			if (observed) {
+				receiver = observed->id;
+				guarded = true;
+			}
+		}
+		symtab_entry_t *callee = NULL;
 		if (receiver && receiver != TOP && receiver != BOTTOM) {
 			//e found `real class'
 
 			//e NB: running this ahead of time will not work too well, as methods won't generally have
 			//e been compiled yet at that time.
-			symtab_entry_t *sym = class_lookup_member(receiver, node->children[1]->sym->selector);
-			if (sym && SYMTAB_KIND_FUNCTION == SYMTAB_KIND(sym)) {
+			callee = class_lookup_member(receiver, selector_node->sym->selector);
+			if (callee && SYMTAB_KIND_FUNCTION != SYMTAB_KIND(callee)) {
+				callee = NULL;
+			}
+		}
+		if (!callee) {
 #ifdef DEBUG_PRECISE_CALLS
-				fprintf(stderr, "#opt replacing dynamic call by direct call to ");
-				symtab_entry_name_dump(stderr, receiver);
-				fprintf(stderr, ".");
-				symtab_entry_name_dump(stderr, sym);
-				fprintf(stderr, " at %p\n", sym->r_mem);
+			fprintf(stderr, "#opt FAILED to replace dynamic call to ");
+			symtab_entry_name_dump(stderr, selector_node->sym);
+			fprintf(stderr, "[%d]\n", selector_node->sym->selector);
 #endif
-				node->children[1]->sym = sym;
+			//e forget any call target that we resolved while optimising this function earlier
+			if (!(selector_node->sym->symtab_flags & SYMTAB_SELECTOR)) {
+				selector_node->sym = symtab_selector(selector_node->sym->name);
 			}
+			break;
+		}
 #ifdef DEBUG_PRECISE_CALLS
-			else {
-				fprintf(stderr, "#opt FAILED to replace dynamic call to ");
-				symtab_entry_name_dump(stderr, receiver);
-				fprintf(stderr, ".");
-				symtab_entry_name_dump(stderr, node->children[1]->sym);
-				fprintf(stderr, "[%d]", node->children[1]->sym->selector);
-				fprintf(stderr, "because %p %x\n", sym, sym?sym->symtab_flags:0);
-			}
+		fprintf(stderr, "#opt replacing dynamic call by direct call to ");
+		symtab_entry_name_dump(stderr, receiver);
+		fprintf(stderr, ".");
+		symtab_entry_name_dump(stderr, callee);
+		fprintf(stderr, " at %p\n", callee->r_mem);
 #endif
+		if (guarded) {
+			node->opt_flags |= OPT_FLAG_GUARDED_CALL;
+			if (compiler_options.debug_adaptive) {
+				fprintf(stderr, "type feedback: calling `");
+				symtab_entry_name_dump(stderr, callee);
+				fprintf(stderr, "' directly from `");
+				symtab_entry_name_dump(stderr, sym);
+				fprintf(stderr, "'\n");
+			}
 		}
+		selector_node->sym = callee;
+		bind_version(sym, locals, node, callee, node->children[2]);
 	}
 	}
 }
@@ -341,8 +407,15 @@ mark_types(symtab_entry_t *sym, void *pfact, void **context, ast_node_t *node)
 	mark_types_recursively(sym, classifications, node);
 }
 
+static void
+mark_types_init(symtab_entry_t *sym, void **context)
+{
+	//e the call sites that we bind to versions may have changed since we last optimised `sym'
+	dyncomp_version_bindings_clear(sym);
+}
+
 static data_flow_postprocessor_t postprocessor = {
-	.init = NULL,
+	.init = mark_types_init,
 	.visit_node = mark_types,
 	.free = NULL
 };
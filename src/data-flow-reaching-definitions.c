@@ -186,3 +186,16 @@ data_flow_analysis_t data_flow_analysis__reaching_definitions = {
 	.copy = df_copy,
 	.postprocessor = NULL
 };
+
+bool
+data_flow_reaching_definition(symtab_entry_t *sym, ast_node_t *node, int var, ast_node_t **definition)
+{
+	assert(node->cfg);
+	assert(var >= 0 && var < data_flow_number_of_locals(sym));
+	ast_node_t **vars = (ast_node_t **) node->cfg->analysis[data_flow_analysis__reaching_definitions.unique_global_index].inb;
+	if (!vars || vars[var] == TOP) {
+		return false;
+	}
+	*definition = vars[var];
+	return true;
+}
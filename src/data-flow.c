@@ -40,15 +40,19 @@ extern data_flow_analysis_t data_flow_analysis__reaching_definitions;
 extern data_flow_analysis_t data_flow_analysis__definite_assignments;
 extern data_flow_analysis_t data_flow_analysis__out_of_bounds;
 extern data_flow_analysis_t data_flow_analysis__precise_types;
+extern data_flow_analysis_t data_flow_analysis__escape;
+extern data_flow_analysis_t data_flow_analysis__constant_propagation;
 
 data_flow_analysis_t *data_flow_analyses_correctness[] = {
 	&data_flow_analysis__definite_assignments,
 	NULL /*e terminator: must be final entry! */
 };
 data_flow_analysis_t *data_flow_analyses_optimisation[] = {
+	&data_flow_analysis__constant_propagation,
 	&data_flow_analysis__reaching_definitions,
 	&data_flow_analysis__out_of_bounds,
 	&data_flow_analysis__precise_types,
+	&data_flow_analysis__escape,
 	NULL /*e terminator: must be final entry! */
 };
 
@@ -232,4 +232,17 @@ data_flow_is_local_var(symtab_entry_t *sym, ast_node_t *ast);
 void
 data_flow_get_all_locals(symtab_entry_t *sym, symtab_entry_t **locals);
 
+/*e
+ * Looks up the definition of a local variable that reaches a CFG node, as computed by the
+ * most recent run of the `reaching-definitions' analysis
+ *
+ * @param sym The function/constructor/method containing `node'
+ * @param node The AST node to examine (must have node->cfg)
+ * @param var Local variable index, as returned by data_flow_is_local_var()
+ * @param definition Set to the assigned expression, or to NULL if no assignment reaches `node'
+ * @return false if several definitions reach `node', or if no analysis results are available
+ */
+bool
+data_flow_reaching_definition(symtab_entry_t *sym, ast_node_t *node, int var, ast_node_t **definition);
+
 #endif // !defined(_ATTOL_DATA_FLOW_H)
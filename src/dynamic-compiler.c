@@ -26,12 +26,17 @@
 ***************************************************************************/
 
 #include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
 
 #include "address-store.h"
 #include "assembler.h"
 #include "baseline-backend.h"
 #include "class.h"
 #include "compiler-options.h"
+#include "cstack.h"
 #include "dynamic-compiler.h"
 #include "analysis.h"
 #include "errors.h"
@@ -43,6 +48,30 @@
 //#define DEBUG_DYNAMIC_COLLECTION
 //#define DEBUG_DYNAMIC_OPTIMISATION
 
+/*e
+ * Protects the compiler's state (ASTs, symbol table entries, hotness records, and the background
+ * compiler's queues).  The background compiler holds it whenever it is not waiting for work, except
+ * that it lets first-call compilations go first (cf. dyncomp_background_yield()).  The mutator takes
+ * it through dyncomp_lock_acquire() or dyncomp_lock_try(), or, for first-call compilations, through
+ * dyncomp_lock_first_call().
+ */
+static pthread_mutex_t dyncomp_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+dyncomp_lock_acquire(void);
+
+static bool
+dyncomp_lock_try(void);
+
+static void
+dyncomp_lock_first_call(void);
+
+static void
+dyncomp_background_yield(void);
+
+static void
+dyncomp_background_install(void);
+
 buffer_t
 dyncomp_build_generic()
 {
@@ -106,9 +135,96 @@ dyncomp_build_trampoline(void *dyncomp_entry, ast_node_t **functions, int functi
 	return buf;
 }
 
+void
+dyncomp_add_call_site(symtab_entry_t *sym, label_t *label)
+{
+	if (!sym->r_call_sites) {
+		sym->r_call_sites = stack_alloc(sizeof(label_t), 4);
+	}
+	stack_push(sym->r_call_sites, label);
+}
+
+/*e
+ * Re-targets all recorded direct call sites to sym->r_mem
+ */
 static void
-dyncomp_compile_and_update(symtab_entry_t *sym)
+dyncomp_patch_call_sites(symtab_entry_t *sym)
+{
+	if (!sym->r_call_sites) {
+		return;
+	}
+	const size_t call_sites_nr = stack_size(sym->r_call_sites);
+	for (size_t i = 0; i < call_sites_nr; i++) {
+		buffer_setlabel((label_t *) stack_get(sym->r_call_sites, i), sym->r_mem);
+	}
+}
+
+typedef struct {
+	unsigned char *start;
+	unsigned char *end;
+	bool running; /*e might the code still be running further up the stack? */
+} dyncomp_dead_code_t;
+
+//e forgets the call sites into `callee' that lie within the dyncomp_dead_code_t `dead_code_ptr'
+static void
+dyncomp_call_sites_drop_from(symtab_entry_t *callee, void *dead_code_ptr)
+{
+	dyncomp_dead_code_t *dead_code = (dyncomp_dead_code_t *) dead_code_ptr;
+	if (!callee->r_call_sites) {
+		return;
+	}
+	size_t i = 0;
+	while (i < stack_size(callee->r_call_sites)) {
+		label_t *site = (label_t *) stack_get(callee->r_call_sites, i);
+		unsigned char *position = (unsigned char *) site->label_position;
+		if (position < dead_code->start || position >= dead_code->end) {
+			i++;
+			continue;
+		}
+		if (dead_code->running) {
+			//e the trampoline always leads to the current code of `callee'
+			buffer_setlabel(site, callee->r_trampoline);
+		}
+		*site = *((label_t *) stack_get(callee->r_call_sites, stack_size(callee->r_call_sites) - 1));
+		stack_pop(callee->r_call_sites);
+	}
+}
+
+/*e
+ * Forgets all direct call sites in `code', which receives no new calls
+ *
+ * @param running true if `code' may still be running further up the stack; its calls then go through
+ *        the callees' trampolines from now on.  false if we are about to free `code'.
+ */
+static void
+dyncomp_call_sites_drop(buffer_t code, bool running)
+{
+	dyncomp_dead_code_t dead_code = {
+		.start = (unsigned char *) buffer_entrypoint(code),
+		.end = ((unsigned char *) buffer_entrypoint(code)) + buffer_size(code),
+		.running = running
+	};
+	runtime_foreach_callable(runtime_current(), dyncomp_call_sites_drop_from, &dead_code);
+}
+
+//e forgets the entry points into the code we are replacing; optimised code sets up new ones
+static void
+dyncomp_osr_entries_clear(symtab_entry_t *sym)
 {
+	if (sym->r_osr_loops) {
+		const size_t loops_nr = stack_size(sym->r_osr_loops);
+		for (size_t i = 0; i < loops_nr; i++) {
+			(*((dyncomp_loop_t **) stack_get(sym->r_osr_loops, i)))->osr_code = NULL;
+		}
+	}
+}
+
+//e compiles `sym' into a fresh buffer, without making it visible to running code yet
+static buffer_t
+dyncomp_compile(symtab_entry_t *sym)
+{
+	dyncomp_osr_entries_clear(sym);
+
 	if (sym->symtab_flags & SYMTAB_CONSTRUCTOR) {
 		//d Klassenobjekt bei Konstruktoruebersetzung bauen
 		//e Build class object when compiling constructor
@@ -146,11 +262,17 @@ dyncomp_compile_and_update(symtab_entry_t *sym)
 		body_buf = baseline_compile_static_callable(sym);
 	}
 
-	sym->r_mem = buffer_entrypoint(body_buf);
 	if (compiler_options.debug_dynamic_compilation) {
 		buffer_disassemble(body_buf);
 	}
+	return body_buf;
+}
 
+//e points the trampoline, direct call sites and vtable entry of `sym' to `entry'
+static void
+dyncomp_install_entry(symtab_entry_t *sym, void *entry)
+{
+	sym->r_mem = entry;
 	sym->symtab_flags |= SYMTAB_COMPILED;
 
 	//d Trampolin ueberschreiben
@@ -161,6 +283,9 @@ dyncomp_compile_and_update(symtab_entry_t *sym)
 	emit_j(&buf, &label);
 	buffer_setlabel(&label, sym->r_mem);
 
+	//e callers that have already been emitted jump to us directly
+	dyncomp_patch_call_sites(sym);
+
 	if (sym->parent && !(sym->symtab_flags & SYMTAB_CONSTRUCTOR)) {
 		//d Methode?
 		//e method?  If so, update symbol table
@@ -170,6 +295,22 @@ dyncomp_compile_and_update(symtab_entry_t *sym)
 	}
 }
 
+//e points the trampoline, direct call sites and vtable entry of `sym' to the code in `body_buf'
+static void
+dyncomp_install(symtab_entry_t *sym, buffer_t body_buf)
+{
+	if (!(sym->symtab_flags & SYMTAB_OPT)) {
+		sym->r_mem_unoptimised = buffer_entrypoint(body_buf);
+	}
+	dyncomp_install_entry(sym, buffer_entrypoint(body_buf));
+}
+
+static void
+dyncomp_compile_and_update(symtab_entry_t *sym)
+{
+	dyncomp_install(sym, dyncomp_compile(sym));
+}
+
 void
 dyncomp_compile_function(int symtab_entry, void **update_address_on_call_stack)
 {
@@ -180,11 +321,13 @@ dyncomp_compile_function(int symtab_entry, void **update_address_on_call_stack)
 		fail("dynamic function compilation");
 	}
 
+	dyncomp_lock_first_call();
+	dyncomp_background_install();
 	dyncomp_compile_and_update(sym);
-
 	if (update_address_on_call_stack) {
 		*update_address_on_call_stack = sym->r_mem;
 	}
+	pthread_mutex_unlock(&dyncomp_lock);
 }
 
 static void
@@ -201,83 +344,504 @@ dyncomp_print_current_dynamic_parameter_types(symtab_entry_t *sym)
 	fprintf(stderr, ")\n");
 }
 
+//e runs optimisations on `sym' and marks it for optimised code generation
 static void
-dyncomp_opt_compile(symtab_entry_t *sym)
+dyncomp_opt_prepare(symtab_entry_t *sym)
 {
+	if (sym->r_dispatcher && sym->r_versions && stack_size(sym->r_versions) >= DYNCOMP_VERSIONS_MAX) {
+		//e no room for more specialised versions: build one without type guards for all other calls
+		for (int i = 0; i < sym->parameters_nr; i++) {
+			if (sym->dynamic_parameter_types[i]) {
+				sym->dynamic_parameter_types[i] = &class_top;
+			}
+		}
+	}
 	if (compiler_options.debug_dynamic_compilation || compiler_options.debug_adaptive) {
 		fprintf(stderr, "opt-compiling `");
 		symtab_entry_name_dump(stderr, sym);
 		fprintf(stderr, "' for ");
 		dyncomp_print_current_dynamic_parameter_types(sym);
 	}
-	//e run optimisations
-	data_flow_analyses(sym, data_flow_analyses_optimisation);
+	//e run optimisations, one at a time, so that the background compiler can give way in between
+	for (struct data_flow_analysis **analysis = data_flow_analyses_optimisation; *analysis; analysis++) {
+		struct data_flow_analysis *analyses[] = { *analysis, NULL };
+		data_flow_analyses(sym, analyses);
+		dyncomp_background_yield();
+	}
 
 	sym->symtab_flags |= SYMTAB_OPT;
-	
-	dyncomp_compile_and_update(sym);
+}
+
+// --------------------------------------------------------------------------------
+//e specialised versions (cf. dyncomp_version_t)
+
+static void
+dyncomp_version_free(void *version_ptr)
+{
+	dyncomp_version_t *version = (dyncomp_version_t *) version_ptr;
+	if (version->parameter_types) {
+		free(version->parameter_types);
+	}
+}
+
+//e can the type dispatcher see all parameters of `sym'?
+static bool
+dyncomp_versions_eligible(symtab_entry_t *sym)
+{
+	return sym->parameters_nr + (SYMTAB_HAS_SELF(sym) ? 1 : 0) <= REGISTERS_ARGUMENT_NR;
+}
+
+//e (re-)builds the type dispatcher over sym->r_versions and makes it the entry point of `sym'
+static void
+dyncomp_dispatcher_install(symtab_entry_t *sym)
+{
+	void *old_dispatcher = sym->r_dispatcher;
+	sym->r_dispatcher = buffer_entrypoint(baseline_compile_type_dispatcher(sym, sym->r_mem_unoptimised));
+	dyncomp_install_entry(sym, sym->r_dispatcher);
+	if (old_dispatcher) {
+		//e dispatchers make no calls, so no running code can still be in the old one
+		buffer_free(buffer_from_entrypoint(old_dispatcher));
+	}
+}
+
+//e optimises and compiles a new version of `sym', without making it visible to running code yet
+static buffer_t
+dyncomp_opt_compile_version(symtab_entry_t *sym, class_t ***parameter_types)
+{
+	dyncomp_opt_prepare(sym);
+	*parameter_types = NULL;
+	if (sym->parameters_nr) {
+		*parameter_types = calloc(sym->parameters_nr, sizeof(class_t *));
+		if (sym->dynamic_parameter_types) {
+			memcpy(*parameter_types, sym->dynamic_parameter_types, sym->parameters_nr * sizeof(class_t *));
+		}
+	}
+	buffer_t body_buf = dyncomp_compile(sym);
+	if (sym->r_osr_loops) {
+		const size_t loops_nr = stack_size(sym->r_osr_loops);
+		for (size_t i = 0; i < loops_nr; i++) {
+			dyncomp_loop_t *record = *((dyncomp_loop_t **) stack_get(sym->r_osr_loops, i));
+			if (record->osr_code) {
+				record->osr_parameter_types = *parameter_types;
+			}
+		}
+	}
+	return body_buf;
+}
+
+//e makes a version from dyncomp_opt_compile_version() visible to running code
+static void
+dyncomp_version_install(symtab_entry_t *sym, buffer_t body_buf, class_t **parameter_types)
+{
+	if (!sym->r_versions) {
+		sym->r_versions = stack_alloc(sizeof(dyncomp_version_t), DYNCOMP_VERSIONS_MAX + 1);
+	}
+	dyncomp_version_t version = {
+		.parameter_types = parameter_types,
+		.entry = buffer_entrypoint(body_buf)
+	};
+	stack_push(sym->r_versions, &version);
+
+	if (!sym->r_dispatcher) {
+		//e no type guard has failed yet, so this version can handle all calls by itself
+		dyncomp_install(sym, body_buf);
+		return;
+	}
+
+	dyncomp_dispatcher_install(sym);
+	if (compiler_options.debug_dynamic_compilation || compiler_options.debug_adaptive) {
+		fprintf(stderr, "type dispatcher for `");
+		symtab_entry_name_dump(stderr, sym);
+		fprintf(stderr, "' selects from %zu versions\n", stack_size(sym->r_versions));
+	}
+	if (stack_size(sym->r_versions) <= DYNCOMP_VERSIONS_MAX) {
+		//e the unoptimised code still handles all other calls: sample those for the next version
+		sym->symtab_flags &= ~SYMTAB_OPT;
+		dyncomp_init_unoptimised(sym);
+	}
+}
+
+static void
+dyncomp_opt_compile(symtab_entry_t *sym)
+{
+	class_t **parameter_types;
+	buffer_t body_buf = dyncomp_opt_compile_version(sym, &parameter_types);
+	dyncomp_version_install(sym, body_buf, parameter_types);
+}
+
+void *
+dyncomp_version_lookup(symtab_entry_t *callee, symtab_entry_t **argument_classes)
+{
+	if (!callee->r_versions) {
+		return NULL;
+	}
+	const size_t versions_nr = stack_size(callee->r_versions);
+	for (size_t v = 0; v < versions_nr; v++) {
+		dyncomp_version_t *version = (dyncomp_version_t *) stack_get(callee->r_versions, v);
+		bool possible = true;
+		bool certain = true;
+		for (int i = 0; i < callee->parameters_nr; i++) {
+			class_t *type = version->parameter_types[i];
+			if (!type || type == &class_top || type == &class_bottom) {
+				continue;
+			}
+			if (!argument_classes[i]) {
+				certain = false;
+			} else if (argument_classes[i] != type->id) {
+				possible = false;
+			}
+		}
+		if (possible) {
+			//e the dispatcher tries the versions in order
+			return certain ? version->entry : NULL;
+		}
+	}
+	return NULL;
+}
+
+void
+dyncomp_version_bind(symtab_entry_t *sym, ast_node_t *node, void *entry)
+{
+	if (!sym->r_version_bindings) {
+		sym->r_version_bindings = stack_alloc(sizeof(dyncomp_version_binding_t), 4);
+	}
+	dyncomp_version_binding_t binding = {
+		.node = node,
+		.entry = entry
+	};
+	stack_push(sym->r_version_bindings, &binding);
 }
 
 void *
-dyncomp_deoptimise(symtab_entry_t *sym)
+dyncomp_version_binding(symtab_entry_t *sym, ast_node_t *node)
 {
+	if (!sym->r_version_bindings) {
+		return NULL;
+	}
+	const size_t bindings_nr = stack_size(sym->r_version_bindings);
+	for (size_t i = 0; i < bindings_nr; i++) {
+		dyncomp_version_binding_t *binding = (dyncomp_version_binding_t *) stack_get(sym->r_version_bindings, i);
+		if (binding->node == node) {
+			return binding->entry;
+		}
+	}
+	return NULL;
+}
+
+void
+dyncomp_version_bindings_clear(symtab_entry_t *sym)
+{
+	if (sym->r_version_bindings) {
+		stack_clear(sym->r_version_bindings, NULL);
+	}
+}
+
+void
+dyncomp_versions_free(symtab_entry_t *sym)
+{
+	if (sym->r_versions) {
+		stack_free(sym->r_versions, dyncomp_version_free);
+		sym->r_versions = NULL;
+	}
+	if (sym->r_version_bindings) {
+		stack_free(sym->r_version_bindings, NULL);
+		sym->r_version_bindings = NULL;
+	}
+	sym->r_dispatcher = NULL;
+}
+
+/*e
+ * Background compilation (compiler_options.background_compilation)
+ *
+ * The background compiler optimises and compiles functions from the `pending' queue into fresh
+ * buffers.  Only the mutator ever patches code: it installs the buffers from the `finished' queue
+ * whenever it enters the dynamic compiler.  Both queues are protected by dyncomp_lock.
+ *
+ * First calls cannot continue until their function is compiled, so the background compiler releases
+ * dyncomp_lock to them between the steps of a job (cf. dyncomp_background_yield()).  The job's own
+ * state stays untouched meanwhile: all other mutator entries wait for the job to finish, or (with
+ * dyncomp_lock_try()) back off.
+ */
+typedef struct {
+	symtab_entry_t *sym;
+	buffer_t body_buf;
+	class_t **parameter_types;	/*e cf. dyncomp_opt_compile_version() */
+} dyncomp_job_t;
+
+static struct {
+	bool running;
+	bool stop;
+	bool busy;		/*e working on a job; dyncomp_lock may be released to first calls meanwhile */
+	atomic_int first_calls_waiting;	/*e mutator threads in dyncomp_lock_first_call() */
+	pthread_t thread;
+	pthread_cond_t wakeup;
+	pthread_cond_t resume;	/*e signalled when first_calls_waiting drops to zero */
+	pthread_cond_t done;	/*e signalled when `busy' becomes false */
+	cstack_t *pending;	/*e symtab_entry_t * */
+	cstack_t *finished;	/*e dyncomp_job_t */
+} background = {
+	.running = false,
+	.stop = false,
+	.busy = false,
+	.first_calls_waiting = 0,
+	.wakeup = PTHREAD_COND_INITIALIZER,
+	.resume = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER
+};
+
+//e takes dyncomp_lock once the background compiler is not in the middle of a job
+static void
+dyncomp_lock_acquire(void)
+{
+	pthread_mutex_lock(&dyncomp_lock);
+	while (background.busy) {
+		pthread_cond_wait(&background.done, &dyncomp_lock);
+	}
+}
+
+//e like dyncomp_lock_acquire(), but fails instead of waiting
+static bool
+dyncomp_lock_try(void)
+{
+	if (pthread_mutex_trylock(&dyncomp_lock)) {
+		return false;
+	}
+	if (background.busy) {
+		pthread_mutex_unlock(&dyncomp_lock);
+		return false;
+	}
+	return true;
+}
+
+//e takes dyncomp_lock for compiling a function on its first call; may interrupt a background job
+static void
+dyncomp_lock_first_call(void)
+{
+	atomic_fetch_add(&background.first_calls_waiting, 1);
+	pthread_mutex_lock(&dyncomp_lock);
+	if (atomic_fetch_sub(&background.first_calls_waiting, 1) == 1) {
+		pthread_cond_signal(&background.resume);
+	}
+}
+
+//e background compiler: lets waiting first calls take dyncomp_lock before we continue with our job
+static void
+dyncomp_background_yield(void)
+{
+	while (atomic_load(&background.first_calls_waiting)) {
+		pthread_cond_wait(&background.resume, &dyncomp_lock);
+	}
+}
+
+static void *
+dyncomp_background_run(void *_)
+{
+	pthread_mutex_lock(&dyncomp_lock);
+	while (true) {
+		while (!background.stop && !stack_size(background.pending)) {
+			pthread_cond_wait(&background.wakeup, &dyncomp_lock);
+		}
+		if (background.stop) {
+			break;
+		}
+		symtab_entry_t *sym = *((symtab_entry_t **) stack_pop(background.pending));
+		dyncomp_job_t job = {
+			.sym = sym
+		};
+		background.busy = true;
+		job.body_buf = dyncomp_opt_compile_version(sym, &job.parameter_types);
+		stack_push(background.finished, &job);
+		background.busy = false;
+		pthread_cond_broadcast(&background.done);
+		dyncomp_background_yield();
+	}
+	pthread_mutex_unlock(&dyncomp_lock);
+	return NULL;
+}
+
+//e caller must hold dyncomp_lock
+static void
+dyncomp_background_enqueue(symtab_entry_t *sym)
+{
+	if (!background.running) {
+		background.pending = stack_alloc(sizeof(symtab_entry_t *), 8);
+		background.finished = stack_alloc(sizeof(dyncomp_job_t), 8);
+		if (pthread_create(&background.thread, NULL, dyncomp_background_run, NULL)) {
+			perror("pthread_create");
+			fail("starting background compiler");
+		}
+		background.running = true;
+	}
+
+	for (int i = 0; i < stack_size(background.pending); i++) {
+		if (*((symtab_entry_t **) stack_get(background.pending, i)) == sym) {
+			return;
+		}
+	}
+	if (compiler_options.debug_adaptive) {
+		fprintf(stderr, "background compilation queued: ");
+		symtab_entry_name_dump(stderr, sym);
+		fprintf(stderr, "\n");
+	}
+	stack_push(background.pending, &sym);
+	pthread_cond_signal(&background.wakeup);
+}
+
+//e caller must hold dyncomp_lock
+static void
+dyncomp_background_install(void)
+{
+	if (!background.running) {
+		return;
+	}
+	dyncomp_job_t *job;
+	while ((job = stack_pop(background.finished))) {
+		if (compiler_options.debug_adaptive) {
+			fprintf(stderr, "background compilation installed: ");
+			symtab_entry_name_dump(stderr, job->sym);
+			fprintf(stderr, "\n");
+		}
+		dyncomp_version_install(job->sym, job->body_buf, job->parameter_types);
+	}
+}
+
+void
+dyncomp_background_stop(void)
+{
+	if (!background.running) {
+		return;
+	}
+	dyncomp_lock_acquire();
+	background.stop = true;
+	pthread_cond_signal(&background.wakeup);
+	pthread_mutex_unlock(&dyncomp_lock);
+	pthread_join(background.thread, NULL);
+
+	dyncomp_job_t *job;
+	while ((job = stack_pop(background.finished))) {
+		dyncomp_call_sites_drop(job->body_buf, false);
+		buffer_free(job->body_buf);
+		if (job->parameter_types) {
+			free(job->parameter_types);
+		}
+	}
+	stack_free(background.pending, NULL);
+	stack_free(background.finished, NULL);
+	background.running = false;
+	background.stop = false;
+}
+
+void *
+dyncomp_deoptimise(symtab_entry_t *sym, int failed_parameter)
+{
+	dyncomp_lock_acquire();
+	dyncomp_background_install();
+	if (sym->deoptimisations_nr < USHRT_MAX) {
+		++sym->deoptimisations_nr;
+	}
+	if (sym->parameter_guard_failures && sym->parameter_guard_failures[failed_parameter] < UCHAR_MAX) {
+		++sym->parameter_guard_failures[failed_parameter];
+	}
 	if (compiler_options.debug_dynamic_compilation || compiler_options.debug_adaptive) {
 		fprintf(stderr, "de-optimising `");
 		symtab_entry_name_dump(stderr, sym);
-		fprintf(stderr, "'\n");
+		fprintf(stderr, "' (type guard on parameter #%d failed; deoptimisation #%d)\n",
+			failed_parameter, sym->deoptimisations_nr);
 	}
-	//e run optimisations
-	data_flow_analyses(sym, data_flow_analyses_optimisation);
 
 	sym->symtab_flags &= ~SYMTAB_OPT;
 
-	dyncomp_compile_and_update(sym);
-	return sym->r_mem;
+	if (sym->r_mem_unoptimised) {
+		//e our unoptimised code is still around (it may well be running further up the stack)
+		if (dyncomp_versions_eligible(sym)) {
+			//e keep our versions; the type dispatcher sends all calls that they can't handle to the unoptimised code
+			dyncomp_dispatcher_install(sym);
+		} else {
+			dyncomp_osr_entries_clear(sym);
+			if (sym->r_versions) {
+				const size_t versions_nr = stack_size(sym->r_versions);
+				for (size_t i = 0; i < versions_nr; i++) {
+					dyncomp_version_t *version = (dyncomp_version_t *) stack_get(sym->r_versions, i);
+					dyncomp_call_sites_drop(buffer_from_entrypoint(version->entry), true);
+				}
+				stack_clear(sym->r_versions, dyncomp_version_free);
+			}
+			dyncomp_install(sym, buffer_from_entrypoint(sym->r_mem_unoptimised));
+		}
+		dyncomp_init_unoptimised(sym);
+	} else {
+		void *superseded = sym->r_mem;
+		dyncomp_compile_and_update(sym);
+		if (superseded != sym->r_trampoline) {
+			dyncomp_call_sites_drop(buffer_from_entrypoint(superseded), true);
+		}
+	}
+	void *entry_point = sym->r_mem;
+	pthread_mutex_unlock(&dyncomp_lock);
+	return entry_point;
 }
 
 void
 dyncomp_init_unoptimised(symtab_entry_t *sym)
 {
 	sym->fast_hotness_counter = DYNCOMP_ADAPTIVE_SAMPLE_INTERVALS; /*e reset sample counter */
-	sym->slow_hotness_counter = DYNCOMP_ADAPTIVE_OPT_THRESHOLD;
+	//e back off exponentially from functions that keep getting deoptimised
+	const int backoff = sym->deoptimisations_nr < DYNCOMP_DEOPT_BACKOFF_MAX ? sym->deoptimisations_nr : DYNCOMP_DEOPT_BACKOFF_MAX;
+	sym->slow_hotness_counter = DYNCOMP_ADAPTIVE_OPT_THRESHOLD << backoff;
 	if (sym->parameters_nr) {
 		if (!sym->dynamic_parameter_types) {
 			sym->dynamic_parameter_types = calloc(sym->parameters_nr, sizeof(class_t *));
+			sym->parameter_guard_failures = calloc(sym->parameters_nr, sizeof(unsigned char));
 		}
 		for (int i = 0; i < sym->parameters_nr; i++) {
 			if (sym->parameter_types[i] == TYPE_OBJ) {
-				sym->dynamic_parameter_types[i] = &class_bottom;
+				if (sym->parameter_guard_failures[i] >= DYNCOMP_DEOPT_GENERALISE_THRESHOLD) {
+					//e parameter is polymorphic in practice: stop specialising on it
+					sym->dynamic_parameter_types[i] = &class_top;
+				} else {
+					sym->dynamic_parameter_types[i] = &class_bottom;
+				}
 			}
 		}
 	}
 }
 
+//e merges the class of `obj' into the dynamic type of parameter `i'
+static void
+dyncomp_sample_parameter(symtab_entry_t *sym, int i, object_t *obj)
+{
+	class_t *current_classref = sym->dynamic_parameter_types[i];
+	/*e skip NULL entries in dynamic parameter list (those are value parameters) */
+	if (!current_classref || !obj) {
+		return;
+	}
+	class_t *classref = OBJECT_CLASS(obj);
+
+	if (classref == current_classref || current_classref == &class_bottom) {
+		sym->dynamic_parameter_types[i] = classref;
+	} else {
+		sym->dynamic_parameter_types[i] = &class_top;
+	}
+}
+
 void
 dyncomp_runtime_sample(symtab_entry_t *sym, object_t** low_args, object_t** high_args)
 {
+	if (!dyncomp_lock_try()) {
+		//e the background compiler is busy; sample later
+		sym->fast_hotness_counter = DYNCOMP_ADAPTIVE_SAMPLE_INTERVALS;
+		return;
+	}
+	dyncomp_background_install();
 	for (int i = 0; i < sym->parameters_nr; i++) {
-		/*e skip NULL entries in dynamic parameter list (those are value parameters) */
-		if (sym->dynamic_parameter_types[i]) {
-			class_t *current_classref = sym->dynamic_parameter_types[i];
-			const int arg_index = i + (SYMTAB_HAS_SELF(sym) ? 1 : 0);
-			object_t *obj;
-			if (arg_index >= REGISTERS_ARGUMENT_NR) {
-				obj = high_args[REGISTERS_ARGUMENT_NR - i];
-			} else {
-				obj = low_args[i];
-			}
-
-			if (!obj) {
-				continue;
-			}
-			class_t *classref = obj->classref;
-
-			if (classref == current_classref || current_classref == &class_bottom) {
-				sym->dynamic_parameter_types[i] = classref;
-			} else {
-				sym->dynamic_parameter_types[i] = &class_top;
-			}
+		const int arg_index = i + (SYMTAB_HAS_SELF(sym) ? 1 : 0);
+		object_t *obj;
+		if (arg_index >= REGISTERS_ARGUMENT_NR) {
+			obj = high_args[REGISTERS_ARGUMENT_NR - i];
+		} else {
+			obj = low_args[i];
 		}
+		dyncomp_sample_parameter(sym, i, obj);
 	}
 #ifdef DEBUG_DYNAMIC_COLLECTION
 	fprintf(stderr, "#dynamic ");
@@ -288,9 +852,386 @@ dyncomp_runtime_sample(symtab_entry_t *sym, object_t** low_args, object_t** high
 #ifdef DEBUG_DYNAMIC_OPTIMISATION
 		fprintf(stderr, "#optimise: ");
 #endif
-		dyncomp_opt_compile(sym);
+		if (compiler_options.background_compilation) {
+			dyncomp_background_enqueue(sym);
+			//e keep coming back, so that we install the optimised code once it is ready
+			sym->fast_hotness_counter = DYNCOMP_ADAPTIVE_SAMPLE_INTERVALS;
+		} else {
+			dyncomp_opt_compile(sym);
+		}
 	} else {
 		/*e Let's sample some more! */
 		sym->fast_hotness_counter = DYNCOMP_ADAPTIVE_SAMPLE_INTERVALS; /*e reset sample counter */
 	}
+	pthread_mutex_unlock(&dyncomp_lock);
+}
+
+// --------------------------------------------------------------------------------
+//e on-stack replacement
+
+dyncomp_loop_t *
+dyncomp_loop_lookup(symtab_entry_t *sym, ast_node_t *loop)
+{
+	if (!sym->r_osr_loops) {
+		return NULL;
+	}
+	const size_t loops_nr = stack_size(sym->r_osr_loops);
+	for (size_t i = 0; i < loops_nr; i++) {
+		dyncomp_loop_t *record = *((dyncomp_loop_t **) stack_get(sym->r_osr_loops, i));
+		if (record->loop == loop) {
+			return record;
+		}
+	}
+	return NULL;
+}
+
+dyncomp_loop_t *
+dyncomp_loop_record(symtab_entry_t *sym, ast_node_t *loop)
+{
+	dyncomp_loop_t *record = dyncomp_loop_lookup(sym, loop);
+	if (record) {
+		return record;
+	}
+	if (!sym->r_osr_loops) {
+		sym->r_osr_loops = stack_alloc(sizeof(dyncomp_loop_t *), 4);
+	}
+	record = calloc(1, sizeof(dyncomp_loop_t));
+	record->hotness_counter = DYNCOMP_ADAPTIVE_OSR_THRESHOLD;
+	record->sym = sym;
+	record->loop = loop;
+	stack_push(sym->r_osr_loops, &record);
+	return record;
+}
+
+static void
+dyncomp_loop_record_free(void *record_ptr)
+{
+	dyncomp_loop_t *record = *((dyncomp_loop_t **) record_ptr);
+	if (record->extracted) {
+		buffer_free(buffer_from_entrypoint(record->osr_code));
+		ast_node_free(record->extracted->astref, 1);
+		record->extracted->astref = NULL;
+	}
+	free(record);
+}
+
+void
+dyncomp_loop_records_free(symtab_entry_t *sym)
+{
+	if (sym->r_osr_loops) {
+		stack_free(sym->r_osr_loops, dyncomp_loop_record_free);
+		sym->r_osr_loops = NULL;
+	}
+}
+
+inline_cache_t *
+dyncomp_type_feedback(symtab_entry_t *sym, ast_node_t *node)
+{
+	if (!sym->r_type_feedback) {
+		sym->r_type_feedback = stack_alloc(sizeof(dyncomp_type_feedback_t), 8);
+	}
+	const size_t sites_nr = stack_size(sym->r_type_feedback);
+	for (size_t i = 0; i < sites_nr; i++) {
+		dyncomp_type_feedback_t *site = (dyncomp_type_feedback_t *) stack_get(sym->r_type_feedback, i);
+		if (site->node == node) {
+			return site->cache;
+		}
+	}
+	dyncomp_type_feedback_t site = {
+		.node = node,
+		.cache = inline_cache_new()
+	};
+	stack_push(sym->r_type_feedback, &site);
+	return site.cache;
+}
+
+class_t *
+dyncomp_type_feedback_class(symtab_entry_t *sym, ast_node_t *node, inline_cache_entry_t *entry)
+{
+	if (!sym->r_type_feedback) {
+		return NULL;
+	}
+	const size_t sites_nr = stack_size(sym->r_type_feedback);
+	for (size_t i = 0; i < sites_nr; i++) {
+		dyncomp_type_feedback_t *site = (dyncomp_type_feedback_t *) stack_get(sym->r_type_feedback, i);
+		if (site->node == node) {
+			//e the first entry never changes once set, but running code may be adding more
+			inline_cache_entry_t first = site->cache->entries[0];
+			if (site->cache->entries_nr != 1 || !first.classref) {
+				return NULL;
+			}
+			if (entry) {
+				*entry = first;
+			}
+			return first.classref;
+		}
+	}
+	return NULL;
+}
+
+//e is `node' the conversion `p := *convert(p)' that method bodies start with for non-object parameters?
+static bool
+is_parameter_conversion(ast_node_t *node)
+{
+	ast_node_t *rhs = node->children[1];
+	return NODE_TY(rhs) == AST_NODE_FUNAPP
+		&& rhs->children[0]->sym->id == BUILTIN_OP_CONVERT
+		&& rhs->children[1]->children[0]->sym == node->children[0]->sym;
+}
+
+static bool
+assigns_parameter(ast_node_t *node)
+{
+	if (!node || IS_VALUE_NODE(node)) {
+		return false;
+	}
+	if (NODE_TY(node) == AST_NODE_ASSIGN
+	    && NODE_TY(node->children[0]) == AST_VALUE_ID
+	    && (node->children[0]->sym->symtab_flags & SYMTAB_PARAM)
+	    && !is_parameter_conversion(node)) {
+		return true;
+	}
+	for (int i = 0; i < node->children_nr; i++) {
+		if (assigns_parameter(node->children[i])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool
+dyncomp_osr_eligible(symtab_entry_t *sym)
+{
+	return !(sym->symtab_flags & SYMTAB_CONSTRUCTOR)
+		&& !assigns_parameter(sym->astref->children[2]);
+}
+
+bool
+dyncomp_osr_main_loop_eligible(ast_node_t *node)
+{
+	if (!node || IS_VALUE_NODE(node)) {
+		return true;
+	}
+	switch (NODE_TY(node)) {
+	case AST_NODE_METHODAPP:
+	case AST_NODE_NEWINSTANCE:
+	case AST_NODE_RETURN:
+		return false;
+
+	case AST_NODE_FUNAPP:
+		if (!(node->children[0]->sym->symtab_flags & SYMTAB_BUILTIN)) {
+			return false;
+		}
+		break;
+
+	default:
+		break;
+	}
+	for (int i = 0; i < node->children_nr; i++) {
+		if (!dyncomp_osr_main_loop_eligible(node->children[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//e does `record' have optimised code whose parameter type guards (cf. baseline_optimisation_hook()) hold for `args'?
+static bool
+dyncomp_osr_applicable(dyncomp_loop_t *record, object_t **args)
+{
+	if (!record->osr_code) {
+		return false;
+	}
+	symtab_entry_t *sym = record->sym;
+	ast_node_t **params = sym->astref->children[1]->children;
+	for (int i = 0; i < sym->parameters_nr; i++) {
+		class_t *type = record->osr_parameter_types[i];
+		object_t *obj = args[params[i]->sym->offset];
+		if (type && type != &class_top && type != &class_bottom
+		    && obj && OBJECT_CLASS(obj) != type) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void *
+dyncomp_osr(dyncomp_loop_t *record, object_t **args)
+{
+	symtab_entry_t *sym = record->sym;
+	ast_node_t **params = sym->astref->children[1]->children;
+	record->hotness_counter = DYNCOMP_ADAPTIVE_OSR_THRESHOLD;
+
+	if (!dyncomp_lock_try()) {
+		return NULL;
+	}
+	dyncomp_background_install();
+	if (!dyncomp_osr_applicable(record, args) && !(sym->symtab_flags & SYMTAB_OPT)) {
+		//e no version yet that fits our parameters
+		for (int i = 0; i < sym->parameters_nr; i++) {
+			dyncomp_sample_parameter(sym, i, args[params[i]->sym->offset]);
+		}
+		if (compiler_options.background_compilation) {
+			//e continue in unoptimised code; we will come back after the next DYNCOMP_ADAPTIVE_OSR_THRESHOLD iterations
+			dyncomp_background_enqueue(sym);
+			pthread_mutex_unlock(&dyncomp_lock);
+			return NULL;
+		}
+		dyncomp_opt_compile(sym);
+	}
+
+	if (!dyncomp_osr_applicable(record, args)) {
+		pthread_mutex_unlock(&dyncomp_lock);
+		return NULL;
+	}
+
+	if ((compiler_options.debug_dynamic_compilation || compiler_options.debug_adaptive)) {
+		fprintf(stderr, "on-stack replacement at loop in line %d of `", record->loop->source_line);
+		symtab_entry_name_dump(stderr, sym);
+		fprintf(stderr, "'\n");
+	}
+	void *entry_point = record->osr_code;
+	pthread_mutex_unlock(&dyncomp_lock);
+	return entry_point;
+}
+
+/*e
+ * Main entry point loops run as separate functions, in which local variables take the place of
+ * the global variables
+ */
+typedef struct {
+	symtab_entry_t *fun;
+	symtab_entry_t **locals;	/*e indexed by the global variable's offset in static memory */
+	bool *assigned;			/*e indexed like `locals' */
+	int locals_nr;
+} loop_extraction_t;
+
+static ast_node_t *
+extraction_id(symtab_entry_t *sym, int flags)
+{
+	ast_node_t *node = value_node_alloc_generic(AST_VALUE_ID, (ast_value_union_t) { .ident = sym->id });
+	node->type |= flags | SYMTAB_TYPE(sym);
+	node->sym = sym;
+	return node;
+}
+
+static ast_node_t *
+extraction_clone(loop_extraction_t *extraction, ast_node_t *node)
+{
+	if (!node) {
+		return NULL;
+	}
+	ast_node_t *clone;
+	if (IS_VALUE_NODE(node)) {
+		clone = value_node_alloc_generic(NODE_TY(node), ((ast_value_node_t *) node)->v);
+		if (NODE_TY(node) == AST_VALUE_STRING) {
+			AV_STRING(clone) = strdup(AV_STRING(clone));
+		}
+	} else {
+		clone = ast_node_alloc_generic_without_init(NODE_TY(node), node->children_nr);
+		for (int i = 0; i < node->children_nr; i++) {
+			clone->children[i] = extraction_clone(extraction, node->children[i]);
+		}
+	}
+	//e keep types and temps; the optimisation analyses recompute opt_flags
+	clone->type = node->type;
+	clone->storage = node->storage;
+	clone->source_line = node->source_line;
+	clone->sym = node->sym;
+
+	if (NODE_TY(node) == AST_VALUE_ID && SYMTAB_IS_STATIC(node->sym)) {
+		symtab_entry_t *global = node->sym;
+		if (!extraction->locals[global->offset]) {
+			symtab_entry_t *local = symtab_new(global->ast_flags, SYMTAB_KIND_VAR, global->name, global->astref);
+			local->parent = extraction->fun;
+			local->offset = extraction->locals_nr++;
+			extraction->locals[global->offset] = local;
+		}
+		clone->sym = extraction->locals[global->offset];
+		if (node->type & AST_FLAG_LVALUE) {
+			extraction->assigned[global->offset] = true;
+		}
+	}
+	return clone;
+}
+
+void *
+dyncomp_osr_main_loop(dyncomp_loop_t *record)
+{
+	//e re-enter right away the next time we reach this loop
+	record->hotness_counter = 0;
+	if (record->extracted) {
+		return record->osr_code;
+	}
+	if (!dyncomp_lock_try()) {
+		return NULL;
+	}
+	dyncomp_background_install();
+
+	runtime_image_t *image = runtime_current();
+	const int globals_nr = image->globals_nr;
+	symtab_entry_t *locals[globals_nr + 1];
+	bool assigned[globals_nr + 1];
+	memset(locals, 0, sizeof(locals));
+	memset(assigned, 0, sizeof(assigned));
+
+	symtab_entry_t *fun = symtab_new(0, SYMTAB_KIND_FUNCTION | SYMTAB_OPT, "<main loop>", NULL);
+	loop_extraction_t extraction = {
+		.fun = fun,
+		.locals = locals,
+		.assigned = assigned,
+		.locals_nr = 0
+	};
+	ast_node_t *loop = extraction_clone(&extraction, record->loop);
+
+	//e load globals into locals, run the loop, then write back all globals that the loop changes
+	ast_node_t *body = ast_node_alloc_generic_without_init(AST_NODE_BLOCK, 2 * extraction.locals_nr + 1);
+	int statements_nr = 0;
+	for (int i = 0; i < globals_nr; i++) {
+		if (locals[i]) {
+			ast_node_t *vardecl = ast_node_alloc_generic(AST_NODE_VARDECL, 2,
+								     extraction_id(locals[i], AST_FLAG_LVALUE | AST_FLAG_DECL),
+								     extraction_id(symtab_lookup(image->globals[i]), 0));
+			vardecl->type |= SYMTAB_TYPE(locals[i]);
+			body->children[statements_nr++] = vardecl;
+		}
+	}
+	body->children[statements_nr++] = loop;
+	for (int i = 0; i < globals_nr; i++) {
+		if (assigned[i]) {
+			body->children[statements_nr++] = ast_node_alloc_generic(AST_NODE_ASSIGN, 2,
+										 extraction_id(symtab_lookup(image->globals[i]), AST_FLAG_LVALUE),
+										 extraction_id(locals[i], 0));
+		}
+	}
+	body->children_nr = statements_nr;
+
+	ast_node_t *fundef = ast_node_alloc_generic(AST_NODE_FUNDEF, 3,
+						    extraction_id(fun, AST_FLAG_DECL),
+						    ast_node_alloc_generic(AST_NODE_FORMALS, 0),
+						    body);
+	fun->astref = fundef;
+	fun->storage.vars_nr = extraction.locals_nr;
+	fun->storage.temps_nr = symtab_lookup(image->main_entry_sym)->storage.temps_nr;
+
+	if (compiler_options.debug_dynamic_compilation || compiler_options.debug_adaptive) {
+		fprintf(stderr, "on-stack replacement: running loop in line %d of `<main>' as optimised function\n",
+			record->loop->source_line);
+	}
+
+	//e the control-flow graph of the enclosing program is of no interest
+	cfg_node_free(cfg_build(fundef));
+	data_flow_analyses(fun, data_flow_analyses_optimisation);
+	buffer_t buf = baseline_compile_static_callable(fun);
+	if (compiler_options.debug_dynamic_compilation) {
+		AST_DUMP(fundef);
+		buffer_disassemble(buf);
+	}
+
+	fun->symtab_flags |= SYMTAB_COMPILED;
+	fun->r_mem = buffer_entrypoint(buf);
+	record->extracted = fun;
+	record->osr_code = fun->r_mem;
+	pthread_mutex_unlock(&dyncomp_lock);
+	return record->osr_code;
 }
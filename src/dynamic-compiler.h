@@ -28,12 +28,65 @@
 #ifndef _ATTOL_DYNAMIC_COMPILER_H
 #define _ATTOL_DYNAMIC_COMPILER_H
 
+#include <stdbool.h>
+
 #include "ast.h"
 #include "assembler-buffer.h"
+#include "inline-cache.h"
 #include "symbol-table.h"
 
 #define DYNCOMP_ADAPTIVE_SAMPLE_INTERVALS	5	/*e number of method calls until we sample parameter types */
 #define DYNCOMP_ADAPTIVE_OPT_THRESHOLD		5	/*e number samples until we invoke adaptive compiler */
+#define DYNCOMP_ADAPTIVE_OSR_THRESHOLD		200	/*e number of loop iterations in unoptimised code until we attempt on-stack replacement */
+#define DYNCOMP_DEOPT_BACKOFF_MAX		6	/*e each deoptimisation doubles DYNCOMP_ADAPTIVE_OPT_THRESHOLD, up to this many times */
+#define DYNCOMP_DEOPT_GENERALISE_THRESHOLD	2	/*e type guard failures after which we stop specialising a parameter */
+#define DYNCOMP_VERSIONS_MAX			4	/*e number of specialised optimised versions per function, before we fall back to one without type guards */
+
+/*e
+ * Hotness record for one WHILE loop in unoptimised code (cf. dyncomp_osr())
+ *
+ * Unoptimised code decrements `hotness_counter' whenever it reaches the loop header and asks
+ * the dynamic compiler to replace the running code once the counter drops below zero.
+ */
+typedef struct {
+	long hotness_counter;
+	symtab_entry_t *sym;		/*e function/method that contains the loop, or the main entry point */
+	ast_node_t *loop;		/*e WHILE node */
+	void *osr_code;			/*e entry point into optimised code for the loop header, or NULL */
+	class_t **osr_parameter_types;	/*e parameter classes that osr_code is specialised to (cf. dyncomp_version_t) */
+	symtab_entry_t *extracted;	/*e main entry point only: optimised function that runs the loop */
+} dyncomp_loop_t;
+
+/*e
+ * Type feedback for one member access or method call (cf. dyncomp_type_feedback())
+ *
+ * Generated code fills the inline cache with the receiver classes that it observes, so the
+ * cache doubles as the site's receiver class profile.
+ */
+typedef struct {
+	ast_node_t *node;		/*e MEMBER, METHODAPP, or ASSIGN to MEMBER */
+	inline_cache_t *cache;
+} dyncomp_type_feedback_t;
+
+/*e
+ * One optimised version of a function (cf. symtab_entry_t.r_versions)
+ *
+ * The version's code guards its parameters against `parameter_types', the copy of the
+ * function's dynamic_parameter_types that it was compiled for.  Versions are never freed
+ * while the program runs, since callers may be bound to them directly.
+ */
+typedef struct {
+	class_t **parameter_types;		/*e NULL if the function has no parameters */
+	void *entry;
+} dyncomp_version_t;
+
+/*e
+ * A call from optimised code that goes straight to one version of its callee
+ */
+typedef struct {
+	ast_node_t *node;		/*e FUNAPP or METHODAPP */
+	void *entry;			/*e dyncomp_version_t.entry of the callee */
+} dyncomp_version_binding_t;
 
 //d Dynamischer (Zur-Laufzeit) Uebersetzer und Unterstuetzungsroutinen
 //e dynamic (at-runtime) compiler and support operations
@@ -133,14 +186,175 @@ dyncomp_init_unoptimised(symtab_entry_t *sym);
 void
 dyncomp_runtime_sample(symtab_entry_t *sym, struct object** low_args, struct object** high_args);
 
+/*e
+ * Records a direct call site into a dynamically compiled function
+ *
+ * The call site is re-targeted to sym->r_mem whenever the function is (re-)compiled,
+ * i.e., on first compilation, optimisation and deoptimisation.  We forget it once the
+ * code that contains it is replaced (cf. dyncomp_deoptimise()) or freed.
+ *
+ * @param sym The callee
+ * @param label Label of the call instruction's jump target
+ */
+void
+dyncomp_add_call_site(symtab_entry_t *sym, label_t *label);
+
 /*e
  * Deoptimises the specified function
  *
+ * Records the failure, so that we wait longer before optimising again and stop specialising
+ * on parameters whose type guards keep failing.  If the type dispatcher can select between
+ * versions of the function, we keep the current version and let the dispatcher send all other
+ * calls to the unoptimised code, which then samples them for another version.  Otherwise we
+ * reinstall the unoptimised code.
+ *
  * @param sym The function to deoptimise
+ * @param failed_parameter Number of the parameter whose type guard failed
  *
  * @return Entry point for that function (i.e., sym->r_mem);
  */
 void *
-dyncomp_deoptimise(symtab_entry_t *sym);
+dyncomp_deoptimise(symtab_entry_t *sym, int failed_parameter);
+
+/*e
+ * Stops the background compiler thread (if running) and discards all of its uninstalled work
+ *
+ * Must be called before the symbol table or the code of the runtime image are freed.
+ */
+void
+dyncomp_background_stop(void);
+
+/*e
+ * Looks up or creates the hotness record for a loop in unoptimised code
+ *
+ * @param sym The function/method or main entry point that contains the loop
+ * @param loop The WHILE node
+ */
+dyncomp_loop_t *
+dyncomp_loop_record(symtab_entry_t *sym, ast_node_t *loop);
+
+/*e
+ * Looks up the hotness record for a loop, if unoptimised code has created one
+ *
+ * @return The record, or NULL
+ */
+dyncomp_loop_t *
+dyncomp_loop_lookup(symtab_entry_t *sym, ast_node_t *loop);
+
+/*e
+ * Determines whether unoptimised code for `sym' may switch to optimised code within a loop
+ *
+ * This excludes constructors (which we never optimise) and callables that assign to their
+ * parameters, since the optimised code's parameter type guards only describe the values
+ * that the parameters had on entry.
+ */
+bool
+dyncomp_osr_eligible(symtab_entry_t *sym);
+
+/*e
+ * Determines whether a loop in the main entry point may run as a separate, optimised function
+ *
+ * This requires that the loop calls no functions, methods or constructors (which might
+ * access the global variables that the optimised function keeps in local variables).
+ */
+bool
+dyncomp_osr_main_loop_eligible(ast_node_t *loop);
+
+/*e
+ * On-stack replacement: invoked by unoptimised code in a hot loop of a function or method
+ *
+ * Optimises the function, if needed, and checks the optimised code's parameter type guards
+ * against the current frame.
+ *
+ * @param record The loop's hotness record
+ * @param args Address of the parameter at offset 0 in the current frame (i.e., $fp plus the
+ * $fp offset for parameters)
+ * @return Entry point into optimised code for the loop header (to be reached via `jr', with
+ * the unoptimised frame still in place), or NULL to continue in unoptimised code
+ */
+void *
+dyncomp_osr(dyncomp_loop_t *record, struct object **args);
+
+/*e
+ * On-stack replacement: invoked by unoptimised code in a hot loop of the main entry point
+ *
+ * Compiles the loop (once) into an optimised function without parameters that loads the
+ * loop's global variables into local variables, runs the loop, and writes back all global
+ * variables that the loop assigns to.
+ *
+ * @param record The loop's hotness record
+ * @return Entry point of the optimised function (to be called via `jalr'), or NULL to continue
+ * in unoptimised code
+ */
+void *
+dyncomp_osr_main_loop(dyncomp_loop_t *record);
+
+/*e
+ * Looks up or creates the inline cache for a member access or method call
+ *
+ * All code compiled for `sym' shares the same cache for the same site, so that the receiver
+ * class profile survives deoptimisation and recompilation.
+ *
+ * @param sym The function/method or main entry point that contains the site
+ * @param node The MEMBER, METHODAPP, or ASSIGN node
+ */
+inline_cache_t *
+dyncomp_type_feedback(symtab_entry_t *sym, ast_node_t *node);
+
+/*e
+ * Looks up the receiver class that a member access or method call has observed
+ *
+ * @param sym The function/method that contains the site
+ * @param node The MEMBER, METHODAPP, or ASSIGN node
+ * @param entry If non-NULL, receives a copy of the site's inline cache entry for that class
+ * @return The only receiver class that the site has observed, or NULL if the site has no
+ * profile, has observed no class yet, or has observed more than one class
+ */
+class_t *
+dyncomp_type_feedback_class(symtab_entry_t *sym, ast_node_t *node, inline_cache_entry_t *entry);
+
+/*e
+ * Finds the version of `callee' that the type dispatcher would pick for arguments of known classes
+ *
+ * @param callee The function or method to call
+ * @param argument_classes For each parameter of `callee': symbol table entry of the argument's
+ * exact class, or NULL if the caller does not know it
+ * @return Entry point of the version, or NULL if `callee' has no versions or the dispatcher's
+ * choice depends on classes that the caller does not know
+ */
+void *
+dyncomp_version_lookup(symtab_entry_t *callee, symtab_entry_t **argument_classes);
+
+/*e
+ * Records that optimised code for `sym' should call `entry' directly at `node'
+ */
+void
+dyncomp_version_bind(symtab_entry_t *sym, ast_node_t *node, void *entry);
+
+/*e
+ * Looks up a call target recorded by dyncomp_version_bind()
+ *
+ * @return The version's entry point, or NULL
+ */
+void *
+dyncomp_version_binding(symtab_entry_t *sym, ast_node_t *node);
+
+/*e
+ * Forgets all call targets recorded by dyncomp_version_bind() for `sym'
+ */
+void
+dyncomp_version_bindings_clear(symtab_entry_t *sym);
+
+/*e
+ * Frees the version records and the type dispatcher of `sym' (but not the versions' code)
+ */
+void
+dyncomp_versions_free(symtab_entry_t *sym);
+
+/*e
+ * Frees all hotness records of `sym', including code generated by dyncomp_osr_main_loop()
+ */
+void
+dyncomp_loop_records_free(symtab_entry_t *sym);
 
 #endif // !defined(_ATTOL_DYNAMIC_COMPILER_H)
@@ -33,10 +33,15 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <time.h>
 
 #include "bitvector.h"
 #include "cstack.h"
@@ -62,285 +67,1874 @@
 #define HEAP_START 0x10000000000 /*e default heap memory start address */
 #define PAGE_SIZE 0x1000 /*e normal page size (FIXME: validate against system header) */
 
+#ifndef MAP_NORESERVE
+#  define MAP_NORESERVE 0
+#endif
+
+/*e
+ * Nursery size, as a fraction of the total heap (1/2^HEAP_NURSERY_SHIFT), and its lower bound.
+ * Objects larger than 1/2^HEAP_PRETENURE_SHIFT of the nursery are allocated directly in old space.
+ */
+#define HEAP_NURSERY_SHIFT	3
+#define HEAP_NURSERY_MIN_SIZE	(PAGE_SIZE * 4)
+#define HEAP_PRETENURE_SHIFT	2
+
+#if HEAP_INLINE_ALLOCATION_MAX > (HEAP_NURSERY_MIN_SIZE >> HEAP_PRETENURE_SHIFT)
+#  error "Inline allocation must not bypass pretenuring"
+#endif
+
+/*e
+ * Maximum large object space size, as a fraction of the total heap (1/2^HEAP_LARGE_SPACE_SHIFT).
+ * The large object space only commits the pages that it needs; old space gets the rest.
+ */
+#define HEAP_LARGE_SPACE_SHIFT	2
+
+/*e
+ * Heap sizing policy, applied after each major collection: we double the heap if more than
+ * HEAP_GROW_OCCUPANCY percent of old space and large object space are live, or if we spent more than
+ * HEAP_GROW_GC_TIME percent of the time since the last major collection collecting garbage.
+ * We halve it if both are below HEAP_SHRINK_OCCUPANCY and HEAP_SHRINK_GC_TIME.
+ */
+#define HEAP_GROW_OCCUPANCY	50
+#define HEAP_GROW_GC_TIME	10
+#define HEAP_SHRINK_OCCUPANCY	20
+#define HEAP_SHRINK_GC_TIME	2
+
+/*e
+ * We don't clear the nursery after collection, but instead zero it lazily, in chunks of
+ * HEAP_ZERO_CHUNK bytes, right before handing the memory out.
+ */
+#define HEAP_ZERO_CHUNK		(PAGE_SIZE * 8)
+
+#define CARD_SIZE		(1 << HEAP_CARD_SHIFT)
+#define CARD_NO_OBJECT		0xff /*e marker in `card_object_starts': no object starts in this card */
+
 typedef struct {
 	unsigned char *start;
 	unsigned char *end;
 } semispace_t;
 
 void *heap_root_frame_pointer = NULL; /*e initialised by runtime_execute() */
+long long heap_card_table_bias = 0;
+unsigned char *heap_reserved_start = NULL;
+unsigned char *heap_reserved_end = NULL;
+
+static unsigned char *heap_base = NULL;
+static size_t heap_size_total; /*e the heap may grow up to this size */
+static size_t heap_reserved_size; /*e reserved address space, for the largest old space and the largest large object space */
+static size_t heap_size_current; /*e committed heap size */
+static size_t heap_size_minimum; /*e we never shrink the heap below this size */
+static double gc_time; /*e seconds spent collecting since gc_window_start */
+static struct timespec gc_window_start; /*e end of the last major collection */
+unsigned char *heap_free_pointer = NULL; /*e nursery allocation pointer */
+unsigned char *heap_allocation_limit = NULL; /*e end of the zeroed part of the nursery */
+static unsigned char *nursery_dirty_end = NULL; /*e nursery memory from here on is known to be zero */
+static unsigned char *old_free_pointer = NULL; /*e old space allocation pointer (within to_space) */
+
+/*e
+ * Heap layout:  [ nursery | old semispace | old semispace | large object space ]
+ *
+ * New objects are allocated in the nursery.  A minor collection promotes all live nursery
+ * objects into the current old semispace (to_space); its roots are the static memory,
+ * the stack, and all old-space cards that the write barrier marked as dirty.
+ * Once old space cannot absorb the nursery any more, we perform a major collection,
+ * i.e., a Cheney copy of both nursery and old space into the other old semispace.
+ * If the other semispace might be too small for that (and the heap cannot grow), we copy
+ * old space alone and then run a minor collection; nursery survivors that do not fit into
+ * old space stay in the nursery, packed at its start.
+ *
+ * With compiler_options.gc_mark_compact, old space is not split into semispaces: it takes up
+ * all of the space between the nursery and the large object space, and major collections
+ * mark all live objects and then slide them to the start of old space (from_space is empty).
+ *
+ * Objects of at least compiler_options.large_object_threshold bytes go to the large object
+ * space, where each object occupies its own run of pages.  Large objects are never moved;
+ * major collections mark them and sweep the unmarked ones, minor collections treat them
+ * like old space.
+ */
+static semispace_t nursery = { NULL, NULL };
+static semispace_t to_space = { NULL, NULL };
+static semispace_t from_space = { NULL, NULL };
+
+typedef struct large_object {
+	struct large_object *next;
+	size_t first_page;
+	size_t pages_nr;
+	atomic_bool marked;
+} large_object_t;
+
+static struct {
+	unsigned char *start;
+	unsigned char *end;
+	size_t pages_nr;
+	size_t free_pages_nr;
+	large_object_t **page_owners; /*e per page: the large object that occupies it, or NULL */
+	large_object_t *objects; /*e all allocated large objects */
+	cstack_t *grey; /*e marked large objects that the sequential collector has yet to scan */
+} large_space;
+
+/*e
+ * One byte per CARD_SIZE bytes of heap.  `card_table' is nonzero for cards that were written to
+ * since the last collection; `card_object_starts' stores (in words) the offset of the first object
+ * that starts in an old-space card, or CARD_NO_OBJECT.
+ *
+ * Like the heap itself, these tables (and the mark-compact tables below) reserve space for the
+ * largest permissible heap, but only the entries for committed heap memory are ever touched;
+ * heap_commit() initialises and releases them along with the heap.
+ */
+static unsigned char *card_table = NULL;
+static unsigned char *card_object_starts = NULL;
+static size_t cards_nr;
+
+/*e
+ * Mark-compact support: one mark bit per heap word (so one 64 bit word per card), set for
+ * all words of live objects, and the number of live bytes that precede each card in
+ * compaction order (old space, then nursery).
+ *
+ * All collectors use these tables to pack nursery objects that do not fit into old space
+ * at the start of the nursery (cf. gc_retain()).
+ */
+static uint64_t *mark_bits = NULL;
+static size_t *card_live_before = NULL;
+
+static size_t
+card_index(void *addr)
+{
+	return (((unsigned char *) addr) - heap_base) >> HEAP_CARD_SHIFT;
+}
+
+static unsigned char *
+card_address(size_t card)
+{
+	return heap_base + (card << HEAP_CARD_SHIFT);
+}
+
+//e is `addr' within the reserved heap address range?  (Stack-allocated objects are not.)
+static bool
+in_heap(void *addr)
+{
+	return (((unsigned char *)addr) >= heap_reserved_start
+		&& ((unsigned char *)addr) < heap_reserved_end);
+}
+
+static bool
+in_large_space(void *addr)
+{
+	return (((unsigned char *)addr) >= large_space.start
+		&& ((unsigned char *)addr) < large_space.end);
+}
+
+static large_object_t *
+large_object_lookup(void *addr)
+{
+	return large_space.page_owners[(((unsigned char *) addr) - large_space.start) / PAGE_SIZE];
+}
+
+static object_t *
+large_object_address(large_object_t *large)
+{
+	return (object_t *) (large_space.start + large->first_page * PAGE_SIZE);
+}
+
+typedef struct {
+	size_t nursery;
+	size_t semispace; /*e size of one old semispace (or of all of old space, for mark-compact) */
+	size_t large; /*e maximum size of the large object space */
+} heap_layout_t;
+
+//e rounds `size' up to a multiple of PAGE_SIZE, as most systems require that property
+static size_t
+page_align(size_t size)
+{
+	return (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
+
+//e old space consists of two semispaces of equal (page-aligned) size, unless we use mark-compact
+static size_t
+heap_semispace_size(size_t old_space_size)
+{
+	old_space_size &= ~(PAGE_SIZE - 1);
+	if (compiler_options.gc_mark_compact) {
+		return old_space_size;
+	}
+	return (old_space_size >> 1) & ~(PAGE_SIZE - 1);
+}
+
+/*e
+ * Splits a heap of `total' bytes into its spaces; fails if the heap is too small
+ *
+ * @param large_size Committed size of the large object space (at most the returned `large')
+ */
+static heap_layout_t
+heap_layout(size_t total, size_t large_size)
+{
+	heap_layout_t layout;
+	layout.nursery = (total >> HEAP_NURSERY_SHIFT) & ~(PAGE_SIZE - 1);
+	if (layout.nursery < HEAP_NURSERY_MIN_SIZE) {
+		layout.nursery = HEAP_NURSERY_MIN_SIZE;
+	}
+	layout.large = (total >> HEAP_LARGE_SPACE_SHIFT) & ~(PAGE_SIZE - 1);
+	//e old space must be usable even if the large object space is as large as it gets
+	if (total <= layout.nursery + layout.large
+	    || heap_semispace_size(total - layout.nursery - layout.large) < layout.nursery) {
+		fprintf(stderr, "Heap size of %zu bytes is too small\n", total);
+		exit(1);
+	}
+	layout.semispace = heap_semispace_size(total - layout.nursery - large_size);
+	return layout;
+}
+
+//e returns the pages in [start, start + size) to the operating system; they will read as zero afterwards
+static void
+heap_discard_pages(unsigned char *start, size_t size)
+{
+#ifdef __linux__
+	//e Linux guarantees that discarded private anonymous pages are zero-filled on the next access
+	madvise(start, size, MADV_DONTNEED);
+#else
+	if (mmap(start, size, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) == MAP_FAILED) {
+		perror("heap segment mmap");
+		exit(1);
+	}
+#endif
+}
+
+//e zeroes [start, end), returning all pages that are fully contained in that range to the operating system
+static void
+heap_release(unsigned char *start, unsigned char *end)
+{
+	if (start >= end) {
+		return;
+	}
+	unsigned char *first_page = (unsigned char *) page_align((size_t) start);
+	unsigned char *last_page = (unsigned char *) (((size_t) end) & ~(PAGE_SIZE - 1));
+	if (first_page >= last_page) {
+		memset(start, 0, end - start);
+		return;
+	}
+	memset(start, 0, first_page - start);
+	heap_discard_pages(first_page, last_page - first_page);
+	memset(last_page, 0, end - last_page);
+}
+
+//e reserves `size' bytes for a per-card table; the operating system only backs the pages that we touch
+static void *
+heap_side_table_reserve(size_t size)
+{
+	void *table = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return table == MAP_FAILED ? NULL : table;
+}
+
+//e zeroes the entries for cards [first, end) of a per-card table with `entry_size' bytes per entry
+static void
+heap_side_table_release(void *table, size_t entry_size, size_t first, size_t end)
+{
+	if (table) {
+		heap_release(((unsigned char *) table) + first * entry_size, ((unsigned char *) table) + end * entry_size);
+	}
+}
+
+//e commits or decommits memory at the end of a space that changes its size from `old_size' to `new_size'
+static void
+heap_commit(unsigned char *start, size_t old_size, size_t new_size)
+{
+	const size_t old_end_card = card_index(start + old_size);
+	const size_t new_end_card = card_index(start + new_size);
+	if (new_size > old_size) {
+		if (mprotect(start + old_size, new_size - old_size, PROT_READ | PROT_WRITE)) {
+			perror("heap segment mprotect");
+			exit(1);
+		}
+		//e all other tables are zero for memory that we have not used yet
+		memset(card_object_starts + old_end_card, CARD_NO_OBJECT, new_end_card - old_end_card);
+	} else if (new_size < old_size) {
+		//e make sure that we get fresh zero pages if we re-commit later
+		heap_discard_pages(start + new_size, old_size - new_size);
+		mprotect(start + new_size, old_size - new_size, PROT_NONE);
+		heap_side_table_release(card_table, 1, new_end_card, old_end_card);
+		heap_side_table_release(card_object_starts, 1, new_end_card, old_end_card);
+		heap_side_table_release(mark_bits, sizeof(uint64_t), new_end_card, old_end_card);
+		heap_side_table_release(card_live_before, sizeof(size_t), new_end_card, old_end_card);
+	}
+}
+
+/*e
+ * Changes the (committed) heap size and the number of committed large object space pages
+ *
+ * Shrinking any space requires room for all of its objects; shrinking the nursery requires
+ * an empty nursery.
+ *
+ * @return true iff the heap now has the requested layout
+ */
+static bool
+heap_resize_spaces(size_t total, size_t large_pages_nr)
+{
+	heap_layout_t layout = heap_layout(total, large_pages_nr * PAGE_SIZE);
+
+	if ((layout.nursery < nursery.end - nursery.start && heap_free_pointer != nursery.start)
+	    || old_free_pointer > to_space.start + layout.semispace) {
+		return false;
+	}
+	for (size_t page = large_pages_nr; page < large_space.pages_nr; page++) {
+		if (large_space.page_owners[page]) {
+			return false;
+		}
+	}
+
+	heap_commit(nursery.start, nursery.end - nursery.start, layout.nursery);
+	nursery.end = nursery.start + layout.nursery;
+	if (heap_allocation_limit > nursery.end) {
+		heap_allocation_limit = nursery.end;
+	}
+	if (nursery_dirty_end > nursery.end) {
+		nursery_dirty_end = nursery.end;
+	}
+
+	heap_commit(to_space.start, to_space.end - to_space.start, layout.semispace);
+	to_space.end = to_space.start + layout.semispace;
+	if (!compiler_options.gc_mark_compact) {
+		heap_commit(from_space.start, from_space.end - from_space.start, layout.semispace);
+		from_space.end = from_space.start + layout.semispace;
+	}
+
+	heap_commit(large_space.start, large_space.end - large_space.start, large_pages_nr * PAGE_SIZE);
+	large_space.end = large_space.start + large_pages_nr * PAGE_SIZE;
+	large_space.free_pages_nr = large_space.free_pages_nr + large_pages_nr - large_space.pages_nr;
+	large_space.pages_nr = large_pages_nr;
+
+	if (heap_size_current && heap_size_current != total && compiler_options.debug_gc) {
+		fprintf(stderr, "[GC: Resized heap from %zu to %zu bytes]\n", heap_size_current, total);
+	}
+	heap_size_current = total;
+	return true;
+}
+
+/*e
+ * Changes the (committed) heap size
+ *
+ * Growing is always possible, up to heap_size_total.  Shrinking requires an empty nursery and
+ * enough room for all old space and large objects.
+ *
+ * @return true iff the heap now has the requested size
+ */
+static bool
+heap_resize(size_t total)
+{
+	size_t large_pages_nr = large_space.pages_nr;
+	const size_t max_large_pages_nr = heap_layout(total, 0).large / PAGE_SIZE;
+	if (large_pages_nr > max_large_pages_nr) {
+		large_pages_nr = max_large_pages_nr;
+	}
+	return heap_resize_spaces(total, large_pages_nr);
+}
+
+/*e
+ * Commits or decommits large object space pages at the end of the large object space,
+ * taking the memory from (or giving it to) old space
+ *
+ * @return true iff the large object space now has `pages_nr' pages
+ */
+static bool
+large_space_resize(size_t pages_nr)
+{
+	return pages_nr * PAGE_SIZE <= heap_layout(heap_size_current, 0).large
+		&& heap_resize_spaces(heap_size_current, pages_nr);
+}
+
+//e the next larger heap size that we grow to
+static size_t
+heap_next_size(size_t total)
+{
+	total = page_align(total << 1);
+	return total > heap_size_total ? heap_size_total : total;
+}
+
+//e tries to grow the heap until old (semi-)spaces have at least `semispace_size' bytes; returns true on success
+static bool
+heap_grow_semispace(size_t semispace_size)
+{
+	size_t total = heap_size_current;
+	while (total < heap_size_total
+	       && heap_layout(total, large_space.end - large_space.start).semispace < semispace_size) {
+		total = heap_next_size(total);
+	}
+	return total != heap_size_current
+		&& heap_resize(total)
+		&& to_space.end - to_space.start >= semispace_size;
+}
+
+void
+heap_init(size_t initial_heap_size, size_t max_heap_size)
+{
+	//e we allocate the heap only once:
+	assert(!heap_base);
+	heap_size_total = page_align(max_heap_size);
+	size_t initial_size = page_align(initial_heap_size);
+	if (initial_size > heap_size_total) {
+		initial_size = heap_size_total;
+	}
+
+	//e reserve address space for the largest permissible heap; heap_resize() commits what we use
+	heap_layout_t reserved = heap_layout(heap_size_total, 0);
+	heap_layout(initial_size, 0); //e check that the initial heap is usable
+	heap_reserved_size = reserved.nursery + reserved.semispace * (compiler_options.gc_mark_compact ? 1 : 2)
+		+ reserved.large;
+
+	heap_base = mmap((void *) HEAP_START,
+			 heap_reserved_size,
+			 PROT_NONE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+			 -1,
+			 0);
+	if (heap_base == MAP_FAILED) {
+		perror("heap segment mmap");
+		exit(1);
+	}
+
+	if (!heap_base) {
+		// Out of memory
+		fprintf(stderr, "Cannot allocate heap; out of memory\n");
+		exit(1);
+	}
+
+	nursery.start = nursery.end = heap_base;
+
+	//e Copying GC: split old space into two semispaces
+	to_space.start = to_space.end = nursery.start + reserved.nursery;
+	from_space.start = from_space.end = to_space.start + reserved.semispace;
+
+	large_space.start = large_space.end = from_space.start + (compiler_options.gc_mark_compact ? 0 : reserved.semispace);
+	large_space.pages_nr = large_space.free_pages_nr = 0;
+	large_space.page_owners = calloc(reserved.large / PAGE_SIZE + 1, sizeof(large_object_t *));
+	large_space.objects = NULL;
+	large_space.grey = stack_alloc(sizeof(object_t *), 16);
+	if (!large_space.page_owners) {
+		fprintf(stderr, "Cannot allocate large object page table; out of memory\n");
+		exit(1);
+	}
+
+	heap_size_current = 0;
+	heap_size_minimum = initial_size;
+	gc_time = 0.0;
+	clock_gettime(CLOCK_MONOTONIC, &gc_window_start);
+	heap_free_pointer = heap_allocation_limit = nursery_dirty_end = nursery.start;
+	old_free_pointer = to_space.start;
+
+	cards_nr = (heap_reserved_size + CARD_SIZE - 1) >> HEAP_CARD_SHIFT;
+	card_table = heap_side_table_reserve(cards_nr);
+	card_object_starts = heap_side_table_reserve(cards_nr);
+	if (!card_table || !card_object_starts) {
+		fprintf(stderr, "Cannot allocate card table; out of memory\n");
+		exit(1);
+	}
+	mark_bits = heap_side_table_reserve(cards_nr * sizeof(uint64_t));
+	card_live_before = heap_side_table_reserve(cards_nr * sizeof(size_t));
+	if (!mark_bits || !card_live_before) {
+		fprintf(stderr, "Cannot allocate mark bitmap; out of memory\n");
+		exit(1);
+	}
+	heap_resize(initial_size);
+	//e heap_base is page-aligned, so all cards are, too
+	heap_card_table_bias = ((long long) card_table) - (((long long) heap_base) >> HEAP_CARD_SHIFT);
+	heap_reserved_start = heap_base;
+	heap_reserved_end = heap_base + heap_reserved_size;
+}
+
+void
+heap_free()
+{
+	if (heap_base) {
+		munmap(heap_base, heap_reserved_size);
+		heap_base = heap_free_pointer = heap_allocation_limit = nursery_dirty_end = old_free_pointer = NULL;
+		munmap(card_table, cards_nr);
+		munmap(card_object_starts, cards_nr);
+		card_table = card_object_starts = NULL;
+		heap_card_table_bias = 0;
+		heap_reserved_start = heap_reserved_end = NULL;
+		munmap(mark_bits, cards_nr * sizeof(uint64_t));
+		munmap(card_live_before, cards_nr * sizeof(size_t));
+		mark_bits = NULL;
+		card_live_before = NULL;
+
+		while (large_space.objects) {
+			large_object_t *next = large_space.objects->next;
+			free(large_space.objects);
+			large_space.objects = next;
+		}
+		free(large_space.page_owners);
+		large_space.page_owners = NULL;
+		stack_free(large_space.grey, NULL);
+		large_space.grey = NULL;
+		large_space.start = large_space.end = NULL;
+	}
+}
+
+void
+heap_write_barrier(void *slot)
+{
+	if (in_heap(slot)) {
+		card_table[card_index(slot)] = 1;
+	}
+}
+
+//e handle out-of-memory situations
+static void
+handle_out_of_memory(void *frame_pointer, bool major);
+
+//e records that an object starts at `addr' in old space
+static void
+old_space_note_object(unsigned char *addr)
+{
+	size_t card = card_index(addr);
+	if (card_object_starts[card] == CARD_NO_OBJECT) {
+		card_object_starts[card] = (addr - card_address(card)) / sizeof(object_member_t);
+	}
+}
+
+//e allocates large objects directly in old space
+static object_t *
+heap_allocate_old_object(class_t* type, size_t fields_nr, size_t requested_bytes, void *frame_pointer)
+{
+	if (old_free_pointer + requested_bytes > to_space.end) {
+		handle_out_of_memory(frame_pointer, true);
+		if (to_space.end - old_free_pointer < requested_bytes
+		    && !heap_grow_semispace((old_free_pointer - to_space.start) + requested_bytes)) {
+			fprintf(stderr, "Out of memory: insufficient space for %zu bytes (%zu fields) (allocated: %zu of %zu bytes)\n", requested_bytes, fields_nr, heap_available(), heap_size());
+			exit(1);
+		}
+	}
+	object_t *obj = (object_t *) old_free_pointer;
+	old_free_pointer += requested_bytes;
+	old_space_note_object((unsigned char *) obj);
+	obj->classref = type;
+	return obj;
+}
+
+//e hands out the (committed) large object space pages [first_page, first_page + pages_nr)
+static object_t *
+large_space_claim(size_t first_page, size_t pages_nr)
+{
+	large_object_t *large = malloc(sizeof(large_object_t));
+	if (!large) {
+		fprintf(stderr, "Cannot allocate large object descriptor; out of memory\n");
+		exit(1);
+	}
+	large->first_page = first_page;
+	large->pages_nr = pages_nr;
+	atomic_init(&large->marked, false);
+	large->next = large_space.objects;
+	large_space.objects = large;
+	for (size_t i = first_page; i < first_page + pages_nr; i++) {
+		large_space.page_owners[i] = large;
+	}
+	large_space.free_pages_nr -= pages_nr;
+	return large_object_address(large);
+}
+
+//e allocates `requested_bytes' in a fresh run of pages in the large object space, or returns NULL
+static object_t *
+large_space_allocate(size_t requested_bytes)
+{
+	const size_t pages_nr = (requested_bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+
+	//e first fit
+	size_t run_start = 0;
+	for (size_t page = 0; page < large_space.pages_nr; page++) {
+		if (large_space.page_owners[page]) {
+			run_start = page + 1;
+		} else if (page + 1 - run_start == pages_nr) {
+			return large_space_claim(run_start, pages_nr);
+		}
+	}
+	//e extend the free run at the end, if old space can spare the memory
+	if (!large_space_resize(run_start + pages_nr)) {
+		return NULL;
+	}
+	return large_space_claim(run_start, pages_nr);
+}
+
+//e returns the free pages at the end of the large object space to old space
+static void
+large_space_trim(void)
+{
+	size_t pages_nr = large_space.pages_nr;
+	while (pages_nr > 0 && !large_space.page_owners[pages_nr - 1]) {
+		--pages_nr;
+	}
+	if (pages_nr < large_space.pages_nr) {
+		large_space_resize(pages_nr);
+	}
+}
+
+//e allocates objects of at least compiler_options.large_object_threshold bytes
+static object_t *
+heap_allocate_large_object(class_t* type, size_t fields_nr, size_t requested_bytes, void *frame_pointer)
+{
+	object_t *obj = large_space_allocate(requested_bytes);
+	if (!obj) {
+		handle_out_of_memory(frame_pointer, true);
+		obj = large_space_allocate(requested_bytes);
+	}
+	while (!obj && heap_size_current < heap_size_total && heap_resize(heap_next_size(heap_size_current))) {
+		obj = large_space_allocate(requested_bytes);
+	}
+	if (!obj) {
+		//e large object space is too full or too fragmented
+		return heap_allocate_old_object(type, fields_nr, requested_bytes, frame_pointer);
+	}
+	obj->classref = type;
+	return obj;
+}
+
+/*e
+ * Zeroes more of the nursery, so that we can allocate `requested_bytes' at heap_free_pointer
+ *
+ * @return false iff the nursery is full
+ */
+static bool
+nursery_zero_more(size_t requested_bytes)
+{
+	unsigned char *limit = heap_allocation_limit + HEAP_ZERO_CHUNK;
+	//e the allocation limit is exclusive
+	unsigned char *needed = (unsigned char *) page_align((size_t) (heap_free_pointer + requested_bytes + 1));
+	if (limit < needed) {
+		limit = needed;
+	}
+	if (limit > nursery.end) {
+		limit = nursery.end;
+	}
+	if (heap_free_pointer + requested_bytes >= limit) {
+		return false;
+	}
+	if (nursery_dirty_end > heap_allocation_limit) {
+		memset(heap_allocation_limit, 0, (limit < nursery_dirty_end ? limit : nursery_dirty_end) - heap_allocation_limit);
+	}
+	heap_allocation_limit = limit;
+	return true;
+}
+
+object_t *
+heap_allocate_object(class_t* type, size_t fields_nr)
+{
+	object_t *obj = (object_t *) heap_free_pointer;
+	size_t requested_bytes = sizeof(object_t) + (fields_nr * sizeof(object_member_t));
+
+	//	fprintf(stderr, "alloc(%s, %zu * %zu) : ", type->id->name, fields_nr, sizeof(object_member_t));
+
+	if (requested_bytes >= compiler_options.large_object_threshold) {
+		//e __builtin_frame_address(0) reads the $fp
+		return heap_allocate_large_object(type, fields_nr, requested_bytes, __builtin_frame_address(0));
+	}
+	if (requested_bytes > ((nursery.end - nursery.start) >> HEAP_PRETENURE_SHIFT)) {
+		return heap_allocate_old_object(type, fields_nr, requested_bytes, __builtin_frame_address(0));
+	}
+
+	heap_free_pointer += requested_bytes;
+
+	if (heap_free_pointer >= heap_allocation_limit) {
+		heap_free_pointer -= requested_bytes;
+		if (!nursery_zero_more(requested_bytes)) {
+			handle_out_of_memory(__builtin_frame_address(0), false);
+			//e the collection may have retained survivors in the nursery
+			if (!nursery_zero_more(requested_bytes)) {
+				fprintf(stderr, "Error: out of memory\n");
+				exit(1);
+			}
+		}
+		//e handled successfully; recurse to minimise risk of accidental bug
+		return heap_allocate_object(type, fields_nr);
+	}
+	obj->classref = type;
+	/* fprintf(stderr, "alloc(%s, %zu * %zu) -> %p\n", type->id->name, fields_nr, sizeof(object_member_t), obj); */
+	return obj;
+}
+
+size_t
+heap_available(void)
+{
+	return (nursery.end - heap_free_pointer) + (to_space.end - old_free_pointer)
+		+ large_space.free_pages_nr * PAGE_SIZE;
+}
+
+size_t
+heap_size(void)
+{
+	return (nursery.end - nursery.start) + (to_space.end - to_space.start)
+		+ (large_space.end - large_space.start);
+}
+
+// ================================================================================
+// garbage collector implementation
+
+#define GC_THREADS_MAX		64
+#define GC_COPY_BUFFER_SIZE	(CARD_SIZE * 8)	/*e size of per-thread copy buffers; must be a multiple of CARD_SIZE */
+#define GC_DEQUE_INITIAL_SIZE	1024		/*e must be a power of two */
+#define GC_ROOTS_BLOCK		64		/*e number of static slots / stack frames / cards that a worker claims at once */
+
+static bool gc_major; /*e are we performing a major collection? */
+static bool gc_old_space_only; /*e major collection that leaves the nursery in place and treats it as a root */
+static bool gc_nursery_retained; /*e has the current collection left survivors in the nursery? */
+static size_t gc_nursery_retained_size; /*e if so, they take up this many bytes at the start of the nursery */
+
+//e mark-compact collection phases; gc_move() delegates to gc_compact_visit() unless we are in GC_COMPACT_OFF
+enum {
+	GC_COMPACT_OFF,
+	GC_COMPACT_MARK,
+	GC_COMPACT_UPDATE
+} gc_compact_phase = GC_COMPACT_OFF;
+
+static void
+gc_compact_visit(object_t **memref);
+
+static void
+gc_mark_words(unsigned char *start, size_t size);
+
+static bool
+gc_is_marked(void *addr);
+
+/*e
+ * Filler "objects" keep old space parseable (for card scanning) when a parallel collection
+ * leaves gaps at the ends of per-thread copy buffers.  FILLER_WORD occupies one word,
+ * FILLER_BLOCK occupies fields[0].int_v bytes.
+ */
+static char filler_word, filler_block;
+#define FILLER_WORD	((class_t *) &filler_word)
+#define FILLER_BLOCK	((class_t *) &filler_block)
+
+typedef struct gc_deque_array {
+	long long size; /*e always a power of two */
+	struct gc_deque_array *previous; /*e arrays we outgrew; concurrent thieves may still read them */
+	_Atomic(object_t *) elements[];
+} gc_deque_array_t;
+
+/*e
+ * Work-stealing deque of grey objects (copied, but not yet scanned), after Chase and Lev.
+ * Only the owner pushes and takes at the bottom; other workers steal from the top.
+ */
+typedef struct {
+	atomic_llong top;
+	atomic_llong bottom;
+	_Atomic(gc_deque_array_t *) array;
+} gc_deque_t;
+
+typedef struct gc_worker {
+	pthread_t thread;
+	gc_deque_t deque;
+	unsigned char *copy_free; /*e per-thread copy buffer in to_space */
+	unsigned char *copy_end;
+	unsigned int random_state; /*e for picking victims to steal from */
+} gc_worker_t;
+
+typedef struct {
+	void **frame_pointer;
+	void *return_addr;
+} gc_frame_t;
+
+//e state shared by all workers during a parallel collection
+static struct {
+	int workers_nr;
+	gc_worker_t workers[GC_THREADS_MAX];
+	atomic_uintptr_t free_pointer; /*e old space allocation pointer for copy buffers */
+	atomic_int idle_workers;
+	atomic_size_t next_static, next_frame, next_card, next_large_card; /*e root scanning progress */
+	cstack_t *frames;
+	unsigned char *old_limit; /*e end of old space objects that existed before the collection */
+} gc_parallel;
+
+// Swaps contents of to_space and from_space.
+static void
+swap_semispaces(void)
+{
+	semispace_t buf = to_space;
+	to_space = from_space;
+	from_space = buf;
+}
+
+static bool
+in_nursery(void *addr)
+{
+	return (((unsigned char *)addr) >= nursery.start
+		&& ((unsigned char *)addr) < nursery.end);
+}
+
+static bool
+in_from_space(void *addr)
+{
+	return (((unsigned char *)addr) >= from_space.start
+		&& ((unsigned char *)addr) < from_space.end);
+}
+
+static bool
+in_to_space(void *addr)
+{
+	return (((unsigned char *)addr) >= to_space.start
+		&& ((unsigned char *)addr) < to_space.end);
+}
+
+//e Is `addr' in a space that the current collection evacuates?
+static bool
+in_collected_space(void *addr)
+{
+	return (in_nursery(addr) && !gc_old_space_only) || (gc_major && in_from_space(addr));
+}
+
+static void *
+get_forwarding_pointer(void *addr)
+{
+	return *((void **)addr);
+}
+
+static void
+set_forwarding_pointer(void *addr, void *reloc_addr)
+{
+	*((void **)addr) = reloc_addr;
+}
+
+//e computes the size of `obj', given its class (which may differ from `obj->classref' once `obj' has been forwarded)
+static size_t
+object_size_with_class(object_t *obj, class_t *classref)
+{
+	const int BLOCKSIZE = sizeof(object_member_t);
+
+	if (classref == &class_string) {
+		size_t strlen = obj->fields[0].int_v;
+		size_t blocklen = (strlen + (BLOCKSIZE - 1)) & ~(BLOCKSIZE - 1);
+		return BLOCKSIZE + blocklen + sizeof(object_t);
+	} else if (classref == &class_array) {
+		return ((obj->fields[0].int_v + 1) * BLOCKSIZE) + sizeof(object_t);
+	} else if (classref == FILLER_WORD) {
+		return sizeof(object_t);
+	} else if (classref == FILLER_BLOCK) {
+		return obj->fields[0].int_v;
+	} else {
+		return (classref->id->storage.fields_nr * BLOCKSIZE) + sizeof(object_t);
+	}
+}
+
+static size_t
+object_size(object_t *obj)
+{
+	return object_size_with_class(obj, obj->classref);
+}
+
+//e fills the old space range [start, end) with a filler object
+static void
+gc_fill(unsigned char *start, unsigned char *end)
+{
+	if (start == end) {
+		return;
+	}
+	object_t *filler = (object_t *) start;
+	if (end - start == sizeof(object_t)) {
+		filler->classref = FILLER_WORD;
+	} else {
+		filler->classref = FILLER_BLOCK;
+		filler->fields[0].int_v = end - start;
+	}
+	old_space_note_object(start);
+}
+
+static void
+gc_move_parallel(gc_worker_t *worker, object_t **memref);
+
+static void
+gc_deque_push(gc_deque_t *deque, object_t *obj);
+
+//e major collections only: marks a large object and queues it for scanning
+static void
+gc_mark_large(gc_worker_t *worker, object_t *obj)
+{
+	large_object_t *large = large_object_lookup(obj);
+	if (!atomic_exchange(&large->marked, true)) {
+		if (worker) {
+			gc_deque_push(&worker->deque, obj);
+		} else {
+			stack_push(large_space.grey, &obj);
+		}
+	}
+}
+
+//e reports a reference that points into no heap space (with -f debug-gc)
+static void
+gc_report_weird_addr(object_t *obj)
+{
+	if (compiler_options.debug_gc) {
+		fprintf(stderr, "[GC: Trying to relocate weird addr %p]\n", obj);
+	}
+}
+
+/*e
+ * Keeps a nursery object that does not fit into old space in the nursery
+ *
+ * The collector scans retained objects like copied ones; gc_nursery_compact() later moves
+ * them to the start of the nursery.  Old space cards that reference them stay dirty, so that
+ * gc_nursery_compact() and the next minor collection find those references.
+ */
+static void
+gc_retain(object_t **memref, size_t obj_size)
+{
+	object_t *obj = *memref;
+	if (!in_nursery(obj)) {
+		//e cannot happen: we only collect old space when the whole of it fits into to_space
+		fprintf(stderr, "Error: out of memory (old space exhausted during garbage collection)\n");
+		exit(1);
+	}
+	if (!gc_is_marked(obj)) {
+		gc_mark_words((unsigned char *) obj, obj_size);
+		stack_push(large_space.grey, &obj);
+		gc_nursery_retained = true;
+	}
+	heap_write_barrier(memref);
+}
+
+/*e
+ * Evacuates the object that `memref' points to (if needed) and updates `memref'
+ *
+ * @param worker The current worker in a parallel collection, or NULL
+ * @param memref The reference to update
+ */
+static void
+gc_move(gc_worker_t *worker, object_t **memref)
+{
+	//e NULL, tagged ints (cf. object.h) and stack-allocated objects do not reference heap objects
+	if (!*memref || OBJECT_IS_TAGGED_INT(*memref) || !in_heap(*memref)) {
+		return;
+	}
+	if (gc_compact_phase != GC_COMPACT_OFF) {
+		gc_compact_visit(memref);
+		return;
+	}
+	if (in_large_space(*memref)) {
+		if (gc_major) {
+			gc_mark_large(worker, *memref);
+		}
+		return;
+	}
+	if (worker) {
+		gc_move_parallel(worker, memref);
+		return;
+	}
+	if (in_collected_space(*memref)) {
+		void *reloc = get_forwarding_pointer(*memref);
+		if (in_to_space(reloc)) {
+			// already relocated
+			*memref = reloc;
+			return;
+		}
+
+		size_t obj_size = object_size(*memref);
+		if (old_free_pointer + obj_size > to_space.end) {
+			gc_retain(memref, obj_size);
+			return;
+		}
+		reloc = old_free_pointer;
+		old_free_pointer += obj_size;
+		memcpy(reloc, *memref, obj_size);
+		old_space_note_object(reloc);
+		debug(" - [%p -> %p (%s, %zu bytes)]\n", *memref, reloc, (*memref)->classref->id->name, obj_size);
+		set_forwarding_pointer(*memref, reloc);
+	        *memref = reloc;
+	} else if (in_nursery(*memref)) {
+		//e the nursery stays in place during this collection
+		heap_write_barrier(memref);
+	} else if (!in_to_space(*memref)) {
+		gc_report_weird_addr(*memref);
+	}
+}
+
+//e moves all objects referenced from `obj' that are stored in the address range [low, high)
+static void
+gc_scan_object(gc_worker_t *worker, object_t *obj, unsigned char *low, unsigned char *high)
+{
+	if (obj->classref == &class_array) {
+		object_t **elements = &obj->fields[1].object_v;
+		long long int start = 0;
+		long long int end = obj->fields[0].int_v;
+		if ((unsigned char *) elements < low) {
+			start = (low - (unsigned char *) elements) / sizeof(object_member_t);
+		}
+		if ((unsigned char *) (elements + end) > high) {
+			//e the elements may start after `high' (if only the header is in range)
+			end = 0;
+			if (high > (unsigned char *) elements) {
+				end = (high - (unsigned char *) elements + sizeof(object_member_t) - 1) / sizeof(object_member_t);
+			}
+		}
+		for (long long int i = start; i < end; i++) {
+			gc_move(worker, elements + i);
+		}
+	} else if (obj->classref != &class_string
+		   && obj->classref != FILLER_WORD
+		   && obj->classref != FILLER_BLOCK) {
+		bitvector_t classmap = obj->classref->object_map;
+		for (int i = 0; i < bitvector_size(classmap); i++) {
+			unsigned char *slot = (unsigned char *) &obj->fields[i].object_v;
+			if (BITVECTOR_IS_SET(classmap, i)
+			    && slot >= low && slot < high) {
+				gc_move(worker, &obj->fields[i].object_v);
+			}
+		}
+	}
+}
+
+static void
+gc_init()
+{
+	if (gc_major && !compiler_options.gc_mark_compact) {
+		swap_semispaces();
+		old_free_pointer = to_space.start;
+		memset(card_object_starts + card_index(to_space.start), CARD_NO_OBJECT,
+		       card_index(to_space.end) - card_index(to_space.start));
+	}
+}
+
+static void
+gc_scan_static(gc_worker_t *worker, runtime_image_t *img, int index)
+{
+	if (SYMTAB_TYPE(symtab_lookup(img->globals[index])) == TYPE_OBJ) {
+		gc_move(worker, (object_t **) &(img->static_memory[index]));
+	}
+}
+
+static void
+gc_rootset_static()
+{
+	runtime_image_t *img = runtime_current();
+	debug(" <static memory: %d>\n", img->globals_nr);
+	for (int i = 0; i < img->globals_nr; i++) {
+		gc_scan_static(NULL, img, i);
+	}
+}
+
+/*e
+ * Moves all objects referenced from one stack frame
+ *
+ * @param frame_pointer The frame pointer of the frame
+ * @param return_addr The address that the frame's callee will return to
+ */
+static void
+gc_scan_frame(gc_worker_t *worker, void **frame_pointer, void *return_addr)
+{
+	debug(" <stack: %p @%p>: ", frame_pointer, return_addr);
+	symtab_entry_t *symtab_entry;
+	bitvector_t stackmap;
+	int frame_start;
+	if (stackmap_get(return_addr, &stackmap, &symtab_entry, &frame_start)) {
+		object_t **obj = (object_t **) frame_pointer;
+		size_t stackmap_size = bitvector_size(stackmap);
+		int offset = frame_start / 8;
+#ifdef DEBUG
+		if (symtab_entry) {
+			symtab_entry_name_dump(stdout, symtab_entry);
+		} else {
+			debug("<main entry point>");
+		}
+		debug(": ");
+		bitvector_print(stdout, stackmap);
+		debug(" at offset %d\n", offset);
+#endif
+
+		obj += offset;
+		for (int i = 0; i < stackmap_size; i++) {
+			if (BITVECTOR_IS_SET(stackmap, i)) {
+				gc_move(worker, obj + i);
+			}
+		}
+	} else {
+		debug(" (unknown)\n");
+	}
+}
+
+//e iterates over all stack frames between `frame_pointer' and heap_root_frame_pointer
+#define FOREACH_FRAME(frame_pointer, FRAME, RETURN_ADDR)		\
+	for (void **FRAME = (void **) (frame_pointer), *RETURN_ADDR = NULL; \
+	     FRAME != heap_root_frame_pointer				\
+		     && (RETURN_ADDR = FRAME[1], FRAME = (void **) *FRAME, true); )
+
+static void
+gc_rootset_stack(void *frame_pointer)
+{
+	FOREACH_FRAME(frame_pointer, seeker, return_addr) {
+		gc_scan_frame(NULL, seeker, return_addr);
+	}
+}
+
+/*e
+ * Minor collections only: treats all references from one dirty old-space card as roots
+ *
+ * @param limit End of the old space objects that existed before the current collection
+ */
+static void
+gc_scan_card(gc_worker_t *worker, size_t card, unsigned char *limit)
+{
+	const size_t first_card = card_index(to_space.start);
+	unsigned char *card_start = card_address(card);
+	unsigned char *card_end = card_start + CARD_SIZE;
+
+	//e find the object that covers the start of this card
+	size_t start_card = card;
+	if (card_object_starts[card] != 0) {
+		while (start_card > first_card
+		       && (start_card == card || card_object_starts[start_card] == CARD_NO_OBJECT)) {
+			--start_card;
+		}
+	}
+	if (card_object_starts[start_card] == CARD_NO_OBJECT) {
+		return; //e no objects here (yet)
+	}
+	unsigned char *scan = card_address(start_card) + card_object_starts[start_card] * sizeof(object_member_t);
+
+	while (scan < card_end && scan < limit) {
+		object_t *obj = (object_t *) scan;
+		size_t obj_size = object_size(obj);
+		if (scan + obj_size > card_start) {
+			gc_scan_object(worker, obj, card_start, card_end);
+		}
+		scan += obj_size;
+	}
+}
+
+//e minor collections only: treats all references from one dirty large object space card as roots
+static void
+gc_scan_large_card(gc_worker_t *worker, size_t card)
+{
+	unsigned char *card_start = card_address(card);
+	large_object_t *large = large_object_lookup(card_start);
+	if (large) {
+		object_t *obj = large_object_address(large);
+		if (card_start < ((unsigned char *) obj) + object_size(obj)) {
+			gc_scan_object(worker, obj, card_start, card_start + CARD_SIZE);
+		}
+	}
+}
+
+static void
+gc_rootset_cards(unsigned char *limit)
+{
+	const size_t first_card = card_index(to_space.start);
+	const size_t end_card = card_index(limit + CARD_SIZE - 1);
+	debug(" <cards: %zu>\n", end_card - first_card);
+
+	for (size_t card = first_card; card < end_card; card++) {
+		if (card_table[card]) {
+			gc_scan_card(NULL, card, limit);
+		}
+	}
+	for (size_t card = card_index(large_space.start); card < card_index(large_space.end); card++) {
+		if (card_table[card]) {
+			gc_scan_large_card(NULL, card);
+		}
+	}
+}
+
+//e collections with gc_old_space_only: treats all references from the nursery as roots
+static void
+gc_rootset_nursery(void)
+{
+	debug(" <nursery: %zu bytes>\n", (size_t) (heap_free_pointer - nursery.start));
+	for (unsigned char *scan = nursery.start; scan < heap_free_pointer; ) {
+		object_t *obj = (object_t *) scan;
+		size_t obj_size = object_size(obj);
+		gc_scan_object(NULL, obj, scan, scan + obj_size);
+		scan += obj_size;
+	}
+}
+
+static void
+gc_do_scan(unsigned char *scan)
+{
+	debug(" <scan>\n");
+	while (true) {
+		while ((unsigned char *) scan < old_free_pointer) {
+			object_t *obj = (object_t *) scan;
+			size_t obj_size = object_size(obj);
+			gc_scan_object(NULL, obj, scan, scan + obj_size);
+			scan += obj_size;
+		}
+		object_t **grey = stack_pop(large_space.grey);
+		if (!grey) {
+			return;
+		}
+		object_t *obj = *grey;
+		gc_scan_object(NULL, obj, (unsigned char *) obj, ((unsigned char *) obj) + object_size(obj));
+	}
+}
+
+//e frees all unmarked large objects and clears the marks of all others
+static void
+gc_sweep_large(void)
+{
+	large_object_t **link = &large_space.objects;
+	while (*link) {
+		large_object_t *large = *link;
+		if (atomic_load(&large->marked)) {
+			atomic_store(&large->marked, false);
+			link = &large->next;
+		} else {
+			*link = large->next;
+			object_t *obj = large_object_address(large);
+			debug(" - [free large %p (%zu pages)]\n", obj, large->pages_nr);
+			heap_release((unsigned char *) obj, ((unsigned char *) obj) + large->pages_nr * PAGE_SIZE);
+			for (size_t i = 0; i < large->pages_nr; i++) {
+				large_space.page_owners[large->first_page + i] = NULL;
+			}
+			large_space.free_pages_nr += large->pages_nr;
+			free(large);
+		}
+	}
+}
+
+// --------------------------------------------------------------------------------
+// parallel collection
+
+static gc_deque_array_t *
+gc_deque_array_new(long long size, gc_deque_array_t *previous)
+{
+	gc_deque_array_t *array = malloc(sizeof(gc_deque_array_t) + size * sizeof(_Atomic(object_t *)));
+	if (!array) {
+		fprintf(stderr, "Error: out of memory (garbage collector work queue)\n");
+		exit(1);
+	}
+	array->size = size;
+	array->previous = previous;
+	return array;
+}
+
+static void
+gc_deque_init(gc_deque_t *deque)
+{
+	atomic_init(&deque->top, 0);
+	atomic_init(&deque->bottom, 0);
+	atomic_init(&deque->array, gc_deque_array_new(GC_DEQUE_INITIAL_SIZE, NULL));
+}
+
+static void
+gc_deque_free(gc_deque_t *deque)
+{
+	gc_deque_array_t *array = atomic_load(&deque->array);
+	while (array) {
+		gc_deque_array_t *previous = array->previous;
+		free(array);
+		array = previous;
+	}
+}
+
+//e owner only
+static void
+gc_deque_push(gc_deque_t *deque, object_t *obj)
+{
+	long long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+	long long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+	gc_deque_array_t *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+	if (bottom - top > array->size - 1) {
+		//e full: grow
+		gc_deque_array_t *new_array = gc_deque_array_new(array->size << 1, array);
+		for (long long i = top; i < bottom; i++) {
+			object_t *elt = atomic_load_explicit(&array->elements[i & (array->size - 1)], memory_order_relaxed);
+			atomic_store_explicit(&new_array->elements[i & (new_array->size - 1)], elt, memory_order_relaxed);
+		}
+		atomic_store_explicit(&deque->array, new_array, memory_order_release);
+		array = new_array;
+	}
+	atomic_store_explicit(&array->elements[bottom & (array->size - 1)], obj, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+}
+
+//e owner only; returns NULL if empty
+static object_t *
+gc_deque_take(gc_deque_t *deque)
+{
+	long long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+	gc_deque_array_t *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+	atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	long long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+	object_t *obj = NULL;
+	if (top <= bottom) {
+		obj = atomic_load_explicit(&array->elements[bottom & (array->size - 1)], memory_order_relaxed);
+		if (top == bottom) {
+			//e last element: race against thieves
+			if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+								     memory_order_seq_cst, memory_order_relaxed)) {
+				obj = NULL;
+			}
+			atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+		}
+	} else {
+		atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+	}
+	return obj;
+}
+
+//e any worker; returns NULL if empty or if we lost a race
+static object_t *
+gc_deque_steal(gc_deque_t *deque)
+{
+	long long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	long long bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+	if (top < bottom) {
+		gc_deque_array_t *array = atomic_load_explicit(&deque->array, memory_order_acquire);
+		object_t *obj = atomic_load_explicit(&array->elements[top & (array->size - 1)], memory_order_relaxed);
+		if (atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+							    memory_order_seq_cst, memory_order_relaxed)) {
+			return obj;
+		}
+	}
+	return NULL;
+}
 
-static unsigned char *heap_base = NULL;
-static size_t heap_size_total;
-static unsigned char *heap_free_pointer = NULL;
+static bool
+gc_deque_is_empty(gc_deque_t *deque)
+{
+	return atomic_load_explicit(&deque->top, memory_order_acquire)
+		>= atomic_load_explicit(&deque->bottom, memory_order_acquire);
+}
 
-static semispace_t to_space = { NULL, NULL };
-static semispace_t from_space = { NULL, NULL };
+//e allocates `size' bytes in the worker's copy buffer, fetching a new buffer if needed
+static unsigned char *
+gc_worker_allocate(gc_worker_t *worker, size_t size)
+{
+	if (worker->copy_free + size > worker->copy_end) {
+		gc_fill(worker->copy_free, worker->copy_end);
 
+		size_t buffer_size = GC_COPY_BUFFER_SIZE;
+		if (size > buffer_size) {
+			buffer_size = (size + CARD_SIZE - 1) & ~(CARD_SIZE - 1);
+		}
+		unsigned char *buffer = (unsigned char *) atomic_fetch_add(&gc_parallel.free_pointer, buffer_size);
+		if (buffer + buffer_size > to_space.end) {
+			fprintf(stderr, "Error: out of memory (old space exhausted during garbage collection)\n");
+			exit(1);
+		}
+		worker->copy_free = buffer;
+		worker->copy_end = buffer + buffer_size;
+	}
+	unsigned char *addr = worker->copy_free;
+	worker->copy_free += size;
+	return addr;
+}
 
-void
-heap_init(size_t requested_heap_size)
+static void
+gc_move_parallel(gc_worker_t *worker, object_t **memref)
 {
-	//e we allocate the heap only once:
-	assert(!heap_base);
-	heap_size_total = requested_heap_size;
+	object_t *obj = *memref;
+	if (!in_collected_space(obj)) {
+		if (!in_to_space(obj)) {
+			gc_report_weird_addr(obj);
+		}
+		return;
+	}
 
-	//e Make sure that heap_size is a multiple of PAGE_SIZE, as most systems require that property
-	if (heap_size_total & (PAGE_SIZE - 1)) {
-		heap_size_total = (heap_size_total + PAGE_SIZE) & ~(PAGE_SIZE -1);
+	_Atomic(class_t *) *header = (_Atomic(class_t *) *) &obj->classref;
+	class_t *classref = atomic_load_explicit(header, memory_order_acquire);
+	if (in_to_space(classref)) {
+		// already relocated
+		*memref = (object_t *) classref;
+		return;
 	}
 
-	heap_base = mmap((void *) HEAP_START,
-			 heap_size_total,
-			 PROT_READ | PROT_WRITE,
-			 MAP_PRIVATE | MAP_ANONYMOUS,
-			 -1,
-			 0);
-	if (heap_base == MAP_FAILED) {
-		perror("heap segment mmap");
-		exit(1);
+	//e copy speculatively, then try to install the forwarding pointer
+	size_t obj_size = object_size_with_class(obj, classref);
+	object_t *reloc = (object_t *) gc_worker_allocate(worker, obj_size);
+	memcpy(reloc, obj, obj_size);
+	reloc->classref = classref;
+
+	if (atomic_compare_exchange_strong_explicit(header, &classref, (class_t *) reloc,
+						    memory_order_acq_rel, memory_order_acquire)) {
+		old_space_note_object((unsigned char *) reloc);
+		gc_deque_push(&worker->deque, reloc);
+		*memref = reloc;
+	} else {
+		//e another worker was faster: `classref' is now its forwarding pointer; undo our copy
+		worker->copy_free = (unsigned char *) reloc;
+		*memref = (object_t *) classref;
 	}
+}
 
-	if (!heap_base) {
-		// Out of memory
-		fprintf(stderr, "Cannot allocate heap; out of memory\n");
-		exit(1);
+static object_t *
+gc_worker_steal(gc_worker_t *worker)
+{
+	const int workers_nr = gc_parallel.workers_nr;
+	worker->random_state = worker->random_state * 1103515245 + 12345;
+	const int start = (worker->random_state >> 16) % workers_nr;
+
+	for (int i = 0; i < workers_nr; i++) {
+		gc_worker_t *victim = &gc_parallel.workers[(start + i) % workers_nr];
+		if (victim != worker) {
+			object_t *obj = gc_deque_steal(&victim->deque);
+			if (obj) {
+				return obj;
+			}
+		}
 	}
+	return NULL;
+}
 
-	//e Copying GC: split heap into two semispaces
-	to_space.start = heap_base;
-	to_space.end = heap_base + (heap_size_total >> 1);
-	from_space.start = to_space.end;
-	from_space.end = heap_base + heap_size_total;
+static bool
+gc_work_available(void)
+{
+	for (int i = 0; i < gc_parallel.workers_nr; i++) {
+		if (!gc_deque_is_empty(&gc_parallel.workers[i].deque)) {
+			return true;
+		}
+	}
+	return false;
+}
 
-	heap_free_pointer = to_space.start;
+//e claims the next block of GC_ROOTS_BLOCK root indices; returns false once `max' is reached
+static bool
+gc_claim_roots(atomic_size_t *counter, size_t max, size_t *start, size_t *end)
+{
+	*start = atomic_fetch_add(counter, GC_ROOTS_BLOCK);
+	*end = *start + GC_ROOTS_BLOCK;
+	if (*end > max) {
+		*end = max;
+	}
+	return *start < max;
 }
 
-void
-heap_free()
+static void *
+gc_worker_run(void *_worker)
 {
-	if (heap_base) {
-		munmap(heap_base, heap_size_total);
-		heap_base = heap_free_pointer = NULL;
+	gc_worker_t *worker = (gc_worker_t *) _worker;
+	size_t start, end;
+
+	//e roots
+	runtime_image_t *img = runtime_current();
+	while (gc_claim_roots(&gc_parallel.next_static, img->globals_nr, &start, &end)) {
+		for (size_t i = start; i < end; i++) {
+			gc_scan_static(worker, img, i);
+		}
+	}
+	while (gc_claim_roots(&gc_parallel.next_frame, stack_size(gc_parallel.frames), &start, &end)) {
+		for (size_t i = start; i < end; i++) {
+			gc_frame_t *frame = (gc_frame_t *) stack_get(gc_parallel.frames, i);
+			gc_scan_frame(worker, frame->frame_pointer, frame->return_addr);
+		}
+	}
+	if (!gc_major) {
+		const size_t first_card = card_index(to_space.start);
+		const size_t end_card = card_index(gc_parallel.old_limit + CARD_SIZE - 1);
+		while (gc_claim_roots(&gc_parallel.next_card, end_card - first_card, &start, &end)) {
+			for (size_t card = first_card + start; card < first_card + end; card++) {
+				if (card_table[card]) {
+					gc_scan_card(worker, card, gc_parallel.old_limit);
+				}
+			}
+		}
+		const size_t first_large_card = card_index(large_space.start);
+		const size_t end_large_card = card_index(large_space.end);
+		while (gc_claim_roots(&gc_parallel.next_large_card, end_large_card - first_large_card, &start, &end)) {
+			for (size_t card = first_large_card + start; card < first_large_card + end; card++) {
+				if (card_table[card]) {
+					gc_scan_large_card(worker, card);
+				}
+			}
+		}
+	}
+
+	//e scan grey objects until no worker has any left
+	while (true) {
+		object_t *obj = gc_deque_take(&worker->deque);
+		if (!obj) {
+			obj = gc_worker_steal(worker);
+		}
+		if (obj) {
+			gc_scan_object(worker, obj, (unsigned char *) obj, ((unsigned char *) obj) + object_size(obj));
+			continue;
+		}
+
+		//e idle: terminate once all workers are idle, unless new work shows up
+		atomic_fetch_add(&gc_parallel.idle_workers, 1);
+		while (!gc_work_available()) {
+			if (atomic_load(&gc_parallel.idle_workers) == gc_parallel.workers_nr) {
+				return NULL;
+			}
+			sched_yield();
+		}
+		atomic_fetch_sub(&gc_parallel.idle_workers, 1);
 	}
 }
 
-//e handle out-of-memory situations
+/*e
+ * Parallel alternative to scanning the root set and the grey objects
+ *
+ * @param frame_pointer Frame pointer of the failed invocation to heap_allocate_object
+ * @param old_limit End of the old space objects that existed before the current collection
+ */
 static void
-handle_out_of_memory(void *frame_pointer);
-
-object_t *
-heap_allocate_object(class_t* type, size_t fields_nr)
+gc_parallel_collect(void *frame_pointer, unsigned char *old_limit)
 {
-	object_t *obj = (object_t *) heap_free_pointer;
-	size_t requested_bytes = sizeof(object_t) + (fields_nr * sizeof(object_member_t));
-	heap_free_pointer += requested_bytes;
+	int workers_nr = compiler_options.gc_threads;
+	if (workers_nr > GC_THREADS_MAX) {
+		workers_nr = GC_THREADS_MAX;
+	}
+	gc_parallel.workers_nr = workers_nr;
 
-	//	fprintf(stderr, "alloc(%s, %zu * %zu) : ", type->id->name, fields_nr, sizeof(object_member_t));
-	
-	if (heap_free_pointer >= to_space.end) {
-		heap_free_pointer -= requested_bytes;
-		//e __builtin_frame_address(0) reads the $fp
-		handle_out_of_memory(__builtin_frame_address(0));
-		if (heap_available() < requested_bytes) {
-			fprintf(stderr, "Out of memory: insufficient space for %zu bytes (%zu fields) (allocated: %zu of %zu bytes)\n", requested_bytes, fields_nr, heap_available(), heap_size());
+	//e copy buffers start at card boundaries, so that workers never share cards
+	unsigned char *start = (unsigned char *) ((((uintptr_t) old_free_pointer) + CARD_SIZE - 1) & ~((uintptr_t) CARD_SIZE - 1));
+	gc_fill(old_free_pointer, start);
+	atomic_store(&gc_parallel.free_pointer, (uintptr_t) start);
+	gc_parallel.old_limit = old_limit;
+	atomic_store(&gc_parallel.idle_workers, 0);
+	atomic_store(&gc_parallel.next_static, 0);
+	atomic_store(&gc_parallel.next_frame, 0);
+	atomic_store(&gc_parallel.next_card, 0);
+	atomic_store(&gc_parallel.next_large_card, 0);
+
+	gc_parallel.frames = stack_alloc(sizeof(gc_frame_t), 64);
+	FOREACH_FRAME(frame_pointer, seeker, return_addr) {
+		gc_frame_t frame = { .frame_pointer = seeker, .return_addr = return_addr };
+		stack_push(gc_parallel.frames, &frame);
+	}
+
+	for (int i = 0; i < workers_nr; i++) {
+		gc_worker_t *worker = &gc_parallel.workers[i];
+		gc_deque_init(&worker->deque);
+		worker->copy_free = worker->copy_end = NULL;
+		worker->random_state = i + 1;
+	}
+
+	//e worker 0 is the current thread
+	for (int i = 1; i < workers_nr; i++) {
+		int error = pthread_create(&gc_parallel.workers[i].thread, NULL, gc_worker_run, &gc_parallel.workers[i]);
+		if (error) {
+			fprintf(stderr, "Error: cannot start garbage collector thread: %s\n", strerror(error));
 			exit(1);
 		}
-		//e handled successfully; recurse to minimise risk of accidental bug
-		return heap_allocate_object(type, fields_nr);
 	}
-	obj->classref = type;
-	/* fprintf(stderr, "alloc(%s, %zu * %zu) -> %p\n", type->id->name, fields_nr, sizeof(object_member_t), obj); */
-	return obj;
+	gc_worker_run(&gc_parallel.workers[0]);
+	for (int i = 1; i < workers_nr; i++) {
+		pthread_join(gc_parallel.workers[i].thread, NULL);
+	}
+
+	//e retire copy buffers; if a buffer is at the end of old space, we can release its unused part
+	unsigned char *end = (unsigned char *) atomic_load(&gc_parallel.free_pointer);
+	for (int i = 0; i < workers_nr; i++) {
+		gc_worker_t *worker = &gc_parallel.workers[i];
+		if (worker->copy_end && worker->copy_end == end) {
+			//e may contain leftovers from lost forwarding races
+			memset(worker->copy_free, 0, end - worker->copy_free);
+			end = worker->copy_free;
+		} else {
+			gc_fill(worker->copy_free, worker->copy_end);
+		}
+		gc_deque_free(&worker->deque);
+	}
+	old_free_pointer = end;
+
+	stack_free(gc_parallel.frames, NULL);
+	gc_parallel.frames = NULL;
 }
 
-size_t
-heap_available(void)
+// --------------------------------------------------------------------------------
+// mark-compact collection
+
+static void
+gc_mark_words(unsigned char *start, size_t size)
 {
-	return to_space.end - heap_free_pointer;
+	for (size_t offset = 0; offset < size; offset += sizeof(object_member_t)) {
+		size_t word = (start + offset - heap_base) / sizeof(object_member_t);
+		mark_bits[word >> 6] |= 1ull << (word & 63);
+	}
 }
 
-size_t
-heap_size(void)
+static bool
+gc_is_marked(void *addr)
 {
-	return to_space.end - to_space.start;
+	size_t word = (((unsigned char *) addr) - heap_base) / sizeof(object_member_t);
+	return mark_bits[word >> 6] & (1ull << (word & 63));
 }
 
-// ================================================================================
-// garbage collector implementation
-
-// Swaps contents of to_space and from_space.
-static void
-swap_semispaces(void)
+//e computes the post-compaction address of the live object at `addr'
+static object_t *
+gc_compact_forward(void *addr)
 {
-	semispace_t buf = to_space;
-	to_space = from_space;
-	from_space = buf;
+	//e retained nursery objects move to the start of the nursery, all others to the start of old space
+	unsigned char *base = gc_nursery_retained && in_nursery(addr) ? nursery.start : to_space.start;
+	size_t card = card_index(addr);
+	size_t bit = (((unsigned char *) addr) - card_address(card)) / sizeof(object_member_t);
+	size_t live_words = __builtin_popcountll(mark_bits[card] & ((1ull << bit) - 1));
+	return (object_t *) (base + card_live_before[card] + live_words * sizeof(object_member_t));
 }
 
-static bool
-in_from_space(void *addr)
+static void
+gc_compact_visit(object_t **memref)
 {
-	return (((unsigned char *)addr) >= from_space.start
-		&& ((unsigned char *)addr) < from_space.end);
+	object_t *obj = *memref;
+	if (in_large_space(obj)) {
+		if (gc_compact_phase == GC_COMPACT_MARK) {
+			gc_mark_large(NULL, obj);
+		}
+	} else if (in_nursery(obj) || in_to_space(obj)) {
+		if (gc_compact_phase == GC_COMPACT_UPDATE) {
+			//e (gc_nursery_compact() only moves the marked nursery objects)
+			if (gc_is_marked(obj)) {
+				*memref = gc_compact_forward(obj);
+			}
+			if (in_nursery(*memref)) {
+				heap_write_barrier(memref);
+			}
+		} else if (!gc_is_marked(obj)) {
+			gc_mark_words((unsigned char *) obj, object_size(obj));
+			stack_push(large_space.grey, &obj);
+		}
+	} else {
+		gc_report_weird_addr(obj);
+	}
 }
 
-static bool
-in_to_space(void *addr)
+//e counts live bytes per card, in compaction order; returns the total
+static size_t
+gc_compact_count(unsigned char *start, unsigned char *end, size_t live)
 {
-	return (((unsigned char *)addr) >= to_space.start
-		&& ((unsigned char *)addr) < to_space.end);
+	for (size_t card = card_index(start); card < card_index(end + CARD_SIZE - 1); card++) {
+		card_live_before[card] = live;
+		live += __builtin_popcountll(mark_bits[card]) * sizeof(object_member_t);
+	}
+	return live;
 }
 
-static void *
-get_forwarding_pointer(void *addr)
+//e applies `f' to all marked objects in [start, end)
+static void
+gc_compact_foreach(unsigned char *start, unsigned char *end, void (*f)(object_t *, size_t))
 {
-	return *((void **)addr);
+	unsigned char *scan = start;
+	while (scan < end) {
+		object_t *obj = (object_t *) scan;
+		//e after a copying collection, the nursery copies of promoted objects hold forwarding pointers
+		object_t *reloc = get_forwarding_pointer(obj);
+		size_t obj_size = object_size(in_to_space(reloc) ? reloc : obj);
+		if (gc_is_marked(obj)) {
+			f(obj, obj_size);
+		}
+		scan += obj_size;
+	}
 }
 
 static void
-set_forwarding_pointer(void *addr, void *reloc_addr)
+gc_compact_update_object(object_t *obj, size_t obj_size)
 {
-	*((void **)addr) = reloc_addr;
+	gc_scan_object(NULL, obj, (unsigned char *) obj, ((unsigned char *) obj) + obj_size);
 }
 
-static size_t
-object_size(object_t *obj)
+static void
+gc_compact_move_object(object_t *obj, size_t obj_size)
 {
-	const int BLOCKSIZE = sizeof(object_member_t);
-	
-	if (obj->classref == &class_string) {
-		size_t strlen = obj->fields[0].int_v;
-		size_t blocklen = (strlen + (BLOCKSIZE - 1)) & ~(BLOCKSIZE - 1);
-		return BLOCKSIZE + blocklen + sizeof(object_t);
-	} else if (obj->classref == &class_array) {
-		return ((obj->fields[0].int_v + 1) * BLOCKSIZE) + sizeof(object_t);
-	} else {
-		return (obj->classref->id->storage.fields_nr * BLOCKSIZE) + sizeof(object_t);
-	}
+	//e objects only ever move down within old space or the nursery, or from the nursery into old space
+	memmove(gc_compact_forward(obj), obj, obj_size);
 }
 
+/*e
+ * Major collection for compiler_options.gc_mark_compact: marks all live objects, then slides
+ * them (old space first, then the nursery) to the start of old space
+ *
+ * If the nursery survivors do not fit, they move to the start of the nursery instead (cf. gc_retain()).
+ *
+ * @param frame_pointer Frame pointer of the failed invocation to heap_allocate_object
+ */
 static void
-gc_move(object_t **memref)
+gc_mark_compact(void *frame_pointer)
 {
-	if (!*memref) {
-		return;
+	//e mark
+	gc_compact_phase = GC_COMPACT_MARK;
+	gc_rootset_static();
+	gc_rootset_stack(frame_pointer);
+	object_t **grey;
+	while ((grey = stack_pop(large_space.grey))) {
+		object_t *obj = *grey;
+		gc_scan_object(NULL, obj, (unsigned char *) obj, ((unsigned char *) obj) + object_size(obj));
 	}
-	if (in_from_space(*memref)) {
-		void *reloc = get_forwarding_pointer(*memref);
-		if (in_to_space(reloc)) {
-			// already relocated
-			*memref = reloc;
-			return;
-		}
 
-		reloc = heap_free_pointer;
-		size_t obj_size = object_size(*memref);
-		heap_free_pointer += obj_size;
-		assert(heap_free_pointer < to_space.end);
-		memcpy(reloc, *memref, obj_size);
-		debug(" - [%p -> %p (%s, %zu bytes)]\n", *memref, reloc, (*memref)->classref->id->name, obj_size);
-		set_forwarding_pointer(*memref, reloc);
-	        *memref = reloc;
+	//e compute new addresses
+	const size_t old_live = gc_compact_count(to_space.start, old_free_pointer, 0);
+	const size_t nursery_live = gc_compact_count(nursery.start, heap_free_pointer, 0);
+	gc_nursery_retained = old_live + nursery_live > to_space.end - to_space.start;
+	if (gc_nursery_retained) {
+		gc_nursery_retained_size = nursery_live;
 	} else {
-		printf("Trying to relocate weird addr %p\n", *memref);
+		gc_compact_count(nursery.start, heap_free_pointer, old_live);
+	}
+
+	//e update references
+	gc_compact_phase = GC_COMPACT_UPDATE;
+	gc_rootset_static();
+	gc_rootset_stack(frame_pointer);
+	gc_compact_foreach(to_space.start, old_free_pointer, gc_compact_update_object);
+	gc_compact_foreach(nursery.start, heap_free_pointer, gc_compact_update_object);
+	for (large_object_t *large = large_space.objects; large; large = large->next) {
+		if (atomic_load(&large->marked)) {
+			object_t *obj = large_object_address(large);
+			gc_compact_update_object(obj, object_size(obj));
+		}
+	}
+	gc_compact_phase = GC_COMPACT_OFF;
+
+	//e move
+	gc_compact_foreach(to_space.start, old_free_pointer, gc_compact_move_object);
+	gc_compact_foreach(nursery.start, heap_free_pointer, gc_compact_move_object);
+
+	unsigned char *old_end = old_free_pointer;
+	old_free_pointer = to_space.start + old_live + (gc_nursery_retained ? 0 : nursery_live);
+	heap_release(old_free_pointer, old_end);
+	//e (only touch the mark bits of committed memory)
+	memset(mark_bits + card_index(nursery.start), 0,
+	       (card_index(nursery.end) - card_index(nursery.start)) * sizeof(uint64_t));
+	memset(mark_bits + card_index(to_space.start), 0,
+	       (card_index(old_end + CARD_SIZE - 1) - card_index(to_space.start)) * sizeof(uint64_t));
+
+	if (gc_nursery_retained) {
+		//e the update phase marked the cards of references to retained objects before their holders moved
+		memset(card_table + card_index(to_space.start), 1,
+		       card_index(old_free_pointer + CARD_SIZE - 1) - card_index(to_space.start));
+	}
+
+	//e rebuild the crossing map
+	memset(card_object_starts + card_index(to_space.start), CARD_NO_OBJECT,
+	       card_index(to_space.end) - card_index(to_space.start));
+	for (unsigned char *scan = to_space.start; scan < old_free_pointer; scan += object_size((object_t *) scan)) {
+		old_space_note_object(scan);
 	}
 }
 
+/*e
+ * After a copying collection that retained nursery objects (cf. gc_retain()): slides them
+ * to the start of the nursery
+ *
+ * All references to retained objects are in roots, in dirty cards, or in retained objects.
+ *
+ * @param frame_pointer Frame pointer of the failed invocation to heap_allocate_object
+ */
 static void
-gc_init()
+gc_nursery_compact(void *frame_pointer)
 {
-	swap_semispaces();
-	heap_free_pointer = to_space.start;
+	gc_nursery_retained_size = gc_compact_count(nursery.start, heap_free_pointer, 0);
+
+	gc_compact_phase = GC_COMPACT_UPDATE;
+	gc_rootset_static();
+	gc_rootset_stack(frame_pointer);
+	gc_rootset_cards(old_free_pointer);
+	gc_compact_foreach(nursery.start, heap_free_pointer, gc_compact_update_object);
+	gc_compact_phase = GC_COMPACT_OFF;
+
+	gc_compact_foreach(nursery.start, heap_free_pointer, gc_compact_move_object);
+	memset(mark_bits + card_index(nursery.start), 0,
+	       (card_index(nursery.end) - card_index(nursery.start)) * sizeof(uint64_t));
 }
 
+//e clears the card table for all committed heap memory
 static void
-gc_rootset_static()
+heap_clear_cards(void)
 {
-	runtime_image_t *img = runtime_current();
-	debug(" <static memory: %d>\n", img->globals_nr);
-	for (int i = 0; i < img->globals_nr; i++) {
-		if (SYMTAB_TYPE(symtab_lookup(img->globals[i])) == TYPE_OBJ) {
-			gc_move((object_t **) &(img->static_memory[i]));
-		}
+	semispace_t *spaces[] = { &nursery, &to_space, &from_space };
+	for (int i = 0; i < 3; i++) {
+		memset(card_table + card_index(spaces[i]->start), 0,
+		       card_index(spaces[i]->end + CARD_SIZE - 1) - card_index(spaces[i]->start));
 	}
+	memset(card_table + card_index(large_space.start), 0,
+	       card_index(large_space.end) - card_index(large_space.start));
 }
 
-static void
-gc_rootset_stack(void *frame_pointer)
+static double
+timespec_seconds(struct timespec *time)
 {
-	void **seeker = (void **) frame_pointer;
-	while (seeker != heap_root_frame_pointer) {
-		void *return_addr = (void *)(seeker[1]);
-		seeker = (void **) *seeker;
-		debug(" <stack: %p @%p>: ", seeker, return_addr);
-		symtab_entry_t *symtab_entry;
-		bitvector_t stackmap;
-		if (stackmap_get(return_addr, &stackmap, &symtab_entry)) {
-			object_t **obj = (object_t **) seeker;
-			size_t stackmap_size = bitvector_size(stackmap);
-			int offset;
-
-			if (symtab_entry) {
-				offset = symtab_entry->stackframe_start / 8;
-			} else {
-				offset = -stackmap_size;
-			}
-#ifdef DEBUG
-			if (symtab_entry) {
-				symtab_entry_name_dump(stdout, symtab_entry);
-			} else {
-				debug("<main entry point>");
-			}
-			debug(": ");
-			bitvector_print(stdout, stackmap);
-			debug(" at offset %d\n", offset);
-#endif
+	return time->tv_sec + time->tv_nsec * 1e-9;
+}
 
-			obj += offset;
-			for (int i = 0; i < stackmap_size; i++) {
-				if (BITVECTOR_IS_SET(stackmap, i)) {
-					gc_move(obj + i);
-				}
-			}
-		} else {
-			debug(" (unknown)\n");
+/*e
+ * Grows or shrinks the heap after a major collection, according to the heap sizing policy
+ *
+ * @param gc_time_ratio Fraction of the time since the last major collection that we spent collecting
+ * @return true iff the heap grew
+ */
+static bool
+heap_adapt_size(double gc_time_ratio)
+{
+	large_space_trim();
+	const size_t live = (old_free_pointer - to_space.start)
+		+ (large_space.pages_nr - large_space.free_pages_nr) * PAGE_SIZE;
+	const size_t capacity = (to_space.end - to_space.start) + (large_space.end - large_space.start);
+
+	size_t target = heap_size_current;
+	if (live * 100 > capacity * HEAP_GROW_OCCUPANCY || gc_time_ratio * 100 > HEAP_GROW_GC_TIME) {
+		target = heap_next_size(heap_size_current);
+	} else if (live * 100 < capacity * HEAP_SHRINK_OCCUPANCY && gc_time_ratio * 100 < HEAP_SHRINK_GC_TIME) {
+		target = page_align(heap_size_current >> 1);
+		if (target < heap_size_minimum) {
+			target = heap_size_minimum;
 		}
 	}
+
+	const size_t previous = heap_size_current;
+	if (target == previous || !heap_resize(target)) {
+		return false;
+	}
+	return target > previous;
 }
 
+/*e
+ * Runs one collection, as selected by gc_major and gc_old_space_only
+ *
+ * @param frame_pointer Frame pointer of the failed invocation to heap_allocate_object
+ * @param parallel Whether to use compiler_options.gc_threads threads; these need more room in old space
+ */
 static void
-gc_do_scan()
+gc_collect(void *frame_pointer, bool parallel)
 {
-	debug(" <scan>\n");
-	unsigned char *scan = to_space.start;
-	while ((unsigned char *) scan < heap_free_pointer) {
-		object_t *obj = (object_t *) scan;
-		size_t obj_size = object_size(obj);
-		if (obj->classref == &class_array) {
-			for (int i = 0; i < obj->fields[0].int_v; i++) {
-				gc_move(&obj->fields[1 + i].object_v);
-			}
-		} else if (obj->classref != &class_string) {
-			bitvector_t classmap = obj->classref->object_map;
-			for (int i = 0; i < bitvector_size(classmap); i++) {
-				if (BITVECTOR_IS_SET(classmap, i)) {
-					gc_move(&obj->fields[i].object_v);
-				}
-			}
-		}
+	unsigned char *old_end = old_free_pointer;
 
-		scan += obj_size;
+	gc_init();
+	unsigned char *scan = old_free_pointer;
+	if (gc_major && compiler_options.gc_mark_compact) {
+		gc_mark_compact(frame_pointer);
+	} else if (gc_old_space_only) {
+		gc_rootset_static();
+		gc_rootset_stack(frame_pointer);
+		gc_rootset_nursery();
+		gc_do_scan(scan);
+	} else if (parallel) {
+		gc_parallel_collect(frame_pointer, scan);
+	} else {
+		gc_rootset_static();
+		gc_rootset_stack(frame_pointer);
+		if (!gc_major) {
+			gc_rootset_cards(scan);
+		}
+		gc_do_scan(scan);
+	}
+	if (gc_nursery_retained && !(gc_major && compiler_options.gc_mark_compact)) {
+		gc_nursery_compact(frame_pointer);
+	}
+	if (gc_major) {
+		gc_sweep_large();
+	}
+	if (gc_major && !compiler_options.gc_mark_compact) {
+		//e the old semispace is garbage now; the next major collection will find it zeroed
+		heap_release(from_space.start, old_end);
 	}
 }
 
+//e after a collection: continues allocation after the objects that it retained in the nursery, if any
+static void
+nursery_reset(void)
+{
+	heap_free_pointer = heap_allocation_limit = nursery.start + (gc_nursery_retained ? gc_nursery_retained_size : 0);
+}
+
 /*e
  * handle out-of-memory situations
  *
  * @param frame_pointer Frame pointer of the failed invocation to heap_allocate_object;
  * can be used to trace the parent frame pointers up to heap_root_frame_pointer
+ * @param major Whether to force a major collection
  */
 static void
-handle_out_of_memory(void *frame_pointer)
+handle_out_of_memory(void *frame_pointer, bool major)
 {
 	//fprintf(stderr, "Out of memory! Seeking from %p to %p\n", frame_pointer, heap_root_frame_pointer);
 	if (!heap_root_frame_pointer) {
@@ -348,25 +1942,94 @@ handle_out_of_memory(void *frame_pointer)
 		exit(1);
 	}
 
+	struct timespec gc_start;
+	clock_gettime(CLOCK_MONOTONIC, &gc_start);
+
+	//e A minor collection may have to promote the entire nursery (plus partially filled copy buffers, if parallel)
+	const size_t nursery_used = heap_free_pointer - nursery.start;
+	size_t promotion_reserve = nursery_used;
+	if (compiler_options.gc_threads > 1) {
+		promotion_reserve += (compiler_options.gc_threads + 1) * GC_COPY_BUFFER_SIZE;
+	}
+	gc_major = major
+		|| (to_space.end - old_free_pointer) < nursery_used;
+	//e if possible, make sure that everything could survive
+	const bool grown = gc_major && heap_grow_semispace((old_free_pointer - to_space.start) + promotion_reserve);
+	const bool collect_old = gc_major;
+	gc_nursery_retained = false;
+
 	size_t before = heap_available();
+	//e the nursery is zeroed lazily (cf. nursery_zero_more())
+	if (nursery_dirty_end < heap_free_pointer) {
+		nursery_dirty_end = heap_free_pointer;
+	}
 
-	gc_init();
-	gc_rootset_static();
-	gc_rootset_stack(frame_pointer);
-	gc_do_scan();
-	//e clear memory at end of stack frame
-	memset(heap_free_pointer, 0, to_space.end - heap_free_pointer);
+	const size_t old_used = old_free_pointer - to_space.start;
+	const size_t semispace_size = to_space.end - to_space.start;
+	if (gc_major && !compiler_options.gc_mark_compact && old_used + nursery_used > semispace_size) {
+		/*e
+		 * A copying major collection might not fit the survivors into the other semispace.
+		 * Promote what fits of the nursery in a minor collection, and retain the rest in the
+		 * nursery; then collect old space alone, which cannot run out of space, with the
+		 * retained objects as roots; then promote what now fits of the retained objects.
+		 */
+		gc_major = false;
+		gc_collect(frame_pointer, false);
+		nursery_reset();
+		//e the old space collection re-marks the cards of references to retained objects
+		heap_clear_cards();
+		gc_major = true;
+		gc_old_space_only = true;
+		gc_collect(frame_pointer, false);
+		gc_old_space_only = false;
+		if (gc_nursery_retained) {
+			gc_major = false;
+			gc_nursery_retained = false;
+			gc_collect(frame_pointer, false);
+		}
+	} else {
+		if (gc_major) {
+			//e major collections re-mark the cards of references to any objects that they retain in the nursery
+			heap_clear_cards();
+		}
+		gc_collect(frame_pointer, compiler_options.gc_threads > 1 && old_used + promotion_reserve <= semispace_size);
+	}
+
+	nursery_reset();
+	if (gc_nursery_retained) {
+		//e leave the cards dirty, in particular those that reference retained objects
+		if (compiler_options.debug_gc) {
+			fprintf(stderr, "[GC: Retained %zu bytes in the nursery]\n", (size_t) (heap_free_pointer - nursery.start));
+		}
+	} else {
+		heap_clear_cards();
+	}
+	gc_major = collect_old;
 
 	size_t after = heap_available();
+	//e parallel collections may leave gaps in old space, so we may lose space
+	size_t reclaimed = after > before ? after - before : 0;
 #if defined(INFO) || defined(DEBUG)
 	{
 #else
 	if (compiler_options.debug_gc) {
 #endif
-		fprintf(stderr, "[GC: Reclaimed %zu bytes]\n", after - before);
+		fprintf(stderr, "[GC%s: Reclaimed %zu bytes]\n", gc_major ? "" : " (minor)", reclaimed);
 	}
-	if (after - before == 0) {
-		fprintf(stderr, "Error: out of memory\n");
-		exit(1);
+
+	struct timespec gc_end;
+	clock_gettime(CLOCK_MONOTONIC, &gc_end);
+	gc_time += timespec_seconds(&gc_end) - timespec_seconds(&gc_start);
+	if (gc_major) {
+		const bool adapted = heap_adapt_size(gc_time / (timespec_seconds(&gc_end) - timespec_seconds(&gc_window_start)));
+		gc_time = 0.0;
+		gc_window_start = gc_end;
+
+		//e nothing reclaimed: grow, if we can
+		if (after == before && !grown && !adapted
+		    && (heap_size_current == heap_size_total || !heap_resize(heap_next_size(heap_size_current)))) {
+			fprintf(stderr, "Error: out of memory\n");
+			exit(1);
+		}
 	}
 }
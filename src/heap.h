@@ -33,15 +33,49 @@
 
 extern void *heap_root_frame_pointer; /*e points to the frame pointer of the loader stack frame */
 
+/*e
+ * Write barrier support: the heap is divided into cards of (1 << HEAP_CARD_SHIFT) bytes.  Any store
+ * of an object reference into a heap object must mark the card containing the updated slot, by
+ * writing a nonzero byte to
+ *
+ *   ((unsigned char *) heap_card_table_bias)[slot_address >> HEAP_CARD_SHIFT]
+ *
+ * so that minor collections can find references from old objects into the nursery.
+ */
+#define HEAP_CARD_SHIFT 9
+extern long long heap_card_table_bias;
+
+/*e
+ * Stack-allocated objects (cf. OPT_FLAG_STACK_ALLOCATE) lie outside of the reserved heap address range
+ * [heap_reserved_start, heap_reserved_end) and must not be passed to the write barrier.
+ */
+extern unsigned char *heap_reserved_start;
+extern unsigned char *heap_reserved_end;
+
+/*e
+ * Inline allocation support: objects of at most HEAP_INLINE_ALLOCATION_MAX bytes (and fewer than
+ * compiler_options.large_object_threshold bytes) may be allocated by bumping heap_free_pointer, as long as the result stays below heap_allocation_limit, and
+ * storing the `classref'.  The remaining fields of such objects are always zero.
+ * All other allocations must go through heap_allocate_object(), which also zeroes more of
+ * the nursery (and raises heap_allocation_limit) when needed.
+ */
+#define HEAP_INLINE_ALLOCATION_MAX 0x400
+extern unsigned char *heap_free_pointer;
+extern unsigned char *heap_allocation_limit;
+
 /*e
  * Creates the heap
  *
  * Note that the heap is not cleared initially.  Call heap_clear() before allocating.
  *
- * @param size_t Maximum heap size
+ * The heap reserves address space for `max_heap_size' bytes, but only commits memory
+ * as needed; it grows and shrinks after garbage collection.
+ *
+ * @param initial_heap_size Initial (and minimal) heap size
+ * @param max_heap_size Maximum heap size
  */
 void
-heap_init(size_t heap_size);
+heap_init(size_t initial_heap_size, size_t max_heap_size);
 
 /*e
  * Deallocates the heap
@@ -74,6 +108,14 @@ heap_free(void);
 object_t *
 heap_allocate_object(class_t* type, size_t fields_nr);
 
+/*e
+ * Write barrier for object references stored into heap objects by C code
+ *
+ * @param slot Address of the updated field or array element
+ */
+void
+heap_write_barrier(void *slot);
+
 /*e
  * Determines the amount of currently unallocated heap space, in bytes
  */
@@ -0,0 +1,83 @@
+/***************************************************************************
+  Copyright (C) 2015 Christoph Reichenbach
+
+
+ This program may be modified and copied freely according to the terms of
+ the GNU general public license (GPL), as long as the above copyright
+ notice and the licensing information contained herein are preserved.
+
+ Please refer to www.gnu.org for licensing details.
+
+ This work is provided AS IS, without warranty of any kind, expressed or
+ implied, including but not limited to the warranties of merchantability,
+ noninfringement, and fitness for a specific purpose. The author will not
+ be held liable for any damage caused by this work or derivatives of it.
+
+ By using this source code, you agree to the licensing terms as stated
+ above.
+
+
+ Please contact the maintainer for bug reports or inquiries.
+
+ Current Maintainer:
+
+    Christoph Reichenbach (CR) <creichen@gmail.com>
+
+***************************************************************************/
+
+#include <stdlib.h>
+
+#include "inline-cache.h"
+
+static inline_cache_t *inline_caches = NULL;
+
+inline_cache_t *
+inline_cache_new(void)
+{
+	inline_cache_t *cache = calloc(1, sizeof(inline_cache_t));
+	cache->next = inline_caches;
+	inline_caches = cache;
+	return cache;
+}
+
+//e next free entry, or NULL if the site is megamorphic
+static inline_cache_entry_t *
+inline_cache_next_entry(inline_cache_t *cache)
+{
+	if (cache->entries_nr == INLINE_CACHE_ENTRIES_NR) {
+		return NULL;
+	}
+	return &cache->entries[cache->entries_nr++];
+}
+
+//e generated code only looks at the method slot or field offset once the class matches, so we set these first
+
+void
+inline_cache_add_method(inline_cache_t *cache, class_t *classref, void **method_slot)
+{
+	inline_cache_entry_t *entry = inline_cache_next_entry(cache);
+	if (entry) {
+		entry->method_slot = method_slot;
+		entry->classref = classref;
+	}
+}
+
+void
+inline_cache_add_field(inline_cache_t *cache, class_t *classref, long long field_offset)
+{
+	inline_cache_entry_t *entry = inline_cache_next_entry(cache);
+	if (entry) {
+		entry->field_offset = field_offset;
+		entry->classref = classref;
+	}
+}
+
+void
+inline_cache_clear(void)
+{
+	while (inline_caches) {
+		inline_cache_t *next = inline_caches->next;
+		free(inline_caches);
+		inline_caches = next;
+	}
+}
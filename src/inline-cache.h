@@ -0,0 +1,89 @@
+/***************************************************************************
+  Copyright (C) 2015 Christoph Reichenbach
+
+
+ This program may be modified and copied freely according to the terms of
+ the GNU general public license (GPL), as long as the above copyright
+ notice and the licensing information contained herein are preserved.
+
+ Please refer to www.gnu.org for licensing details.
+
+ This work is provided AS IS, without warranty of any kind, expressed or
+ implied, including but not limited to the warranties of merchantability,
+ noninfringement, and fitness for a specific purpose. The author will not
+ be held liable for any damage caused by this work or derivatives of it.
+
+ By using this source code, you agree to the licensing terms as stated
+ above.
+
+
+ Please contact the maintainer for bug reports or inquiries.
+
+ Current Maintainer:
+
+    Christoph Reichenbach (CR) <creichen@gmail.com>
+
+***************************************************************************/
+
+//e Per-call-site inline caches for selector lookups
+
+#ifndef _ATTOL_INLINE_CACHE_H
+#define _ATTOL_INLINE_CACHE_H
+
+#include "class.h"
+
+//e Number of classes an inline cache remembers before the site is considered megamorphic
+#define INLINE_CACHE_ENTRIES_NR		4
+
+typedef struct {
+	class_t *classref; /*e receiver class; NULL for unused entries */
+	union {
+		void **method_slot; /*e methods: vtable entry (the vtable may be updated when methods are recompiled) */
+		long long field_offset; /*e fields: byte offset of the field within the object */
+	};
+} inline_cache_entry_t;
+
+/*e
+ * Inline cache for one selector access in generated code
+ *
+ * Generated code compares the receiver class against all entries and only calls into the runtime
+ * on a miss; the runtime then uses inline_cache_add_method() or inline_cache_add_field() to
+ * update the cache.
+ */
+typedef struct inline_cache {
+	inline_cache_entry_t entries[INLINE_CACHE_ENTRIES_NR];
+	int entries_nr; /*e number of entries in use */
+	struct inline_cache *next; /*e registry (cf. inline_cache_clear()) */
+} inline_cache_t;
+
+/*e
+ * Allocates an empty inline cache
+ *
+ * The cache remains valid until the next inline_cache_clear().
+ */
+inline_cache_t *
+inline_cache_new(void);
+
+/*e
+ * Remembers a method lookup result in an inline cache
+ *
+ * Does nothing if the cache is full, i.e., if the site is megamorphic.
+ */
+void
+inline_cache_add_method(inline_cache_t *cache, class_t *classref, void **method_slot);
+
+/*e
+ * Remembers a field lookup result in an inline cache
+ *
+ * Does nothing if the cache is full, i.e., if the site is megamorphic.
+ */
+void
+inline_cache_add_field(inline_cache_t *cache, class_t *classref, long long field_offset);
+
+/*e
+ * Deallocates all inline caches (to be called when the code that references them is freed)
+ */
+void
+inline_cache_clear(void);
+
+#endif // !defined(_ATTOL_INLINE_CACHE_H)
@@ -0,0 +1,575 @@
+/***************************************************************************
+  Copyright (C) 2015 Christoph Reichenbach
+
+
+ This program may be modified and copied freely according to the terms of
+ the GNU general public license (GPL), as long as the above copyright
+ notice and the licensing information contained herein are preserved.
+
+ Please refer to www.gnu.org for licensing details.
+
+ This work is provided AS IS, without warranty of any kind, expressed or
+ implied, including but not limited to the warranties of merchantability,
+ noninfringement, and fitness for a specific purpose. The author will not
+ be held liable for any damage caused by this work or derivatives of it.
+
+ By using this source code, you agree to the licensing terms as stated
+ above.
+
+
+ Please contact the maintainer for bug reports or inquiries.
+
+ Current Maintainer:
+
+    Christoph Reichenbach (CR) <creichen@gmail.com>
+
+***************************************************************************/
+
+#include <stdlib.h>
+
+#include "ast.h"
+#include "chash.h"
+#include "class.h"
+#include "data-flow.h"
+#include "loop-invariants.h"
+
+typedef struct {
+	symtab_entry_t *sym;		/*e callable that we are examining */
+	hashset_ptr_t *hoisted;		/*e expressions hoisted out of enclosing loops (or this one) */
+	int next_temp;
+	int loops_size;
+
+	//e current loop
+	ast_node_t *loop;
+	hashset_ptr_t *definitions;	/*e right-hand sides of all assignments within the loop */
+	bool fields_invariant;		/*e no field of `self' can change within the loop */
+	loop_plan_t *plan;
+	bool needs_arrays;		/*e the last invariant expression relies on plan->checked_arrays */
+} scan_context_t;
+
+//e Collects all assigned expressions, and checks for calls and field stores
+static void
+scan_loop(ast_node_t *node, hashset_ptr_t *definitions, bool *calls, bool *field_stores)
+{
+	if (!node || IS_VALUE_NODE(node)) {
+		return;
+	}
+	switch (NODE_TY(node)) {
+	case AST_NODE_VARDECL:
+	case AST_NODE_ASSIGN: {
+		ast_node_t *lhs = node->children[0];
+		if (NODE_TY(lhs) == AST_NODE_MEMBER
+		    || (NODE_TY(lhs) == AST_VALUE_ID && (lhs->sym->symtab_flags & SYMTAB_MEMBER))) {
+			*field_stores = true;
+		}
+		if (node->children[1]) {
+			hashset_ptr_add(definitions, node->children[1]);
+		}
+	}
+		break;
+
+	case AST_NODE_METHODAPP:
+	case AST_NODE_NEWINSTANCE:
+		*calls = true;
+		break;
+
+	case AST_NODE_FUNAPP: {
+		symtab_entry_t *callee = AST_CALLABLE_SYMREF(node);
+		if (!(callee->id < 0 || (callee->symtab_flags & SYMTAB_BUILTIN))) {
+			*calls = true;
+		}
+	}
+		break;
+	}
+	for (int i = 0; i < node->children_nr; i++) {
+		scan_loop(node->children[i], definitions, calls, field_stores);
+	}
+}
+
+//e Counts the definitions of `var' within `node', and remembers the last one
+static int
+count_assignments(ast_node_t *node, symtab_entry_t *var, ast_node_t **assignment)
+{
+	if (!node || IS_VALUE_NODE(node)) {
+		return 0;
+	}
+	int count = 0;
+	if ((NODE_TY(node) == AST_NODE_ASSIGN || NODE_TY(node) == AST_NODE_VARDECL)
+	    && NODE_TY(node->children[0]) == AST_VALUE_ID
+	    && node->children[0]->sym == var) {
+		*assignment = node;
+		++count;
+	}
+	for (int i = 0; i < node->children_nr; i++) {
+		count += count_assignments(node->children[i], var, assignment);
+	}
+	return count;
+}
+
+static bool
+is_invariant_var(scan_context_t *ctx, ast_node_t *node)
+{
+	const int var = data_flow_is_local_var(ctx->sym, node);
+	if (var < 0) {
+		return false;
+	}
+	ast_node_t *definition;
+	if (!count_assignments(ctx->loop, node->sym, &definition)) {
+		//e several definitions may reach the loop, but none from within
+		return true;
+	}
+	if (!data_flow_reaching_definition(ctx->sym, ctx->loop, var, &definition)) {
+		return false;
+	}
+	return !definition || !hashset_ptr_contains(ctx->definitions, definition);
+}
+
+static bool
+is_field(symtab_entry_t *sym)
+{
+	return sym->parent
+		&& SYMTAB_KIND(sym) == SYMTAB_KIND_VAR
+		&& (sym->symtab_flags & SYMTAB_MEMBER);
+}
+
+static bool
+contains(symtab_entry_t **syms, int syms_nr, symtab_entry_t *sym)
+{
+	for (int i = 0; i < syms_nr; i++) {
+		if (syms[i] == sym) {
+			return true;
+		}
+	}
+	return false;
+}
+
+//e Is this a call to the built-in `size()' method on an invariant receiver?
+static bool
+is_size_call(scan_context_t *ctx, ast_node_t *node)
+{
+	if (NODE_TY(node) != AST_NODE_METHODAPP
+	    || node->children[2]->children_nr
+	    || !is_invariant_var(ctx, node->children[0])) {
+		return false;
+	}
+	symtab_entry_t *method = node->children[1]->sym;
+	if (method->selector != symtab_selector_size) {
+		return false;
+	}
+	if (SYMTAB_KIND(method) == SYMTAB_KIND_FUNCTION
+	    && (method->symtab_flags & SYMTAB_MEMBER)
+	    && !(node->opt_flags & OPT_FLAG_GUARDED_CALL)
+	    && (method->parent == class_array.id || method->parent == class_string.id)) {
+		return true;
+	}
+	//e dynamically dispatched: safe only if the receiver is known to be an array
+	if (contains(ctx->plan->checked_arrays, ctx->plan->checked_arrays_nr, node->children[0]->sym)
+	    || contains(ctx->plan->bounded_arrays, ctx->plan->bounded_arrays_nr, node->children[0]->sym)) {
+		ctx->needs_arrays = true;
+		return true;
+	}
+	return false;
+}
+
+/*e
+ * Determines whether `node' computes the same value in each iteration of the current loop,
+ * and can be computed ahead of the loop without failing or having side effects
+ */
+static bool
+is_invariant(scan_context_t *ctx, ast_node_t *node)
+{
+	switch (NODE_TY(node)) {
+	case AST_VALUE_INT:
+	case AST_VALUE_STRING:
+		return true;
+
+	case AST_VALUE_ID:
+		if (node->sym->id == BUILTIN_OP_SELF) {
+			return true;
+		}
+		if (is_field(node->sym)) {
+			return ctx->fields_invariant;
+		}
+		return is_invariant_var(ctx, node);
+
+	case AST_NODE_FUNAPP: {
+		symtab_entry_t *op = AST_CALLABLE_SYMREF(node);
+		ast_node_t **args = node->children[1]->children;
+		const int args_nr = node->children[1]->children_nr;
+		if (op->id >= 0 || !(op->symtab_flags & SYMTAB_HIDDEN)) {
+			return false;
+		}
+		switch (op->id) {
+		case BUILTIN_OP_TEST_EQ:
+			if (AST_TYPE(args[0]) != TYPE_INT || AST_TYPE(args[1]) != TYPE_INT) {
+				return false;
+			}
+			break;
+
+		case BUILTIN_OP_DIV:
+			//e must not trap
+			if (NODE_TY(args[1]) != AST_VALUE_INT || AV_INT(args[1]) == 0) {
+				return false;
+			}
+			break;
+
+		case BUILTIN_OP_CONVERT:
+			//e unboxing cannot fail for `size()', but boxing would allocate a fresh object each time
+			if (AST_TYPE(node) != TYPE_INT || !is_size_call(ctx, args[0])) {
+				return false;
+			}
+			break;
+
+		case BUILTIN_OP_ADD:
+		case BUILTIN_OP_SUB:
+		case BUILTIN_OP_MUL:
+		case BUILTIN_OP_TEST_LE:
+		case BUILTIN_OP_TEST_LT:
+		case BUILTIN_OP_NOT:
+			break;
+
+		default:
+			return false;
+		}
+		for (int i = 0; i < args_nr; i++) {
+			if (!is_invariant(ctx, args[i])) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	case AST_NODE_METHODAPP:
+		return is_size_call(ctx, node);
+
+	default:
+		return false;
+	}
+}
+
+//e Is it worth reserving a temp for `node'?
+static bool
+is_candidate(ast_node_t *node)
+{
+	switch (NODE_TY(node)) {
+	case AST_VALUE_ID:
+		return is_field(node->sym) && !(node->type & AST_FLAG_LVALUE);
+	case AST_NODE_FUNAPP:
+	case AST_NODE_METHODAPP:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void
+plan_add_invariant(scan_context_t *ctx, loop_plan_t *plan, ast_node_t *node)
+{
+	plan->invariants = realloc(plan->invariants, sizeof(loop_invariant_t) * (plan->invariants_nr + 1));
+	plan->invariants[plan->invariants_nr].node = node;
+	plan->invariants[plan->invariants_nr].temp = ctx->next_temp++;
+	plan->invariants[plan->invariants_nr].needs_arrays = ctx->needs_arrays;
+	plan->invariants_nr++;
+	hashset_ptr_add(ctx->hoisted, node);
+}
+
+//e Finds maximal invariant expressions
+static void
+hoist(scan_context_t *ctx, loop_plan_t *plan, ast_node_t *node)
+{
+	if (!node || hashset_ptr_contains(ctx->hoisted, node)) {
+		return;
+	}
+	ctx->needs_arrays = false;
+	if (is_candidate(node) && is_invariant(ctx, node)) {
+		plan_add_invariant(ctx, plan, node);
+		return;
+	}
+	if (IS_VALUE_NODE(node)) {
+		return;
+	}
+	for (int i = 0; i < node->children_nr; i++) {
+		hoist(ctx, plan, node->children[i]);
+	}
+}
+
+//e Finds local array variables whose type checks can move into the preheader
+static void
+check_arrays(scan_context_t *ctx, loop_plan_t *plan, symtab_entry_t **checked, int checked_nr, ast_node_t *node)
+{
+	if (!node || IS_VALUE_NODE(node)) {
+		return;
+	}
+	if (NODE_TY(node) == AST_NODE_ARRAYSUB
+	    && !(node->opt_flags & OPT_FLAG_NO_TYPECHECK1)
+	    && NODE_TY(node->children[0]) == AST_VALUE_ID
+	    && is_invariant_var(ctx, node->children[0])) {
+		symtab_entry_t *array = node->children[0]->sym;
+		if (!contains(checked, checked_nr, array)
+		    && !contains(plan->checked_arrays, plan->checked_arrays_nr, array)) {
+			plan->checked_arrays = realloc(plan->checked_arrays, sizeof(symtab_entry_t *) * (plan->checked_arrays_nr + 1));
+			plan->checked_arrays[plan->checked_arrays_nr++] = array;
+		}
+	}
+	for (int i = 0; i < node->children_nr; i++) {
+		check_arrays(ctx, plan, checked, checked_nr, node->children[i]);
+	}
+}
+
+static bool
+is_var(ast_node_t *node, symtab_entry_t *var)
+{
+	return NODE_TY(node) == AST_VALUE_ID && node->sym == var;
+}
+
+//e Finds `a[v]' for invariant local arrays `a'
+static void
+find_bounded_accesses(scan_context_t *ctx, loop_plan_t *plan, ast_node_t *node)
+{
+	if (!node || IS_VALUE_NODE(node)) {
+		return;
+	}
+	if (NODE_TY(node) == AST_NODE_ARRAYSUB
+	    && is_var(node->children[1], plan->induction_var)
+	    && NODE_TY(node->children[0]) == AST_VALUE_ID
+	    && is_invariant_var(ctx, node->children[0])) {
+		symtab_entry_t *array = node->children[0]->sym;
+		plan->bounded_accesses = realloc(plan->bounded_accesses, sizeof(ast_node_t *) * (plan->bounded_accesses_nr + 1));
+		plan->bounded_accesses[plan->bounded_accesses_nr++] = node;
+		if (!contains(plan->bounded_arrays, plan->bounded_arrays_nr, array)) {
+			plan->bounded_arrays = realloc(plan->bounded_arrays, sizeof(symtab_entry_t *) * (plan->bounded_arrays_nr + 1));
+			plan->bounded_arrays[plan->bounded_arrays_nr++] = array;
+		}
+	}
+	for (int i = 0; i < node->children_nr; i++) {
+		find_bounded_accesses(ctx, plan, node->children[i]);
+	}
+}
+
+/*e
+ * Recognises loops of the form `while (v < bound) { ... a[v] ... v := v + step; ... }'
+ *
+ * Only accesses that precede the (unique) update of `v' in the loop body are bounded by the
+ * loop condition.
+ */
+static void
+find_induction_var(scan_context_t *ctx, loop_plan_t *plan)
+{
+	ast_node_t *cond = plan->loop->children[0];
+	if (NODE_TY(cond) != AST_NODE_FUNAPP || AST_CALLABLE_SYMREF(cond)->id != BUILTIN_OP_TEST_LT) {
+		return;
+	}
+	ast_node_t *var = cond->children[1]->children[0];
+	ast_node_t *bound = cond->children[1]->children[1];
+	if (NODE_TY(var) != AST_VALUE_ID
+	    || AST_TYPE(var) != TYPE_INT
+	    || AST_TYPE(bound) != TYPE_INT
+	    || data_flow_is_local_var(ctx->sym, var) < 0) {
+		return;
+	}
+
+	ast_node_t *body = plan->loop->children[1];
+	ast_node_t *update = NULL;
+	if (count_assignments(body, var->sym, &update) != 1 || NODE_TY(update) != AST_NODE_ASSIGN) {
+		return;
+	}
+	ast_node_t *rhs = update->children[1];
+	if (NODE_TY(rhs) != AST_NODE_FUNAPP || AST_CALLABLE_SYMREF(rhs)->id != BUILTIN_OP_ADD) {
+		return;
+	}
+	ast_node_t **args = rhs->children[1]->children;
+	ast_node_t *step;
+	if (is_var(args[0], var->sym)) {
+		step = args[1];
+	} else if (is_var(args[1], var->sym)) {
+		step = args[0];
+	} else {
+		return;
+	}
+	if (AST_TYPE(step) != TYPE_INT) {
+		return;
+	}
+	plan->induction_var = var->sym;
+
+	ast_node_t **stmts = &body;
+	int stmts_nr = 1;
+	if (NODE_TY(body) == AST_NODE_BLOCK) {
+		stmts = body->children;
+		stmts_nr = body->children_nr;
+	}
+	for (int i = 0; i < stmts_nr; i++) {
+		if (count_assignments(stmts[i], var->sym, &update)) {
+			break;
+		}
+		find_bounded_accesses(ctx, plan, stmts[i]);
+	}
+
+	//e the preheader must evaluate `step' and `bound'
+	if (!plan->bounded_accesses_nr
+	    || !is_invariant(ctx, step)
+	    || !is_invariant(ctx, bound)) {
+		free(plan->bounded_accesses);
+		free(plan->bounded_arrays);
+		plan->bounded_accesses = NULL;
+		plan->bounded_accesses_nr = 0;
+		plan->bounded_arrays = NULL;
+		plan->bounded_arrays_nr = 0;
+		plan->induction_var = NULL;
+		return;
+	}
+	plan->induction_step = step;
+	plan->induction_bound = bound;
+	plan->bound_temp = ctx->next_temp++;
+}
+
+static loop_plan_t *
+plan_loop(scan_context_t *ctx, loop_invariants_t *invariants, symtab_entry_t **checked, int checked_nr, ast_node_t *loop)
+{
+	bool calls = false;
+	bool field_stores = false;
+	ctx->loop = loop;
+	ctx->definitions = hashset_ptr_alloc();
+	scan_loop(loop, ctx->definitions, &calls, &field_stores);
+	ctx->fields_invariant = (ctx->sym->symtab_flags & SYMTAB_MEMBER) && !calls && !field_stores;
+
+	loop_plan_t plan = { .loop = loop };
+	ctx->plan = &plan;
+	check_arrays(ctx, &plan, checked, checked_nr, loop->children[0]);
+	check_arrays(ctx, &plan, checked, checked_nr, loop->children[1]);
+	find_induction_var(ctx, &plan);
+	hoist(ctx, &plan, loop->children[0]);
+	hoist(ctx, &plan, loop->children[1]);
+	ctx->plan = NULL;
+	hashset_ptr_free(ctx->definitions);
+	ctx->definitions = NULL;
+
+	if (!plan.invariants_nr && !plan.checked_arrays_nr && !plan.bounded_accesses_nr) {
+		return NULL;
+	}
+	if (invariants->loops_nr == ctx->loops_size) {
+		ctx->loops_size = ctx->loops_size ? ctx->loops_size * 2 : 4;
+		invariants->loops = realloc(invariants->loops, sizeof(loop_plan_t) * ctx->loops_size);
+	}
+	invariants->loops[invariants->loops_nr] = plan;
+	return &invariants->loops[invariants->loops_nr++];
+}
+
+//e Plans outer loops before inner ones, so that expressions move as far out as possible
+static void
+find_loops(scan_context_t *ctx, loop_invariants_t *invariants, symtab_entry_t **checked, int checked_nr, ast_node_t *node)
+{
+	if (!node || IS_VALUE_NODE(node)) {
+		return;
+	}
+	if (NODE_TY(node) == AST_NODE_WHILE) {
+		loop_plan_t *plan = plan_loop(ctx, invariants, checked, checked_nr, node);
+		if (plan && plan->checked_arrays_nr) {
+			//e arrays checked here need no further checks in nested loops
+			symtab_entry_t *nested_checked[checked_nr + plan->checked_arrays_nr];
+			for (int i = 0; i < checked_nr; i++) {
+				nested_checked[i] = checked[i];
+			}
+			for (int i = 0; i < plan->checked_arrays_nr; i++) {
+				nested_checked[checked_nr + i] = plan->checked_arrays[i];
+			}
+			find_loops(ctx, invariants, nested_checked, checked_nr + plan->checked_arrays_nr, node->children[1]);
+			return;
+		}
+	}
+	for (int i = 0; i < node->children_nr; i++) {
+		find_loops(ctx, invariants, checked, checked_nr, node->children[i]);
+	}
+}
+
+void
+loop_invariants_find(symtab_entry_t *sym, int first_temp, loop_invariants_t *invariants)
+{
+	invariants->loops = NULL;
+	invariants->loops_nr = 0;
+	invariants->temps_nr = 0;
+	if (!sym->astref || NODE_TY(sym->astref) != AST_NODE_FUNDEF) {
+		return;
+	}
+
+	scan_context_t ctx = {
+		.sym = sym,
+		.hoisted = hashset_ptr_alloc(),
+		.next_temp = first_temp,
+		.loops_size = 0
+	};
+	find_loops(&ctx, invariants, NULL, 0, sym->astref->children[2]);
+	hashset_ptr_free(ctx.hoisted);
+	invariants->temps_nr = ctx.next_temp - first_temp;
+}
+
+loop_plan_t *
+loop_invariants_plan(loop_invariants_t *invariants, ast_node_t *loop)
+{
+	for (int i = 0; i < invariants->loops_nr; i++) {
+		if (invariants->loops[i].loop == loop) {
+			return &invariants->loops[i];
+		}
+	}
+	return NULL;
+}
+
+loop_invariant_t *
+loop_invariants_lookup(loop_invariants_t *invariants, ast_node_t *node)
+{
+	for (int i = 0; i < invariants->loops_nr; i++) {
+		loop_plan_t *plan = &invariants->loops[i];
+		if (plan->active) {
+			for (int k = 0; k < plan->invariants_nr; k++) {
+				if (plan->invariants[k].node == node
+				    && (plan->arrays_checked || !plan->invariants[k].needs_arrays)) {
+					return &plan->invariants[k];
+				}
+			}
+		}
+	}
+	return NULL;
+}
+
+bool
+loop_invariants_array_checked(loop_invariants_t *invariants, symtab_entry_t *sym)
+{
+	for (int i = 0; i < invariants->loops_nr; i++) {
+		loop_plan_t *plan = &invariants->loops[i];
+		if (plan->arrays_checked
+		    && (contains(plan->checked_arrays, plan->checked_arrays_nr, sym)
+			|| contains(plan->bounded_arrays, plan->bounded_arrays_nr, sym))) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool
+loop_invariants_bounds_checked(loop_invariants_t *invariants, ast_node_t *node)
+{
+	for (int i = 0; i < invariants->loops_nr; i++) {
+		loop_plan_t *plan = &invariants->loops[i];
+		if (plan->arrays_checked) {
+			for (int k = 0; k < plan->bounded_accesses_nr; k++) {
+				if (plan->bounded_accesses[k] == node) {
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+void
+loop_invariants_free(loop_invariants_t *invariants)
+{
+	for (int i = 0; i < invariants->loops_nr; i++) {
+		free(invariants->loops[i].invariants);
+		free(invariants->loops[i].checked_arrays);
+		free(invariants->loops[i].bounded_accesses);
+		free(invariants->loops[i].bounded_arrays);
+	}
+	free(invariants->loops);
+	invariants->loops = NULL;
+	invariants->loops_nr = 0;
+}
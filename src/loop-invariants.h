@@ -0,0 +1,136 @@
+/***************************************************************************
+  Copyright (C) 2015 Christoph Reichenbach
+
+
+ This program may be modified and copied freely according to the terms of
+ the GNU general public license (GPL), as long as the above copyright
+ notice and the licensing information contained herein are preserved.
+
+ Please refer to www.gnu.org for licensing details.
+
+ This work is provided AS IS, without warranty of any kind, expressed or
+ implied, including but not limited to the warranties of merchantability,
+ noninfringement, and fitness for a specific purpose. The author will not
+ be held liable for any damage caused by this work or derivatives of it.
+
+ By using this source code, you agree to the licensing terms as stated
+ above.
+
+
+ Please contact the maintainer for bug reports or inquiries.
+
+ Current Maintainer:
+
+    Christoph Reichenbach (CR) <creichen@gmail.com>
+
+***************************************************************************/
+
+//e Loop-invariant code motion for optimised code
+
+#ifndef _ATTOL_LOOP_INVARIANTS_H
+#define _ATTOL_LOOP_INVARIANTS_H
+
+#include <stdbool.h>
+
+#include "ast.h"
+#include "symbol-table.h"
+
+typedef struct {
+	ast_node_t *node;	/*e hoisted expression */
+	int temp;		/*e temp storage offset (as in ast_node_t.storage) that holds its value */
+	bool needs_arrays;	/*e only hoisted in the loop copy for checked arrays */
+} loop_invariant_t;
+
+/*e
+ * Code motion plan for one WHILE loop
+ *
+ * The backend evaluates all `invariants' once, in a preheader that only runs if the loop is
+ * entered, and loads them from their temps within the loop.  If there are `checked_arrays', the
+ * preheader also checks that each of these variables holds an array and, if so, runs a copy of
+ * the loop in which indexing these variables skips its type check.  Otherwise, it falls back to
+ * a copy of the loop that only uses those invariants that don't have `needs_arrays' set.
+ *
+ * If the loop condition is `v < bound' for an induction variable `v' that the loop only updates
+ * as `v := v + step', the preheader also checks that 0 <= v, 0 <= step <= bound, and that `bound'
+ * does not exceed the size of any of the `bounded_arrays'.  Accesses `a[v]' that take place
+ * before the update then need no bounds checks in the checked copy of the loop.
+ */
+typedef struct {
+	ast_node_t *loop;		/*e WHILE node */
+	loop_invariant_t *invariants;
+	int invariants_nr;
+	symtab_entry_t **checked_arrays;	/*e local variables that are indexed in the loop but never assigned there */
+	int checked_arrays_nr;
+
+	symtab_entry_t *induction_var;	/*e `v', or NULL if there are no bounded_accesses */
+	ast_node_t *induction_step;
+	ast_node_t *induction_bound;
+	int bound_temp;			/*e temp that holds `bound' while checking */
+	ast_node_t **bounded_accesses;	/*e ARRAYSUB nodes `a[v]' whose bounds the preheader checks */
+	int bounded_accesses_nr;
+	symtab_entry_t **bounded_arrays;
+	int bounded_arrays_nr;
+
+	bool active;			/*e backend: invariants are currently held in their temps */
+	bool arrays_checked;		/*e backend: currently compiling the loop copy for which all checks passed */
+} loop_plan_t;
+
+typedef struct {
+	loop_plan_t *loops;
+	int loops_nr;
+	int temps_nr;		/*e number of temps needed beyond the callable's own temps */
+} loop_invariants_t;
+
+/*e
+ * Finds loop-invariant expressions in the body of the given callable
+ *
+ * Requires the results of the `reaching-definitions' analysis: a local variable is invariant
+ * in a loop if the loop never assigns to it, or if the definition that reaches the loop header
+ * is unique and lies outside of the loop.  Only expressions that can neither fail nor have side effects are hoisted: integer
+ * arithmetic, reads of fields of `self' in methods (if the loop contains no calls and no field
+ * stores), and `size()' calls on arrays and strings.  Unless precise-types has resolved their
+ * targets, `size()' calls are only hoisted if their receiver is among the checked arrays.
+ *
+ * @param sym The function, method or constructor to examine
+ * @param first_temp First temp storage offset that is free for holding invariants
+ * @param invariants The plans to fill in; must be freed with loop_invariants_free()
+ */
+void
+loop_invariants_find(symtab_entry_t *sym, int first_temp, loop_invariants_t *invariants);
+
+/*e
+ * Looks up the code motion plan for a WHILE loop
+ *
+ * @return The plan, or NULL if there is nothing to hoist out of `loop'
+ */
+loop_plan_t *
+loop_invariants_plan(loop_invariants_t *invariants, ast_node_t *loop);
+
+/*e
+ * Looks up a hoisted expression within the loops that are currently active
+ *
+ * @return The hoisted expression's record, or NULL if `node' is not currently hoisted
+ */
+loop_invariant_t *
+loop_invariants_lookup(loop_invariants_t *invariants, ast_node_t *node);
+
+/*e
+ * Determines whether an array access through `sym' is known to target an array
+ *
+ * @return true iff we are compiling a loop copy in which `sym' has been checked to hold an array
+ */
+bool
+loop_invariants_array_checked(loop_invariants_t *invariants, symtab_entry_t *sym);
+
+/*e
+ * Determines whether an array access is known to be within bounds
+ *
+ * @return true iff we are compiling a loop copy in which the bounds of `node' have been checked
+ */
+bool
+loop_invariants_bounds_checked(loop_invariants_t *invariants, ast_node_t *node);
+
+void
+loop_invariants_free(loop_invariants_t *invariants);
+
+#endif // !defined(_ATTOL_LOOP_INVARIANTS_H)
@@ -25,6 +25,7 @@
 
 ***************************************************************************/
 
+#include <stddef.h>
 #include <string.h>
 
 #include "errors.h"
@@ -45,6 +46,9 @@ new_object(class_t* type, unsigned long long fields_nr)
 object_t *
 new_int(long long int v)
 {
+	if (OBJECT_CAN_TAG_INT(v)) {
+		return OBJECT_TAG_INT(v);
+	}
 	object_t *obj = heap_allocate_object(&class_boxed_int, 1);
 	obj->fields[0].int_v = v;
 	return obj;
@@ -95,11 +99,13 @@ builtin_op_obj_test_eq(object_t *a0, object_t *a1)
 	if (a0 == NULL || a1 == NULL) {
 		return 0;
 	}
-	if (a0->classref != a1->classref) {
+	//e tagged ints may be compared against boxed ints (e.g., temporaries built by the backend)
+	//d Markierte Ganzzahlen koennen mit verpackten verglichen werden (z.B. mit Temporaerobjekten des Backends)
+	if (OBJECT_CLASS(a0) != OBJECT_CLASS(a1)) {
 		return 0;
 	}
-	if (a0->classref == &class_boxed_int) {
-		return a0->fields[0].int_v == a1->fields[0].int_v;
+	if (OBJECT_CLASS(a0) == &class_boxed_int) {
+		return OBJECT_INT_VALUE(a0) == OBJECT_INT_VALUE(a1);
 	}
 	if (a0->classref == &class_boxed_real) {
 		return a0->fields[0].real_v == a1->fields[0].real_v;
@@ -124,6 +130,11 @@ object_print_internal(FILE *f, object_t *obj, int depth, bool debug, char *sep)
 		return;
 	}
 
+	if (OBJECT_IS_TAGGED_INT(obj)) {
+		fprintf(f, "%lld", OBJECT_TAGGED_INT_VALUE(obj));
+		return;
+	}
+
 	class_t *classref = obj->classref;
 	char loc[24] = "";
 	if (debug) {
@@ -243,36 +254,86 @@ fail_selector_lookup(object_t *obj, ast_node_t *node, int actual_type, int expec
 		}
 	} else {
 		sprintf(message, "Object at %p has no method or field `%s'", obj, sym->name);
-fprintf(stderr, "Object at %p (class %p) has no method or field `%s'", obj, obj->classref, sym->name);
-class_print(stderr, obj->classref);
 	}
 
 	fail_at_node(node, message);
 }
 
+/*e
+ * Global (class, selector) lookup cache
+ *
+ * A direct-mapped cache in front of the class dispatch table (cf. class.h), shared by all
+ * selector accesses from C code (including the miss handlers of the inline caches in generated code).
+ */
+#define SELECTOR_CACHE_SIZE	1024	/*e must be a power of two */
+
+typedef struct {
+	class_t *classref; /*e NULL: unused */
+	int selector;
+	unsigned short type;
+	long long int offset;
+} selector_cache_entry_t;
+
+static selector_cache_entry_t selector_cache[SELECTOR_CACHE_SIZE];
+static unsigned long long selector_cache_hits = 0;
+static unsigned long long selector_cache_misses = 0;
+
+void
+object_selector_cache_flush(void)
+{
+	memset(selector_cache, 0, sizeof(selector_cache));
+}
+
+void
+object_selector_cache_stats(unsigned long long *hits, unsigned long long *misses)
+{
+	*hits = selector_cache_hits;
+	*misses = selector_cache_misses;
+}
+
+/*e
+ * Looks up `selector' in `classref', setting `type' and `offset'
+ *
+ * @return false iff the class has no such selector
+ */
+static inline bool
+selector_lookup(class_t *classref, int selector, unsigned short *type, long long int *offset)
+{
+	selector_cache_entry_t *entry =
+		&selector_cache[((((uintptr_t) classref) >> 4) ^ (selector * 0x9e3779b1u)) & (SELECTOR_CACHE_SIZE - 1)];
+	if (entry->classref == classref && entry->selector == selector) {
+		++selector_cache_hits;
+		*type = entry->type;
+		*offset = entry->offset;
+		return true;
+	}
+	++selector_cache_misses;
+
+	const unsigned long long coding = class_lookup_selector(classref, selector);
+	if (!coding) {
+		return false;
+	}
+	*type = CLASS_DECODE_SELECTOR_TYPE(coding);
+	*offset = CLASS_DECODE_SELECTOR_OFFSET(coding);
+
+	entry->classref = classref;
+	entry->selector = selector;
+	entry->type = *type;
+	entry->offset = *offset;
+	return true;
+}
+
 // Gemeinsamer Code fuer alle Selektorzugriffe
 #define LOAD_SELECTOR							\
 									\
 	if (!obj) {							\
 		fail_at_node(node, "Null pointer object dereference");	\
 	}								\
-	class_t *classref = obj->classref;				\
-	const int mask = classref->table_mask;				\
-	int index = selector & mask;					\
+	class_t *classref = OBJECT_CLASS(obj);				\
 	unsigned short type;						\
 	long long int offset;						\
-	while (true) {							\
-		const unsigned long long coding = classref->members[index].selector_encoding; \
-		if (!coding) {						\
-			fail_selector_lookup(obj, node, 0, 0);		\
-		}							\
-		if (CLASS_DECODE_SELECTOR_ID(coding) != selector) {	\
-			index = (index + 1) & mask;			\
-			continue;					\
-		}							\
-		type = CLASS_DECODE_SELECTOR_TYPE(coding);		\
-		offset = CLASS_DECODE_SELECTOR_OFFSET(coding);		\
-		break;							\
+	if (!selector_lookup(classref, selector, &type, &offset)) {	\
+		fail_selector_lookup(obj, node, 0, 0);			\
 	}
 
 
@@ -287,6 +348,18 @@ object_get_member_method(object_t *obj, ast_node_t *node, int selector, int para
 	return CLASS_VTABLE(classref)[offset];
 }
 
+void *
+object_get_member_method_cached(object_t *obj, ast_node_t *node, int selector, int parameters_nr, inline_cache_t *cache)
+{
+	LOAD_SELECTOR;
+	if (type != CLASS_MEMBER_METHOD(parameters_nr)) {
+		fail_selector_lookup(obj, node, type, CLASS_MEMBER_METHOD(parameters_nr));
+	}
+	void **method_slot = &CLASS_VTABLE(classref)[offset];
+	inline_cache_add_method(cache, classref, method_slot);
+	return *method_slot;
+}
+
 void *
 object_read_member_field_obj(object_t *obj, ast_node_t *node, int selector)
 {
@@ -314,8 +387,8 @@ object_read_member_field_int(object_t *obj, ast_node_t *node, int selector)
 
 	if (type == CLASS_MEMBER_VAR_OBJ) {
 		object_t *elt = obj->fields[offset].object_v;
-		if (elt->classref == &class_boxed_int) {
-			return elt->fields[0].int_v;
+		if (elt && OBJECT_CLASS(elt) == &class_boxed_int) {
+			return OBJECT_INT_VALUE(elt);
 		}
 		fail_at_node(node, "attempted to convert non-int object to int value");
 	} else if (type == CLASS_MEMBER_VAR_INT) {
@@ -333,6 +406,7 @@ object_write_member_field_int(object_t *obj, ast_node_t *node, int selector, lon
 	//e `type' und `offset' are now set
 	if (type == CLASS_MEMBER_VAR_OBJ) {
 		obj->fields[offset].object_v = new_int(value);
+		heap_write_barrier(&obj->fields[offset].object_v);
 	} else if (type == CLASS_MEMBER_VAR_INT) {
 		obj->fields[offset].int_v = value;
 	} else {
@@ -348,15 +422,56 @@ object_write_member_field_obj(object_t *obj, ast_node_t *node, int selector, obj
 
 	if (type == CLASS_MEMBER_VAR_OBJ) {
 		obj->fields[offset].object_v = value;
+		heap_write_barrier(&obj->fields[offset].object_v);
 	} else if (type == CLASS_MEMBER_VAR_INT) {
 		if (!value) {
 			fail_at_node(node, "attempted to assign NULL to int field");
 		}
-		if (value->classref == &class_boxed_int) {
-			obj->fields[offset].int_v = value->fields[0].int_v;
+		if (OBJECT_CLASS(value) == &class_boxed_int) {
+			obj->fields[offset].int_v = OBJECT_INT_VALUE(value);
+			return;
 		}
 		fail_at_node(node, "attempted to convert non-int object to int value");
 	} else {
 		fail_selector_lookup(obj, node, type, CLASS_MEMBER_VAR_OBJ);
 	}
 }
+
+//e records the field offset in `cache' if the field has the expected type, which generated code can then access directly
+static void
+cache_field(object_t *obj, ast_node_t *node, int selector, inline_cache_t *cache, unsigned short expected_type)
+{
+	LOAD_SELECTOR;
+	//e tagged ints share class_boxed_int, but have no fields to access
+	if (type == expected_type && classref != &class_boxed_int) {
+		inline_cache_add_field(cache, classref, offsetof(object_t, fields) + offset * sizeof(object_member_t));
+	}
+}
+
+void *
+object_read_member_field_obj_cached(object_t *obj, ast_node_t *node, int selector, inline_cache_t *cache)
+{
+	cache_field(obj, node, selector, cache, CLASS_MEMBER_VAR_OBJ);
+	return object_read_member_field_obj(obj, node, selector);
+}
+
+long long int
+object_read_member_field_int_cached(object_t *obj, ast_node_t *node, int selector, inline_cache_t *cache)
+{
+	cache_field(obj, node, selector, cache, CLASS_MEMBER_VAR_INT);
+	return object_read_member_field_int(obj, node, selector);
+}
+
+void
+object_write_member_field_int_cached(object_t *obj, ast_node_t *node, int selector, long long int value, inline_cache_t *cache)
+{
+	cache_field(obj, node, selector, cache, CLASS_MEMBER_VAR_INT);
+	object_write_member_field_int(obj, node, selector, value);
+}
+
+void
+object_write_member_field_obj_cached(object_t *obj, ast_node_t *node, int selector, object_t *value, inline_cache_t *cache)
+{
+	cache_field(obj, node, selector, cache, CLASS_MEMBER_VAR_OBJ);
+	object_write_member_field_obj(obj, node, selector, value);
+}
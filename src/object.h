@@ -32,10 +32,12 @@
 #define _ATTOL_OBJECT_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include "symbol-table.h"
 #include "class.h"
+#include "inline-cache.h"
 
 typedef	union {
 	long long int int_v;
@@ -53,6 +55,38 @@ typedef struct object {
 //d Berechnet den Zeiger auf die C-Zeichenkette aus einem AttoVM-Objekt (führt keine Typprüfung durch!)
 #define OBJECT_STRING(obj) ((char *)(&((obj)->fields[1])))
 
+/*e
+ * Tagged small integers
+ *
+ * An object reference with its lowest bit set is not a pointer but encodes a 63 bit integer (value << 1 | 1).
+ * Such references behave like `Int' objects but must never be dereferenced; use OBJECT_CLASS() to obtain
+ * the class of an arbitrary non-NULL object reference.  Integers outside of the tagged range are still
+ * boxed in a class_boxed_int object.
+ */
+/*d
+ * Markierte kleine Ganzzahlen
+ *
+ * Eine Objektreferenz mit gesetztem niedrigsten Bit ist kein Zeiger, sondern kodiert eine 63-Bit-Ganzzahl
+ * (Wert << 1 | 1).  Solche Referenzen verhalten sich wie `Int'-Objekte, duerfen aber nie dereferenziert werden;
+ * OBJECT_CLASS() liefert die Klasse einer beliebigen Objektreferenz (ungleich NULL).  Ganzzahlen ausserhalb
+ * des markierbaren Bereichs werden weiterhin in einem class_boxed_int-Objekt verpackt.
+ */
+#define OBJECT_INT_TAG			1
+#define OBJECT_TAGGED_INT_MIN		(-(1ll << 62))
+#define OBJECT_TAGGED_INT_MAX		((1ll << 62) - 1)
+#define OBJECT_IS_TAGGED_INT(obj)	(((uintptr_t) (obj)) & OBJECT_INT_TAG)
+#define OBJECT_CAN_TAG_INT(v)		((v) >= OBJECT_TAGGED_INT_MIN && (v) <= OBJECT_TAGGED_INT_MAX)
+#define OBJECT_TAG_INT(v)		((object_t *) (intptr_t) ((((unsigned long long) (v)) << 1) | OBJECT_INT_TAG))
+#define OBJECT_TAGGED_INT_VALUE(obj)	(((long long int) (intptr_t) (obj)) >> 1)
+
+//e class of a non-NULL object reference, which may be a tagged int
+//d Klasse einer Objektreferenz ungleich NULL, die auch eine markierte Ganzzahl sein darf
+#define OBJECT_CLASS(obj)		(OBJECT_IS_TAGGED_INT(obj) ? &class_boxed_int : (obj)->classref)
+
+//e int value of a tagged or boxed int (performs no type check)
+//d Wert einer markierten oder verpackten Ganzzahl (führt keine Typprüfung durch!)
+#define OBJECT_INT_VALUE(obj)		(OBJECT_IS_TAGGED_INT(obj) ? OBJECT_TAGGED_INT_VALUE(obj) : (obj)->fields[0].int_v)
+
 /*d
  * Alloziert ein neues Objekt fuer eine beliebige Klasse
  *
@@ -76,9 +110,13 @@ new_object(class_t *classref, unsigned long long fields_nr);
 
 /*d
  * Alloziert ein neues `Int' Objekt, um eine Ganzzahl zu repraesentieren
+ *
+ * Ganzzahlen im 63-Bit-Bereich werden ohne Allokation als markierte Referenz zurueckgegeben.
  */
 /*e
  * Allocates a new Int object
+ *
+ * Integers that fit into 63 bits are returned as tagged references, without allocation.
  */
 object_t *
 new_int(long long int value);
@@ -173,6 +211,18 @@ object_print(FILE *f, object_t *obj, int depth, bool debug);
 //d Selektor-Zugriff
 //e Selector access
 
+/*e
+ * Invalidates the global (class, selector) lookup cache; must be called whenever a class' member table changes
+ */
+void
+object_selector_cache_flush(void);
+
+/*e
+ * Reports how many selector lookups from C code hit or missed the global lookup cache
+ */
+void
+object_selector_cache_stats(unsigned long long *hits, unsigned long long *misses);
+
 /*d
  * Liest einen Methoden-Zeiger aus einem Objekt, wenn der Eintrag die korrekte Anzahl an Parametern hat
  *
@@ -196,6 +246,16 @@ object_print(FILE *f, object_t *obj, int depth, bool debug);
 void *
 object_get_member_method(object_t *obj, ast_node_t *node, int selector, int parameters_nr);
 
+/*e
+ * Like object_get_member_method(), but also records the result in an inline cache
+ *
+ * Invoked by generated code when the inline cache of a method call site misses.
+ *
+ * @param cache The inline cache of the call site
+ */
+void *
+object_get_member_method_cached(object_t *obj, ast_node_t *node, int selector, int parameters_nr, inline_cache_t *cache);
+
 /*d
  * Laed ein Obj-Feld aus einem Objekt
  *
@@ -268,4 +328,24 @@ object_write_member_field_int(object_t *obj, ast_node_t *node, int selector, lon
 void
 object_write_member_field_obj(object_t *obj, ast_node_t *node, int selector, object_t *value);
 
+/*e
+ * Variants of the above field accessors that also record the field offset in an inline cache
+ *
+ * Invoked by generated code when the inline cache of a field access misses.  Only fields whose type
+ * matches the access (int fields for the `_int' variants, obj fields for the `_obj' variants) are cached.
+ *
+ * @param cache The inline cache of the access site
+ */
+void *
+object_read_member_field_obj_cached(object_t *obj, ast_node_t *node, int selector, inline_cache_t *cache);
+
+long long int
+object_read_member_field_int_cached(object_t *obj, ast_node_t *node, int selector, inline_cache_t *cache);
+
+void
+object_write_member_field_int_cached(object_t *obj, ast_node_t *node, int selector, long long int value, inline_cache_t *cache);
+
+void
+object_write_member_field_obj_cached(object_t *obj, ast_node_t *node, int selector, object_t *value, inline_cache_t *cache);
+
 #endif // !defined(_ATTOL_OBJECT_H)
@@ -0,0 +1,285 @@
+/***************************************************************************
+  Copyright (C) 2015 Christoph Reichenbach
+
+
+ This program may be modified and copied freely according to the terms of
+ the GNU general public license (GPL), as long as the above copyright
+ notice and the licensing information contained herein are preserved.
+
+ Please refer to www.gnu.org for licensing details.
+
+ This work is provided AS IS, without warranty of any kind, expressed or
+ implied, including but not limited to the warranties of merchantability,
+ noninfringement, and fitness for a specific purpose. The author will not
+ be held liable for any damage caused by this work or derivatives of it.
+
+ By using this source code, you agree to the licensing terms as stated
+ above.
+
+
+ Please contact the maintainer for bug reports or inquiries.
+
+ Current Maintainer:
+
+    Christoph Reichenbach (CR) <creichen@gmail.com>
+
+***************************************************************************/
+
+#include <stdlib.h>
+
+#include "ast.h"
+#include "register-allocator.h"
+
+typedef struct {
+	symtab_entry_t *sym;
+	int start, end;		/*e first and last position (inclusive) */
+	bool excluded;		/*e must remain on the stack */
+} live_interval_t;
+
+typedef struct {
+	ast_node_t *loop;
+	int start, end;
+} loop_range_t;
+
+typedef struct {
+	int position;			/*e current position in the linearised AST */
+	live_interval_t *intervals;
+	int intervals_nr, intervals_size;
+	loop_range_t *loops;		/*e loops, innermost first */
+	int loops_nr, loops_size;
+} scan_context_t;
+
+static bool
+is_candidate(symtab_entry_t *sym)
+{
+	return sym
+		&& SYMTAB_KIND(sym) == SYMTAB_KIND_VAR
+		&& SYMTAB_IS_STACK_DYNAMIC(sym)
+		&& sym->id != BUILTIN_OP_SELF
+		&& SYMTAB_TYPE(sym) == TYPE_INT;
+}
+
+static live_interval_t *
+interval_get(scan_context_t *ctx, symtab_entry_t *sym)
+{
+	for (int i = 0; i < ctx->intervals_nr; i++) {
+		if (ctx->intervals[i].sym == sym) {
+			return &ctx->intervals[i];
+		}
+	}
+	if (ctx->intervals_nr == ctx->intervals_size) {
+		ctx->intervals_size = ctx->intervals_size ? ctx->intervals_size * 2 : 16;
+		ctx->intervals = realloc(ctx->intervals, sizeof(live_interval_t) * ctx->intervals_size);
+	}
+	live_interval_t *interval = &ctx->intervals[ctx->intervals_nr++];
+	interval->sym = sym;
+	interval->excluded = false;
+	interval->start = ctx->position;
+	interval->end = ctx->position;
+	return interval;
+}
+
+static void
+occurs(scan_context_t *ctx, symtab_entry_t *sym)
+{
+	interval_get(ctx, sym)->end = ctx->position;
+}
+
+static void
+scan(scan_context_t *ctx, ast_node_t *node)
+{
+	if (!node) {
+		return;
+	}
+	const int loop_start = ctx->position++;
+
+	if (NODE_TY(node) == AST_VALUE_ID) {
+		if (is_candidate(node->sym)) {
+			occurs(ctx, node->sym);
+		}
+		return;
+	}
+	if (IS_VALUE_NODE(node)) {
+		return;
+	}
+
+	for (int i = 0; i < node->children_nr; i++) {
+		ast_node_t *child = node->children[i];
+		if (child && NODE_TY(child) == AST_VALUE_ID && (child->type & AST_FLAG_LVALUE) && is_candidate(child->sym)
+		    && !(i == 0 && (NODE_TY(node) == AST_NODE_ASSIGN || NODE_TY(node) == AST_NODE_VARDECL))) {
+			//e we cannot take the address of a register
+			interval_get(ctx, child->sym)->excluded = true;
+		}
+	}
+
+	if (NODE_TY(node) == AST_NODE_ASSIGN || NODE_TY(node) == AST_NODE_VARDECL) {
+		//e the right-hand side is evaluated first
+		scan(ctx, node->children[1]);
+		scan(ctx, node->children[0]);
+	} else {
+		for (int i = 0; i < node->children_nr; i++) {
+			scan(ctx, node->children[i]);
+		}
+	}
+
+	if (NODE_TY(node) == AST_NODE_WHILE) {
+		if (ctx->loops_nr == ctx->loops_size) {
+			ctx->loops_size = ctx->loops_size ? ctx->loops_size * 2 : 4;
+			ctx->loops = realloc(ctx->loops, sizeof(loop_range_t) * ctx->loops_size);
+		}
+		ctx->loops[ctx->loops_nr].loop = node;
+		ctx->loops[ctx->loops_nr].start = loop_start;
+		ctx->loops[ctx->loops_nr].end = ctx->position++;
+		ctx->loops_nr++;
+	}
+}
+
+static int
+compare_interval_start(const void *a, const void *b)
+{
+	return ((const live_interval_t *) a)->start - ((const live_interval_t *) b)->start;
+}
+
+void
+register_allocation_linear_scan(symtab_entry_t *sym, register_allocation_t *alloc)
+{
+	ast_node_t *fundef = sym->astref;
+	scan_context_t ctx = { .position = 0 };
+
+	//e parameters are live from the entry point on
+	ast_node_t *formals = fundef->children[1];
+	for (int i = 0; i < formals->children_nr; i++) {
+		if (is_candidate(formals->children[i]->sym)) {
+			interval_get(&ctx, formals->children[i]->sym);
+		}
+	}
+	ctx.position++;
+	scan(&ctx, fundef->children[2]);
+
+	//e values may flow around the back edge of any loop that overlaps the interval
+	for (int l = 0; l < ctx.loops_nr; l++) {
+		const loop_range_t *loop = &ctx.loops[l];
+		for (int i = 0; i < ctx.intervals_nr; i++) {
+			live_interval_t *interval = &ctx.intervals[i];
+			if (interval->start <= loop->end && interval->end >= loop->start) {
+				if (interval->start > loop->start) {
+					interval->start = loop->start;
+				}
+				if (interval->end < loop->end) {
+					interval->end = loop->end;
+				}
+			}
+		}
+	}
+
+	qsort(ctx.intervals, ctx.intervals_nr, sizeof(live_interval_t), compare_interval_start);
+
+	alloc->assignments = calloc(ctx.intervals_nr + 1, sizeof(register_assignment_t));
+	alloc->assignments_nr = 0;
+	alloc->used_nr = 0;
+	for (int r = 0; r < REGISTERS_CALLEE_SAVED_NR; r++) {
+		alloc->used[r] = false;
+	}
+
+	//e intervals currently occupying each register, if any
+	live_interval_t *active[REGISTERS_CALLEE_SAVED_NR] = { NULL };
+	int assignment_index[REGISTERS_CALLEE_SAVED_NR];
+
+	for (int i = 0; i < ctx.intervals_nr; i++) {
+		live_interval_t *interval = &ctx.intervals[i];
+		if (interval->excluded) {
+			continue;
+		}
+		int free_reg = -1;
+		int furthest_reg = -1;
+		for (int r = 0; r < REGISTERS_CALLEE_SAVED_NR; r++) {
+			if (active[r] && active[r]->end < interval->start) {
+				//e expired
+				active[r] = NULL;
+			}
+			if (!active[r]) {
+				if (free_reg < 0) {
+					free_reg = r;
+				}
+			} else if (furthest_reg < 0 || active[r]->end > active[furthest_reg]->end) {
+				furthest_reg = r;
+			}
+		}
+
+		if (free_reg < 0) {
+			//e spill whichever interval ends last
+			if (active[furthest_reg]->end <= interval->end) {
+				continue;
+			}
+			free_reg = furthest_reg;
+			alloc->assignments[assignment_index[free_reg]].sym = NULL;
+		}
+
+		active[free_reg] = interval;
+		assignment_index[free_reg] = alloc->assignments_nr;
+		alloc->assignments[alloc->assignments_nr].sym = interval->sym;
+		alloc->assignments[alloc->assignments_nr].reg = registers_callee_saved[free_reg];
+		alloc->assignments[alloc->assignments_nr].start = interval->start;
+		alloc->assignments[alloc->assignments_nr].end = interval->end;
+		alloc->assignments_nr++;
+		if (!alloc->used[free_reg]) {
+			alloc->used[free_reg] = true;
+			alloc->used_nr++;
+		}
+	}
+
+	alloc->loops = calloc(ctx.loops_nr + 1, sizeof(register_loop_t));
+	alloc->loops_nr = ctx.loops_nr;
+	for (int l = 0; l < ctx.loops_nr; l++) {
+		alloc->loops[l].loop = ctx.loops[l].loop;
+		alloc->loops[l].start = ctx.loops[l].start;
+	}
+
+	free(ctx.intervals);
+	free(ctx.loops);
+}
+
+int
+register_allocation_lookup(register_allocation_t *alloc, symtab_entry_t *sym)
+{
+	for (int i = 0; i < alloc->assignments_nr; i++) {
+		if (alloc->assignments[i].sym == sym) {
+			return alloc->assignments[i].reg;
+		}
+	}
+	return -1;
+}
+
+int
+register_allocation_live_at_loop(register_allocation_t *alloc, ast_node_t *loop, register_assignment_t *live)
+{
+	int position = -1;
+	for (int l = 0; l < alloc->loops_nr; l++) {
+		if (alloc->loops[l].loop == loop) {
+			position = alloc->loops[l].start;
+		}
+	}
+	if (position < 0) {
+		return 0;
+	}
+	int live_nr = 0;
+	for (int i = 0; i < alloc->assignments_nr; i++) {
+		register_assignment_t *assignment = &alloc->assignments[i];
+		//e intervals that share a register never overlap, so at most one of them contains `position'
+		if (assignment->sym && assignment->start <= position && position <= assignment->end) {
+			live[live_nr++] = *assignment;
+		}
+	}
+	return live_nr;
+}
+
+void
+register_allocation_free(register_allocation_t *alloc)
+{
+	free(alloc->assignments);
+	alloc->assignments = NULL;
+	alloc->assignments_nr = 0;
+	free(alloc->loops);
+	alloc->loops = NULL;
+	alloc->loops_nr = 0;
+}
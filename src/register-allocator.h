@@ -0,0 +1,99 @@
+/***************************************************************************
+  Copyright (C) 2015 Christoph Reichenbach
+
+
+ This program may be modified and copied freely according to the terms of
+ the GNU general public license (GPL), as long as the above copyright
+ notice and the licensing information contained herein are preserved.
+
+ Please refer to www.gnu.org for licensing details.
+
+ This work is provided AS IS, without warranty of any kind, expressed or
+ implied, including but not limited to the warranties of merchantability,
+ noninfringement, and fitness for a specific purpose. The author will not
+ be held liable for any damage caused by this work or derivatives of it.
+
+ By using this source code, you agree to the licensing terms as stated
+ above.
+
+
+ Please contact the maintainer for bug reports or inquiries.
+
+ Current Maintainer:
+
+    Christoph Reichenbach (CR) <creichen@gmail.com>
+
+***************************************************************************/
+
+//e Linear-scan register allocation for optimised code
+
+#ifndef _ATTOL_REGISTER_ALLOCATOR_H
+#define _ATTOL_REGISTER_ALLOCATOR_H
+
+#include <stdbool.h>
+
+#include "ast.h"
+#include "registers.h"
+#include "symbol-table.h"
+
+typedef struct {
+	symtab_entry_t *sym;	/*e local variable or parameter */
+	int reg;		/*e register number (one of registers_callee_saved) */
+	int start, end;		/*e live interval, as positions in the linearised AST */
+} register_assignment_t;
+
+typedef struct {
+	ast_node_t *loop;	/*e WHILE node */
+	int start;		/*e position of the loop header in the linearised AST */
+} register_loop_t;
+
+/*e
+ * Assignment of local variables to callee-saved registers for one function/method/constructor
+ *
+ * Variables without an assignment remain in their stack slots.  Only variables of type `int'
+ * are candidates, so registers never hold references and the stack maps remain precise without
+ * any spilling around call sites.
+ */
+typedef struct {
+	register_assignment_t *assignments;
+	int assignments_nr;
+	bool used[REGISTERS_CALLEE_SAVED_NR];	/*e registers_callee_saved[i] is in use and must be saved/restored */
+	int used_nr;				/*e number of registers in use */
+	register_loop_t *loops;
+	int loops_nr;
+} register_allocation_t;
+
+/*e
+ * Computes a register allocation for the body of the given callable
+ *
+ * Live intervals are approximated over the linearised AST: each candidate variable lives from
+ * its first to its last occurrence (parameters from the function entry), extended across any
+ * loop that it is live in.
+ *
+ * @param sym The function, method or constructor to allocate registers for
+ * @param alloc The allocation to fill in; must be freed with register_allocation_free()
+ */
+void
+register_allocation_linear_scan(symtab_entry_t *sym, register_allocation_t *alloc);
+
+/*e
+ * Looks up the register assigned to a variable
+ *
+ * @return The register holding `sym', or -1 if `sym' lives on the stack
+ */
+int
+register_allocation_lookup(register_allocation_t *alloc, symtab_entry_t *sym);
+
+/*e
+ * Lists the variables whose registers may hold live values when entering a loop's header
+ *
+ * @param live Array of at least alloc->assignments_nr entries to fill in
+ * @return Number of entries written to `live'
+ */
+int
+register_allocation_live_at_loop(register_allocation_t *alloc, ast_node_t *loop, register_assignment_t *live);
+
+void
+register_allocation_free(register_allocation_t *alloc);
+
+#endif // !defined(_ATTOL_REGISTER_ALLOCATOR_H)
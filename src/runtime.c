@@ -31,11 +31,14 @@
 
 #include "analysis.h"
 #include "baseline-backend.h"
+#include "class.h"
 #include "compiler-options.h"
+#include "cstack.h"
 #include "data-flow.h"
 #include "debugger.h"
 #include "dynamic-compiler.h"
 #include "heap.h"
+#include "inline-cache.h"
 #include "runtime.h"
 #include "stackmap.h"
 #include "symbol-table.h"
@@ -47,10 +50,15 @@ struct compiler_options compiler_options = {
 	.debug_adaptive			= false,
 	.debug_gc			= false,
 	.no_adaptive_compilation	= false,
+	.background_compilation		= false,
 	.array_storage_type		= TYPE_OBJ,
 	.method_call_param_type		= TYPE_OBJ,
 	.method_call_return_type	= TYPE_OBJ,
-	.heap_size			= 0x20000000 /* 20 MiB default */
+	.heap_size			= 0x100000000, /* 4 GiB default maximum */
+	.heap_min_size			= 0x1000000, /* 16 MiB default minimum */
+	.gc_threads			= 1,
+	.gc_mark_compact		= false,
+	.large_object_threshold		= 0x4000
 };
 
 static runtime_image_t *last = NULL;
@@ -138,8 +146,8 @@ runtime_prepare(ast_node_t *ast, unsigned int action)
 	image->dyncomp = dyncomp_build_generic();
 	image->trampoline = dyncomp_build_trampoline(buffer_entrypoint(image->dyncomp),
 						     image->callables, image->storage->functions_nr + image->classes_nr);
-	heap_init(compiler_options.heap_size);
-	image->code_buffer = baseline_compile_entrypoint(ast, image->storage, image->static_memory);
+	heap_init(compiler_options.heap_min_size, compiler_options.heap_size);
+	image->code_buffer = baseline_compile_entrypoint(ast, main_sym, image->static_memory);
 	image->main_entry_point = buffer_entrypoint(image->code_buffer);
 
 	last = image;
@@ -220,8 +228,10 @@ runtime_execute(runtime_image_t *img)
 void
 runtime_free(runtime_image_t *img)
 {
+	dyncomp_background_stop();
 	heap_free();
 	stackmap_clear();
+	inline_cache_clear();
 	if (img->globals_nr) {
 		free(img->static_memory);
 		img->static_memory = NULL;
@@ -229,16 +239,32 @@ runtime_free(runtime_image_t *img)
 	if (img->code_buffer) {
 		buffer_free(img->code_buffer);
 	}
+	if (img->main_entry_sym) {
+		dyncomp_loop_records_free(symtab_lookup(img->main_entry_sym));
+	}
 	if (img->callables) {
 		for (int i = 0; i < img->callables_nr; i++) {
 			symtab_entry_t *sym = AST_CALLABLE_SYMREF(img->callables[i]);
 			if (sym->r_mem != sym->r_trampoline) {
 				buffer_free(buffer_from_entrypoint(sym->r_mem));
 			}
+			if (sym->r_call_sites) {
+				stack_free(sym->r_call_sites, NULL);
+				sym->r_call_sites = NULL;
+			}
+			dyncomp_loop_records_free(sym);
+			dyncomp_versions_free(sym);
 		}
 		free(img->callables);
 	}
 	if (img->classes) {
+		for (int i = 0; i < img->classes_nr; i++) {
+			symtab_entry_t *class_sym = AST_CALLABLE_SYMREF(img->classes[i]);
+			if (class_sym->r_mem) {
+				class_free((class_t *) class_sym->r_mem);
+				class_sym->r_mem = NULL;
+			}
+		}
 		free(img->classes);
 	}
 	if (img->dyncomp) {
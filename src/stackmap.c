@@ -25,12 +25,33 @@
 
 ***************************************************************************/
 
-#include "chash.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "stackmap.h"
 
+#define STACKMAP_INITIAL_SIZE 64
+
+/*e
+ * The registry is a single array of entries, sorted by (return) address, so that
+ * stackmap_get() can use binary search.  Code is emitted at increasing addresses, so
+ * stackmap_put() almost always appends.
+ */
+typedef struct {
+	void *address;
+	bitvector_t stackmap;
+	symtab_entry_t *symtab_entry;
+	int frame_start;	/*e $fp offset of the stack entry that bit 0 describes */
+} stackmap_entry_t;
+
 cstack_t *debug_stack = NULL;
-static hashtable_t *bitvector_registry = NULL;
-static hashtable_t *symtab_registry = NULL;
+static stackmap_entry_t *registry = NULL;
+static size_t registry_size = 0;
+static size_t registry_capacity = 0;
+//e the background compiler adds stack maps while the garbage collector looks them up
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
 
 void
 stackmap_debug(cstack_t *stack)
@@ -41,45 +62,100 @@ stackmap_debug(cstack_t *stack)
 void
 stackmap_init(void)
 {
-	if (bitvector_registry) {
+	if (registry) {
 		stackmap_clear();
 	}
-	bitvector_registry = hashtable_alloc(hashtable_pointer_hash, hashtable_pointer_compare, 10);
-	symtab_registry = hashtable_alloc(hashtable_pointer_hash, hashtable_pointer_compare, 10);
+	registry_capacity = STACKMAP_INITIAL_SIZE;
+	registry = malloc(sizeof(stackmap_entry_t) * registry_capacity);
+	if (!registry) {
+		fprintf(stderr, "Cannot allocate stack map registry; out of memory\n");
+		exit(1);
+	}
+	registry_size = 0;
 }
 
 void
 stackmap_clear(void)
 {
-	if (bitvector_registry) {
-		hashtable_free(bitvector_registry, NULL, (void (*)(void *)) bitvector_free);
-		hashtable_free(symtab_registry, NULL, NULL);
-		bitvector_registry = NULL;
-		symtab_registry = NULL;
+	if (registry) {
+		for (size_t i = 0; i < registry_size; i++) {
+			bitvector_free(registry[i].stackmap);
+		}
+		free(registry);
+		registry = NULL;
+		registry_size = registry_capacity = 0;
+	}
+}
+
+//e index of the first entry with an address not less than `address'
+static size_t
+stackmap_search(void *address)
+{
+	size_t low = 0;
+	size_t high = registry_size;
+	while (low < high) {
+		size_t mid = low + ((high - low) >> 1);
+		if (registry[mid].address < address) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
 	}
+	return low;
 }
 
 void
 stackmap_put(void *address, bitvector_t bitvector, symtab_entry_t *entry)
 {
+	//e record the frame layout now: code that is still running may outlive recompilation
+	const int frame_start = entry ? entry->stackframe_start : -(int) (sizeof(void *) * bitvector_size(bitvector));
+
+	pthread_mutex_lock(&registry_lock);
 	if (debug_stack) {
 		stack_push(debug_stack, &address);
 	}
-	void *value = (void *) bitvector.large;
-	hashtable_put(bitvector_registry, address, value, (void (*)(void *)) bitvector_free);
-	hashtable_put(symtab_registry, address, (void *) entry, NULL);
+	size_t index = registry_size;
+	if (registry_size && registry[registry_size - 1].address >= address) {
+		index = stackmap_search(address);
+		if (registry[index].address == address) {
+			//e re-used code address: replace
+			bitvector_free(registry[index].stackmap);
+			registry[index].stackmap = bitvector;
+			registry[index].symtab_entry = entry;
+			registry[index].frame_start = frame_start;
+			pthread_mutex_unlock(&registry_lock);
+			return;
+		}
+	}
+
+	if (registry_size == registry_capacity) {
+		registry_capacity <<= 1;
+		registry = realloc(registry, sizeof(stackmap_entry_t) * registry_capacity);
+		if (!registry) {
+			fprintf(stderr, "Cannot grow stack map registry; out of memory\n");
+			exit(1);
+		}
+	}
+	memmove(registry + index + 1, registry + index, sizeof(stackmap_entry_t) * (registry_size - index));
+	registry[index].address = address;
+	registry[index].stackmap = bitvector;
+	registry[index].symtab_entry = entry;
+	registry[index].frame_start = frame_start;
+	++registry_size;
+	pthread_mutex_unlock(&registry_lock);
 }
 
 bool
-stackmap_get(void *address, bitvector_t *bitvector, symtab_entry_t **entry)
+stackmap_get(void *address, bitvector_t *bitvector, symtab_entry_t **entry, int *frame_start)
 {
-	void **ref = hashtable_access(bitvector_registry, address, NULL);
-	if (!ref) {
-		return false;
+	pthread_mutex_lock(&registry_lock);
+	size_t index = stackmap_search(address);
+	const bool found = index < registry_size && registry[index].address == address;
+	if (found) {
+		*bitvector = registry[index].stackmap;
+		*entry = registry[index].symtab_entry;
+		*frame_start = registry[index].frame_start;
 	}
-	*bitvector = (bitvector_t) (unsigned long long *) (*ref);
-	*entry = hashtable_get(symtab_registry, address);
-	return true;
+	pthread_mutex_unlock(&registry_lock);
+	return found;
 }
-
-
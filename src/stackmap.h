@@ -66,18 +66,23 @@ stackmap_put(void *address, bitvector_t stackmap, symtab_entry_t *symtab_entry);
  * Requests a stack map from the registry
  *
  * Bitvector entry 0 describes the stack entry at a position relative to $fp, indicated
- * by symtab_entry->stackframe_start.
+ * by the value of symtab_entry->stackframe_start at the time of stackmap_put().  (The
+ * dynamic compiler may have recompiled the code since, e.g., with optimisations.)
  *
  * May load NULL to (*symtab_entry) and still return `true'.  This happens for
  * code without a symbol table entry.  In that case, the last `bitvector' entry
  * describes the entry immediately below the frame pointer.
  *
+ * Lookups use binary search and may run concurrently (e.g., in parallel garbage
+ * collection), as long as there is no concurrent stackmap_put().
+ *
  * @param address The address to look for
  * @param stackmap Pointer to a bitvector variable to write the stackmap to
  * @param symtab_entry_t * Pointer to a symbol table entry pointer to write to
+ * @param frame_start Pointer to write the $fp offset (in bytes) described by bitvector entry 0 to
  * @return true iff the address was recognised
  */
 bool
-stackmap_get(void *address, bitvector_t *stackmap, symtab_entry_t **symtab_entry);
+stackmap_get(void *address, bitvector_t *stackmap, symtab_entry_t **symtab_entry, int *frame_start);
 
 #endif // !defined(_ATTOL_STACKMAP_H)
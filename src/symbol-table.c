@@ -30,6 +30,7 @@
 
 #include "ast.h"
 #include "chash.h"
+#include "cstack.h"
 #include "lexer-support.h"
 #include "symbol-table.h"
 
@@ -283,6 +284,13 @@ symtab_entry_dump(FILE *file, symtab_entry_t *entry)
 	}
 }
 
+//e frees a cstack element that is a pointer to separately allocated memory
+static void
+free_pointer_element(void *element)
+{
+	free(*((void **) element));
+}
+
 static void
 symtab_entry_free(symtab_entry_t *e)
 {
@@ -292,9 +300,27 @@ symtab_entry_free(symtab_entry_t *e)
 	if (e->dynamic_parameter_types) {
 		free(e->dynamic_parameter_types);
 	}
+	if (e->parameter_guard_failures) {
+		free(e->parameter_guard_failures);
+	}
 	if (e->cfg_exit) {
 		cfg_node_free(e->cfg_exit);
 	}
+	if (e->r_call_sites) {
+		stack_free(e->r_call_sites, NULL);
+	}
+	if (e->r_osr_loops) {
+		stack_free(e->r_osr_loops, free_pointer_element);
+	}
+	if (e->r_type_feedback) {
+		stack_free(e->r_type_feedback, NULL);
+	}
+	if (e->r_versions) {
+		stack_free(e->r_versions, NULL);
+	}
+	if (e->r_version_bindings) {
+		stack_free(e->r_version_bindings, NULL);
+	}
 	free(e);
 }
 
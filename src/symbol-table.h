@@ -75,6 +75,7 @@ typedef struct {
 
 struct cfg_node;
 struct class_struct;
+struct cstack;
 struct object;
 
 typedef struct symtab_entry {
@@ -88,10 +89,20 @@ typedef struct symtab_entry {
 	struct cfg_node *cfg_exit;		/*d Endknoten des Kontrollflussgraphen (fuer SYMTAB_KIND_FUNCTION*/ /*e control flow graph exit node (for SYMTAB_KIND_FUNCTION) */
 	void *r_trampoline;			/*d Zeiger auf Trampolin-Code, falls vorhanden */ /*e pointer to trampoline code, if present */
 	void *r_mem;				/*d Zeiger auf Funktion / Klassenobjekt */ /*e pointer to function or class object */
+	void *r_mem_unoptimised;		/*e functions/methods: entry point of the most recent unoptimised code, which deoptimisation reinstalls */
+	struct cstack *r_call_sites;		/*e direct call sites (label_t) into r_mem, back-patched by the dynamic compiler whenever r_mem changes */
+	struct cstack *r_osr_loops;		/*e hotness records (dyncomp_loop_t *) of loops in unoptimised code, with entry points for on-stack replacement */
+	struct cstack *r_type_feedback;		/*e receiver class profiles (dyncomp_type_feedback_t) of member accesses and method calls in this function */
+	struct cstack *r_versions;		/*e optimised versions (dyncomp_version_t), each specialised to one tuple of parameter classes */
+	void *r_dispatcher;			/*e entry point of the type dispatcher that selects from r_versions, or NULL while we have not needed one */
+	struct cstack *r_version_bindings;	/*e direct calls from this function's optimised code into versions of callees (dyncomp_version_binding_t) */
+	void *r_mem_preallocated;		/*e constructors: entry point that initialises the preallocated object in $t1 (cf. OPT_FLAG_STACK_ALLOCATE) */
 	unsigned short *parameter_types;	/*e for constructors, parameter_types and parameters_nr are 0.  Refer to the class to access them. */
 	struct class_struct **dynamic_parameter_types;	/*e dynamically detected parameter types, using class_top, class_bottom as lattice, and NULL to indicate non-object parameters */
+	unsigned char *parameter_guard_failures;	/*e per parameter: number of deoptimisations that the parameter's type guard caused */
 	long fast_hotness_counter;		/*e outer hotness counter (decreased by generated `cold' code, triggers sampling) */
 	unsigned short slow_hotness_counter;	/*e inner hotness counter (decreased by ) */
+	unsigned short deoptimisations_nr;	/*e number of times that we have deoptimised this function */
 	unsigned short parameters_nr;
 	unsigned short selector;		/*d Globale ID für Felder und Methoden */ /* Global ID for fields and methods */
 	signed short offset;			/*d MEMBER | VAR: Offset in Speicher der Struktur
@@ -401,12 +401,15 @@ analyse(ast_node_t *node, symtab_entry_t *classref, symtab_entry_t *function, co
 
 		ast_node_t *self_update_ref = BUILTIN(SELF);
 		self_update_ref->type |= AST_FLAG_LVALUE;
+		ast_node_t *allocation = CONS(FUNAPP,
+					      BUILTIN(ALLOCATE),
+					      CONS(ACTUALS,
+						   CONSV(INT, num = classref->id)));
+		//e the backends consult this type to tell the GC that `self' now holds a reference
+		allocation->type |= TYPE_OBJ;
 		cons_body[cons_body_offset++] = CONS(ASSIGN,
 						     self_update_ref,
-						     CONS(FUNAPP,
-							  BUILTIN(ALLOCATE),
-							  CONS(ACTUALS,
-							       CONSV(INT, num = classref->id))));
+						     allocation);
 
 		for (int i = 0; i < class_body_size; i++) {
 			ast_node_t *write = NULL;